@@ -1,9 +1,11 @@
-.PHONY: test run-test-args
+.PHONY: test run-test-args run-isa-tests run-test-rvc-reserved \
+	run-pcache-tests run-test-stats
 
 TEST_ARGS_FILE = tests/program-arguments/dut.elf
 TEST_ARGS_EXPECT_FILE = tests/program-arguments/reference.out
 
-test: run-test-args
+test: run-test-args run-isa-tests run-test-rvc-reserved run-pcache-tests \
+	run-test-stats
 
 run-test-args: $(BIN) $(TEST_ARGS_FILE)
 	$(Q)result="$$(./$(BIN) $(TEST_ARGS_FILE) -abcd -1234 -boom=1)"; \
@@ -17,3 +19,103 @@ run-test-args: $(BIN) $(TEST_ARGS_FILE)
 	echo "$$result";\
 	fi
 
+# Self-checking guest tests in tests/isa/<name>.S, built with clang and lld.
+# Each one exits with 0 if all of its checks passed.
+GUEST_CC = $(CXX) --target=riscv32-unknown-elf
+GUEST_FLAGS = -mabi=ilp32 -mno-relax -nostdlib -static -fuse-ld=lld -I tests/isa
+
+ISA_TESTS = rv32m rv32a rvc rv32fd rv32b rvv rdtime ras brind chain smc \
+	evict
+rv32m_MARCH = rv32im
+rv32a_MARCH = rv32ima
+rvc_MARCH = rv32imc
+rv32fd_MARCH = rv32imafdc
+rv32b_MARCH = rv32im_zba_zbb_zbs
+rvv_MARCH = rv32imafdv
+rdtime_MARCH = rv32im_zicsr
+ras_MARCH = rv32im
+brind_MARCH = rv32im
+chain_MARCH = rv32im
+smc_MARCH = rv32imc
+evict_MARCH = rv32im
+
+# Every test runs translated, interpreted, with background compilation, with
+# the smallest code cache and translated ahead of time
+TEST_CONFIGS = "" "RV32JIT_HOT_THRESHOLD=1000000" "RV32JIT_COMPILE_THREADS=2" \
+	"RV32JIT_CODE_CACHE_KB=512" "RV32JIT_AOT_THREADS=2"
+
+ISA_TEST_ELFS := $(addprefix $(OUT)/tests/, $(addsuffix .elf, $(ISA_TESTS)))
+
+$(OUT)/tests/%.elf: tests/isa/%.S tests/isa/check.inc
+	$(VECHO) "  AS\t$@\n"
+	$(Q)$(GUEST_CC) -march=$($*_MARCH) $(GUEST_FLAGS) -o $@ $<
+
+run-isa-tests: $(BIN) $(ISA_TEST_ELFS)
+	$(Q)for t in $(ISA_TESTS); do \
+	for cfg in $(TEST_CONFIGS); do \
+	$(PRINTF) "Running $$t $$cfg ... "; \
+	if env $$cfg ./$(BIN) $(OUT)/tests/$$t.elf > $(OUT)/tests/$$t.out; then \
+	$(call notice, [OK]); \
+	else \
+	$(PRINTF) "Failed.\n"; \
+	grep FAIL $(OUT)/tests/$$t.out; \
+	exit 1; \
+	fi; \
+	done; \
+	done
+
+# Reserved encodings selected by the argument, each one has to trap
+RVC_RESERVED_CASES = 1 2 3 4 5 6
+rvc-reserved_MARCH = rv32imc
+
+run-test-rvc-reserved: $(BIN) $(OUT)/tests/rvc-reserved.elf
+	$(Q)for n in $(RVC_RESERVED_CASES); do \
+	for cfg in $(TEST_CONFIGS); do \
+	$(PRINTF) "Running rvc-reserved $$n $$cfg ... "; \
+	result="$$(env $$cfg ./$(BIN) $(OUT)/tests/rvc-reserved.elf $$n)"; \
+	if [ $$? -ne 0 ] && [ "$$result" = "trap $$n" ]; then \
+	$(call notice, [OK]); \
+	else \
+	$(PRINTF) "Failed.\n"; \
+	echo "$$result"; \
+	exit 1; \
+	fi; \
+	done; \
+	done
+
+# Each test runs twice with an empty persistent cache directory: the first
+# run saves translations, the second one starts from them. smc checks that
+# translations of patched code are not saved
+PCACHE_TESTS = ras brind smc evict
+PCACHE_DIR = $(OUT)/tests/pcache
+
+run-pcache-tests: $(BIN) $(ISA_TEST_ELFS)
+	$(Q)for t in $(PCACHE_TESTS); do \
+	rm -rf $(PCACHE_DIR); mkdir -p $(PCACHE_DIR); \
+	for run in save load; do \
+	$(PRINTF) "Running $$t pcache $$run ... "; \
+	if RV32JIT_PCACHE_DIR=$(PCACHE_DIR) ./$(BIN) $(OUT)/tests/$$t.elf \
+		> $(OUT)/tests/$$t.out && [ -n "$$(ls $(PCACHE_DIR))" ]; then \
+	$(call notice, [OK]); \
+	else \
+	$(PRINTF) "Failed.\n"; \
+	grep FAIL $(OUT)/tests/$$t.out; \
+	exit 1; \
+	fi; \
+	done; \
+	done
+
+# Statistics are printed with RV32JIT_TCACHE_STATS only, lookups are counted
+# then
+run-test-stats: $(BIN) $(OUT)/tests/brind.elf
+	$(Q)$(PRINTF) "Running tcache stats ... "; \
+	stats="$$(RV32JIT_TCACHE_STATS=1 ./$(BIN) $(OUT)/tests/brind.elf 2>&1 \
+		> /dev/null)"; \
+	plain="$$(./$(BIN) $(OUT)/tests/brind.elf 2>&1 > /dev/null)"; \
+	if echo "$$stats" | grep -Eq "lookups: +[1-9]" && [ -z "$$plain" ]; then \
+	$(call notice, [OK]); \
+	else \
+	$(PRINTF) "Failed.\n"; \
+	echo "$$stats"; \
+	exit 1; \
+	fi
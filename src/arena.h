@@ -25,6 +25,13 @@ struct MemArena {
     void Destroy();
     void Reset() { used = 0; }
 
+    u8 *BasePtr() const { return pool; }
+
+    bool HasSpace(size_t alloc_sz, size_t align) const
+    {
+        return roundup(used, align) + alloc_sz <= pool_sz;
+    }
+
     void *Allocate(size_t alloc_sz, size_t align)
     {
         size_t alloc_start = roundup(used, align);
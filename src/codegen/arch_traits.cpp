@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cpuid.h>
 #include <numeric>
 
 #include "codegen/arch_traits.h"
@@ -25,16 +26,19 @@ struct InstCt {
     using ct_order = std::array<u8, N_OUT + N_IN>;
 
     static constexpr InstCt Make(std::array<RACtDef, N_OUT> &&odef_set,
-                                 std::array<RACtDefOrAlias, N_IN> &&idef_set);
+                                 std::array<RACtDefOrAlias, N_IN> &&idef_set,
+                                 RegMask clobber = RegMask(0));
 
     ct_desc ct;
     ct_order order;
+    RegMask clobber;  // overwritten by the instruction besides outputs
 };
 
 template <u8 N_OUT, u8 N_IN>
 constexpr InstCt<N_OUT, N_IN> InstCt<N_OUT, N_IN>::Make(
     std::array<RACtDef, N_OUT> &&odef_set,
-    std::array<RACtDefOrAlias, N_IN> &&idef_set)
+    std::array<RACtDefOrAlias, N_IN> &&idef_set,
+    RegMask clobber)
 {
     using ct_type = std::array<RAOpCt, N_OUT + N_IN>;
     ct_type ct;
@@ -70,7 +74,7 @@ constexpr InstCt<N_OUT, N_IN> InstCt<N_OUT, N_IN>::Make(
     order_ct(0, N_OUT);
     order_ct(N_OUT, N_IN);
 
-    return {ct, order};
+    return {ct, order, clobber};
 }
 
 namespace RACtGPR
@@ -79,9 +83,20 @@ constexpr auto R = ArchTraits::GPR_ALL;
 constexpr auto R8 = ArchTraits::GPR_ALL;
 constexpr auto CX = RegMask(0).Set(ArchTraits::RCX);
 constexpr auto SI = RegMask(0).Set(ArchTraits::RSI);
+constexpr auto AX = RegMask(0).Set(ArchTraits::RAX);
+constexpr auto DX = RegMask(0).Set(ArchTraits::RDX);
+constexpr auto AXDX = AX | DX;
+constexpr auto R_NO_AX = ArchTraits::GPR_ALL & ~AX;
+constexpr auto R_NO_AXDX = ArchTraits::GPR_ALL & ~AXDX;
 };  // namespace RACtGPR
 
+namespace RACtXMM
+{
+constexpr auto X = ArchTraits::XMM_POOL;
+};  // namespace RACtXMM
+
 #define GPR(X) RACtGPR::X
+#define XMM(X) RACtXMM::X
 #define IMM(X) RACtImm::X
 #define DEF(...) RACtDef(__VA_ARGS__)
 #define ALIAS(X) RACtDefOrAlias(X)
@@ -101,40 +116,169 @@ _(r_0_ru32) = InstCt<1, 2>::Make({DEF(GPR(R))},
                                  {ALIAS(0), DEF(GPR(R), IMM(U32))});
 _(r_0_cxi) = InstCt<1, 2>::Make({DEF(GPR(R))},
                                 {ALIAS(0), DEF(GPR(CX), IMM(ANY))});
+_(ax_ax_r) = InstCt<1, 2>::Make({DEF(GPR(AX))},
+                                {DEF(GPR(AX)), DEF(GPR(R_NO_AXDX))},
+                                GPR(AXDX));
+_(dx_ax_r) = InstCt<1, 2>::Make({DEF(GPR(DX))},
+                                {DEF(GPR(AX)), DEF(GPR(R_NO_AXDX))},
+                                GPR(AXDX));
+_(ax_ru32_r) = InstCt<1, 2>::Make(
+    {DEF(GPR(AX))},
+    {DEF(GPR(R_NO_AXDX), IMM(U32)), DEF(GPR(R_NO_AXDX))}, GPR(AXDX));
+_(r_ru32_0) = InstCt<1, 2>::Make({DEF(GPR(R))},
+                                 {DEF(GPR(R), IMM(U32)), ALIAS(0)});
+_(r_r) = InstCt<1, 1>::Make({DEF(GPR(R))}, {DEF(GPR(R))});
+_(r_r_r) = InstCt<1, 2>::Make({DEF(GPR(R))}, {DEF(GPR(R)), DEF(GPR(R))});
+_(r_0) = InstCt<1, 1>::Make({DEF(GPR(R))}, {ALIAS(0)});
+_(r_0_r) = InstCt<1, 2>::Make({DEF(GPR(R))}, {ALIAS(0), DEF(GPR(R))});
+_(r_r_cxi) = InstCt<1, 2>::Make({DEF(GPR(R))},
+                                {DEF(GPR(R)), DEF(GPR(CX), IMM(ANY))});
+// Vector operands are state slots, the last input indexes tail masks
+_(r_r_r_r) = InstCt<1, 3>::Make({DEF(GPR(R))},
+                                {DEF(GPR(R)), DEF(GPR(R)), DEF(GPR(R))});
+_(x_x) = InstCt<1, 1>::Make({DEF(XMM(X))}, {DEF(XMM(X))});
+_(x_x_x) = InstCt<1, 2>::Make({DEF(XMM(X))}, {DEF(XMM(X)), DEF(XMM(X))});
+_(r8_x_x) = InstCt<1, 2>::Make({DEF(GPR(R8))}, {DEF(XMM(X)), DEF(XMM(X))});
+_(r_x) = InstCt<1, 1>::Make({DEF(GPR(R))}, {DEF(XMM(X))});
+_(x_r) = InstCt<1, 1>::Make({DEF(XMM(X))}, {DEF(GPR(R))});
+_(x_ru32) = InstCt<1, 1>::Make({DEF(XMM(X))}, {DEF(GPR(R), IMM(U32))});
+_(ri_x) = InstCt<0, 2>::Make({}, {DEF(GPR(R), IMM(ANY)), DEF(XMM(X))});
+// eax is a scratch register
+_(nax_0) = InstCt<1, 1>::Make({DEF(GPR(R_NO_AX))}, {ALIAS(0)}, GPR(AX));
+// rdtsc returns in edx:eax
+_(naxdx) = InstCt<1, 0>::Make({DEF(GPR(R_NO_AXDX))}, {}, GPR(AXDX));
 #undef _
 
 #undef GPR
+#undef XMM
 #undef IMM
 #undef DEF
 #undef ALIAS
 
 // TODO: verify, check cpuinfo
-#define ARCH_OP_CT_LIST \
-    _(brcc, r_rs32)     \
-    _(gbrind, si)       \
-    _(vmload, r_ru32)   \
-    _(vmstore, ri_r)    \
-    _(setcc, r8_r_rs32) \
-    _(mov, r_ri)        \
-    _(add, r_0_rs32)    \
-    _(sub, r_0_rs32)    \
-    _(and, r_0_ru32)    \
-    _(or, r_0_rs32)     \
-    _(xor, r_0_rs32)    \
-    _(sra, r_0_cxi)     \
-    _(srl, r_0_cxi)     \
-    _(sll, r_0_cxi)
+#define ARCH_OP_CT_LIST   \
+    _(brcc, r_rs32)       \
+    _(gbrind, si)         \
+    _(vmload, r_ru32)     \
+    _(vmstore, ri_r)      \
+    _(setcc, r8_r_rs32)   \
+    _(mov, r_ri)          \
+    _(add, r_0_rs32)      \
+    _(sub, r_0_rs32)      \
+    _(and, r_0_ru32)      \
+    _(or, r_0_rs32)       \
+    _(xor, r_0_rs32)      \
+    _(sra, r_0_cxi)       \
+    _(srl, r_0_cxi)       \
+    _(sll, r_0_cxi)       \
+    _(mul, r_0_rs32)      \
+    _(mulh, dx_ax_r)      \
+    _(mulhsu, dx_ax_r)    \
+    _(mulhu, dx_ax_r)     \
+    _(div, ax_ax_r)       \
+    _(divu, ax_ax_r)      \
+    _(rem, dx_ax_r)       \
+    _(remu, dx_ax_r)      \
+    _(vmlr, r_ru32)       \
+    _(vmsc, ax_ru32_r)    \
+    _(amoswap, r_ru32_0)  \
+    _(amoadd, r_ru32_0)   \
+    _(amoxor, ax_ru32_r)  \
+    _(amoand, ax_ru32_r)  \
+    _(amoor, ax_ru32_r)   \
+    _(amomin, ax_ru32_r)  \
+    _(amomax, ax_ru32_r)  \
+    _(amominu, ax_ru32_r) \
+    _(amomaxu, ax_ru32_r) \
+    _(vmfload, x_ru32)    \
+    _(vmfstore, ri_x)     \
+    _(fcmp, r8_x_x)       \
+    _(fcvtfi, r_x)        \
+    _(fcvtif, x_r)        \
+    _(fsqrt, x_x)         \
+    _(fcvt, x_x)          \
+    _(funbox, x_x)        \
+    _(fadd, x_x_x)        \
+    _(fsub, x_x_x)        \
+    _(fmul, x_x_x)        \
+    _(fdiv, x_x_x)        \
+    _(fmin, x_x_x)        \
+    _(fmax, x_x_x)        \
+    _(fsgnj, x_x_x)       \
+    _(fsgnjn, x_x_x)      \
+    _(fsgnjx, x_x_x)      \
+    _(fmvfi, r_x)         \
+    _(fmvif, x_r)         \
+    _(bswap, r_0)         \
+    _(min, r_0_r)         \
+    _(max, r_0_r)         \
+    _(minu, r_0_r)        \
+    _(maxu, r_0_r)        \
+    _(bset, r_0_rs32)     \
+    _(bclr, r_0_rs32)     \
+    _(binv, r_0_rs32)     \
+    _(vecld, r_ru32)      \
+    _(vecst, ri_r)        \
+    _(vecadd, r_r_r_r)    \
+    _(vecsub, r_r_r_r)    \
+    _(vecmul, r_r_r_r)    \
+    _(vecand, r_r_r_r)    \
+    _(vecor, r_r_r_r)     \
+    _(vecxor, r_r_r_r)    \
+    _(rdtsc, naxdx)
+
+// Fallback sequences of missing extensions need aliased or scratch registers
+#define ARCH_OP_CT_HOST_LIST           \
+    _(clz, has_lzcnt, r_r, r_0)        \
+    _(ctz, has_bmi1, r_r, r_0)         \
+    _(cpop, has_popcnt, r_r, nax_0)    \
+    _(andn, has_bmi1, r_r_r, r_0_r)    \
+    _(rol, has_bmi2, r_r_cxi, r_0_cxi) \
+    _(ror, has_bmi2, r_r_cxi, r_0_cxi)
+
+template <typename Ct>
+static void SetOpCt(qir::Op op, Ct const &ct_info)
+{
+    auto &info = qir::op_info[to_underlying(op)];
+    info.ra_ct = ct_info.ct.data();
+    info.ra_order = ct_info.order.data();
+    info.ra_clobber = &ct_info.clobber;
+}
+
+static void DetectHostFeatures()
+{
+    u32 a, b, c, d;
+    bool os_ymm = false;
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        ArchTraits::has_popcnt = c & bit_POPCNT;
+        ArchTraits::has_sse41 = c & bit_SSE4_1;
+        // ymm state must be enabled by OS
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            u32 xcr0_lo, xcr0_hi;
+            asm("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            os_ymm = (xcr0_lo & 0b110) == 0b110;
+        }
+    }
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+        ArchTraits::has_bmi1 = b & bit_BMI;
+        ArchTraits::has_bmi2 = b & bit_BMI2;
+        ArchTraits::has_avx2 = os_ymm && (b & bit_AVX2);
+    }
+    if (__get_cpuid(0x80000001, &a, &b, &c, &d))
+        ArchTraits::has_lzcnt = c & bit_LZCNT;
+}
 
 void ArchTraits::init()
 {
     UNUSED static auto x = []() {
-#define _(name, ctname)                                             \
-    {                                                               \
-        auto &info = qir::op_info[to_underlying(qir::Op::_##name)]; \
-        info.ra_ct = CT_INFO_##ctname.ct.data();                    \
-        info.ra_order = CT_INFO_##ctname.order.data();              \
-    }
+        DetectHostFeatures();
+#define _(name, ctname) SetOpCt(qir::Op::_##name, CT_INFO_##ctname);
         ARCH_OP_CT_LIST
+#undef _
+#define _(name, feature, ctname, ctname_fallback) \
+    SetOpCt(qir::Op::_##name,                     \
+            feature ? CT_INFO_##ctname : CT_INFO_##ctname_fallback);
+        ARCH_OP_CT_HOST_LIST
 #undef _
         return true;
     }();
@@ -104,8 +104,28 @@ static constexpr RegMask GPR_ALL(((u32) 1 << GPR_NUM) - 1);
 static constexpr RegMask GPR_POOL = GPR_ALL & ~GPR_FIXED;
 static constexpr RegMask GPR_CALL_SAVED = GPR_ALL & ~GPR_CALL_CLOBBER;
 
+// FP vregs live in xmm registers, xmm0 and xmm1 are scratch registers of FP
+// and vector sequences. All of them are clobbered by calls
+static constexpr u8 XMM_NUM = 16;
+static constexpr RegMask XMM_ALL(((u32) 1 << XMM_NUM) - 1);
+static constexpr RegMask XMM_FIXED = RegMask(0).Set(0).Set(1);
+static constexpr RegMask XMM_POOL = XMM_ALL & ~XMM_FIXED;
+
 static constexpr u16 spillframe_size = 1024;  // TODO: reuse temps
 
+// Host ISA extensions, detected by init()
+#define ARCH_HOST_FEATURES(_) \
+    _(bmi1)                   \
+    _(bmi2)                   \
+    _(lzcnt)                  \
+    _(popcnt)                 \
+    _(avx2)                   \
+    _(sse41)
+
+#define _(name) inline bool has_##name{};
+ARCH_HOST_FEATURES(_)
+#undef _
+
 bool match_gp_const(qir::VType type, i64 val, RACtImm ct);
 
 void init();
@@ -1,17 +1,25 @@
+#include <limits>
+
 #include "codegen/emit.h"
 #include "guest/rv32_cpu.h"
+#include "util/hostclock.h"
 
 namespace dbt::qcg
 {
+thread_local QEmit::Context QEmit::ctx{};
+
 QEmit::QEmit(qir::Region *region,
              CompilerRuntime *cruntime_,
              qir::CodeSegment *segment_,
-             bool is_leaf_)
-    : cruntime(cruntime_), segment(segment_), is_leaf(is_leaf_)
+             bool is_leaf_,
+             RegionRelocs *relocs_)
+    : cruntime(cruntime_), segment(segment_), relocs(relocs_), is_leaf(is_leaf_)
 {
     spillframe_sp_offs = sizeof(uptr) * (is_leaf ? 1 : 2);
 
-    if (jcode.init(jrt.environment()))
+    // Soft reset keeps buffers allocated for previous regions
+    jcode.reset(asmjit::ResetPolicy::kSoft);
+    if (jcode.init(asmjit::Environment::host()))
         Panic();
 
     jcode.attach(j._emitter());
@@ -19,20 +27,26 @@ QEmit::QEmit(qir::Region *region,
     jcode.setErrorHandler(&jerr);
 
     u32 n_labels = region->GetNumBlocks();
+    labels.clear();
     labels.reserve(n_labels);
     for (u32 i = 0; i < n_labels; ++i)
         labels.push_back(j.newLabel());
+    ras_conts.clear();
+    brind_ics.clear();
 }
 
 std::span<u8> QEmit::EmitCode()
 {
+    EmitRasContinuations();
+    EmitBrindICs();
+
     jcode.flatten();
     jcode.resolveUnresolvedLinks();
 
     size_t code_sz = jcode.codeSize();
     void *code_ptr = cruntime->AllocateCode(code_sz, 8);
     if (code_ptr == nullptr)
-        Panic();
+        return {};
 
     jcode.relocateToBase((uptr) code_ptr);
     jcode.copyFlattenedData(code_ptr, code_sz);
@@ -59,6 +73,11 @@ static inline asmjit::x86::Gp make_gpr(qir::VOperand opr)
     return make_gpr(opr.GetPGPR(), opr.GetType());
 }
 
+static inline asmjit::x86::Xmm make_xmm(qir::VOperand opr)
+{
+    return asmjit::x86::xmm(opr.GetPFPR());
+}
+
 static inline asmjit::Imm make_imm(qir::VOperand opr)
 {
     return asmjit::imm(opr.GetConst());
@@ -82,6 +101,8 @@ inline asmjit::Operand QEmit::make_operand(qir::VOperand opr)
 {
     if (likely(opr.IsGPR()))
         return make_gpr(opr);
+    if (opr.IsFPR())
+        return make_xmm(opr);
     if (opr.IsConst())
         return make_imm(opr);
     return make_slot(opr);
@@ -89,6 +110,10 @@ inline asmjit::Operand QEmit::make_operand(qir::VOperand opr)
 
 inline asmjit::Operand QEmit::make_stubcall_target(RuntimeStubId stub)
 {
+    if (relocs) {
+        return asmjit::x86::qword_ptr(R_STATE, offsetof(CPUState, stub_tab) +
+                                                   RuntimeStubTab::offs(stub));
+    }
     return asmjit::imm(stub_tab[stub]);
 }
 
@@ -208,45 +233,180 @@ void QEmit::Emit_brcc(qir::InstBrcc *ins)
         j.jmp(labels[bb_f->GetId()]);
 }
 
-void QEmit::Emit_gbr(qir::InstGBr *ins)
+void QEmit::EmitBranchSlot(u32 gip)
 {
-    FrameDestroy();
+    // BranchSlot is patched concurrently by qword stores
+    j.align(asmjit::AlignMode::kCode, sizeof(u64));
     static constexpr size_t patch_size = sizeof(jitabi::ppoint::BranchSlot);
     j.embedUInt8(0, patch_size);
     auto *slot = (jitabi::ppoint::BranchSlot *) (j.bufferPtr() - patch_size);
-    slot->gip = ins->tpc.GetConst();
+    if (relocs)
+        relocs->branch_slots.push_back(j.offset() - patch_size);
+    slot->gip = gip;
     slot->flags.cross_segment = !segment->InSegment(slot->gip);
     slot->LinkLazyJIT();
 }
 
+void QEmit::Emit_gbr(qir::InstGBr *ins)
+{
+    FrameDestroy();
+    EmitBranchSlot(ins->tpc.GetConst());
+}
+
+// Continuations are entered from returns with the frame destroyed, they are
+// linked lazily as any other BranchSlot
+void QEmit::EmitRasContinuations()
+{
+    for (auto const &[label, gip] : ras_conts) {
+        j.align(asmjit::AlignMode::kCode, sizeof(u64));
+        j.bind(label);
+        EmitBranchSlot(gip);
+    }
+}
+
+// Inline caches of gbrind sites, entries are written by tcache::FillBrindIC
+void QEmit::EmitBrindICs()
+{
+    for (auto const &ic : brind_ics) {
+        j.align(asmjit::AlignMode::kZero, sizeof(u64) * tcache::BRIND_IC_SIZE);
+        j.bind(ic);
+        if (relocs)
+            relocs->brind_ics.push_back(j.offset());
+        for (u32 e = 0; e < tcache::BRIND_IC_SIZE; ++e)
+            j.embedUInt64(tcache::BrindCacheEntry().raw);
+    }
+}
+
+void QEmit::Emit_raspush(qir::InstRasPush *ins)
+{
+    using asmjit::x86::rax;
+    using asmjit::x86::rdx;
+    auto cont = j.newLabel();
+    ras_conts.push_back({cont, ins->ret_gip});
+
+    auto top = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, ras_top));
+    auto gip_entry = asmjit::x86::dword_ptr(R_STATE, rax, 2,
+                                            offsetof(CPUState, ras_gip));
+    auto host_entry = asmjit::x86::qword_ptr(R_STATE, rax, 3,
+                                             offsetof(CPUState, ras_host));
+    j.push(rax);
+    j.push(rdx);
+    j.mov(rax.r32(), top);
+    j.inc(rax.r32());
+    j.and_(rax.r32(), CPUState::RAS_SIZE - 1);
+    j.mov(top, rax.r32());
+    j.mov(gip_entry, ins->ret_gip);
+    j.lea(rdx, asmjit::x86::ptr(cont));
+    j.mov(host_entry, rdx);
+    j.pop(rdx);
+    j.pop(rax);
+}
+
 void QEmit::Emit_gbrind(qir::InstGBrind *ins)
 {
     auto ptgt = make_gpr(ins->i(0));
     assert(ptgt.id() == asmjit::x86::Gp::kIdSi);
 
+    using BrindCacheEntry = tcache::BrindCacheEntry;
+    static_assert(sizeof(BrindCacheEntry) == 1u << 3);
+    static_assert(offsetof(BrindCacheEntry, gip) == 0);
+    static_assert(offsetof(BrindCacheEntry, code_offs) == 4);
+
+    auto tmp0 = asmjit::x86::rdi;
+    auto tmp1 = asmjit::x86::rdx;
+    auto tmp2 = asmjit::x86::rax;
+    auto hit = j.newLabel();
+    auto l1_miss = j.newLabel();
     auto slowpath = j.newLabel();
-    {
-        // Inlined l1_brind_cache lookup
-        auto tmp0 = asmjit::x86::rdi;
-        auto tmp1 = asmjit::x86::rdx;
-        j.mov(tmp1.r64(), (uptr) tcache::l1_brind_cache.data());
 
-        static_assert(sizeof(tcache::BrindCacheEntry) == 1u << 4);
-        static_assert(offsetof(tcache::BrindCacheEntry, gip) == 0);
+    if (ins->ras_pop) {
+        // Top entry is popped even if mispredicted
+        auto idx = tmp2;
+        auto top = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, ras_top));
+        auto gip_entry = asmjit::x86::dword_ptr(R_STATE, idx, 2,
+                                                offsetof(CPUState, ras_gip));
+        auto host_entry = asmjit::x86::qword_ptr(R_STATE, idx, 3,
+                                                 offsetof(CPUState, ras_host));
+        auto lookup = j.newLabel();
+
+        j.mov(idx.r32(), top);
+        if (ins->ras_push) {
+            // Pop and push replace the top entry, mov and lea keep flags
+            auto cont = j.newLabel();
+            ras_conts.push_back({cont, ins->ret_gip});
+
+            j.cmp(gip_entry, ptgt.r32());
+            j.mov(tmp1, host_entry);
+            j.mov(gip_entry, ins->ret_gip);
+            j.lea(tmp0, asmjit::x86::ptr(cont));
+            j.mov(host_entry, tmp0);
+            j.jne(lookup);
+            FrameDestroy();
+            j.jmp(tmp1);
+        } else {
+            j.lea(tmp1.r32(), asmjit::x86::ptr(idx, -1));
+            j.and_(tmp1.r32(), CPUState::RAS_SIZE - 1);
+            j.mov(top, tmp1.r32());
+            j.cmp(gip_entry, ptgt.r32());
+            j.jne(lookup);
+            j.mov(idx, host_entry);
+            FrameDestroy();
+            j.jmp(idx);
+        }
+        j.bind(lookup);
+    } else {
+        // Per-site inline cache, slowpath fills it while there are free
+        // entries, then the site turns to l1_brind_cache
+        auto ic = j.newLabel();
+        brind_ics.push_back(ic);
+
+        j.lea(tmp0, asmjit::x86::ptr(ic));
+        for (u32 e = 0; e < tcache::BRIND_IC_SIZE; ++e) {
+            j.mov(tmp2, asmjit::x86::qword_ptr(tmp0, sizeof(u64) * e));
+            j.cmp(tmp2.r32(), ptgt.r32());
+            j.je(hit);
+        }
+        u32 last_offs = sizeof(u64) * (tcache::BRIND_IC_SIZE - 1);
+        j.cmp(asmjit::x86::dword_ptr(tmp0, last_offs),
+              BrindCacheEntry::GIP_EMPTY);
+        j.mov(tmp1, tmp0);
+        j.je(slowpath);
+    }
 
-        j.lea(tmp0.r32(), asmjit::x86::ptr(0, ptgt.r64(), 2));
-        j.and_(tmp0.r32(), ((1ull << tcache::L1_CACHE_BITS) - 1) << 4);
+    {
+        // Inlined l1_brind_cache lookup, entry is loaded atomically
+        if (relocs) {
+            j.mov(tmp1.r64(), asmjit::x86::qword_ptr(
+                                  R_STATE, offsetof(CPUState, l1_brind_cache)));
+        } else {
+            j.mov(tmp1.r64(), (uptr) tcache::l1_brind_cache.data());
+        }
+
+        j.lea(tmp0.r32(), asmjit::x86::ptr(0, ptgt.r64(), 1));
+        j.and_(tmp0.r32(), ((1ull << tcache::L1_CACHE_BITS) - 1) << 3);
 
-        j.cmp(asmjit::x86::ptr(tmp1.r64(), tmp0.r64(), 0, 0, sizeof(u32)),
-              ptgt.r32());
-        j.jne(slowpath);
+        j.mov(tmp2.r64(), asmjit::x86::ptr(tmp1.r64(), tmp0.r64(), 0, 0,
+                                           sizeof(u64)));
+        j.cmp(tmp2.r32(), ptgt.r32());
+        j.jne(l1_miss);
 
+        j.bind(hit);
+        j.shr(tmp2.r64(), 32);
+        if (relocs) {
+            j.mov(tmp1.r64(), asmjit::x86::qword_ptr(
+                                  R_STATE, offsetof(CPUState, tcode_base)));
+        } else {
+            j.mov(tmp1.r64(), (uptr) tcache::CodeBase());
+        }
+        j.add(tmp2.r64(), tmp1.r64());
         FrameDestroy();
-        j.jmp(asmjit::x86::ptr(tmp1.r64(), tmp0.r64(), 0,
-                               offsetof(tcache::BrindCacheEntry, code),
-                               sizeof(u64)));
+        j.jmp(tmp2.r64());
     }
 
+    j.bind(l1_miss);
+    j.xor_(tmp1.r32(), tmp1.r32());
+
+    // Inline cache to fill is passed in rdx
     j.bind(slowpath);
 
     j.mov(asmjit::x86::gpq(asmjit::x86::Gp::kIdDi), R_STATE);
@@ -329,6 +489,131 @@ void QEmit::Emit_vmstore(qir::InstVMStore *ins)
     j.emit(asmjit::x86::Inst::kIdMov, mem, pdata);
 }
 
+void QEmit::Emit_vmlr(qir::InstVMLr *ins)
+{
+    auto &vrd = ins->o(0);
+    auto &vbase = ins->i(0);
+
+    auto mem = make_vmem(vbase);
+    mem.setSize(4);
+
+    // rd may share the register with base, record the address first
+    auto lr_addr = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, lr_addr));
+    auto lr_val = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, lr_val));
+    j.emit(asmjit::x86::Inst::kIdMov, lr_addr, make_operand(vbase));
+    j.mov(make_gpr(vrd), mem);
+    j.mov(lr_val, make_gpr(vrd));
+}
+
+// Succeeds if the reservation address matches and the word still holds the
+// loaded value, which is as strong as host cmpxchg allows
+void QEmit::Emit_vmsc(qir::InstVMSc *ins)
+{
+    auto &vbase = ins->i(0);
+    auto pval = make_gpr(ins->i(1));
+    assert(ins->o(0).GetPGPR() == asmjit::x86::Gp::kIdAx);
+
+    auto mem = make_vmem(vbase);
+    mem.setSize(4);
+
+    auto lr_addr = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, lr_addr));
+    auto lr_val = asmjit::x86::dword_ptr(R_STATE, offsetof(CPUState, lr_val));
+    auto l_done = j.newLabel();
+
+    j.emit(asmjit::x86::Inst::kIdCmp, lr_addr, make_operand(vbase));
+    j.mov(asmjit::x86::eax, 1);
+    j.jne(l_done);
+    j.mov(asmjit::x86::eax, lr_val);
+    j.lock().cmpxchg(mem, pval, asmjit::x86::eax);
+    j.setne(asmjit::x86::al);
+    j.movzx(asmjit::x86::eax, asmjit::x86::al);
+    j.bind(l_done);
+    j.mov(lr_addr, -1);
+}
+
+void QEmit::Emit_amoswap(qir::InstVMAtomic *ins)
+{
+    auto mem = make_vmem(ins->i(0));
+    mem.setSize(4);
+    assert(ins->o(0).GetPGPR() == ins->i(1).GetPGPR());
+    j.xchg(mem, make_gpr(ins->o(0)));  // implicitly locked
+}
+
+void QEmit::Emit_amoadd(qir::InstVMAtomic *ins)
+{
+    auto mem = make_vmem(ins->i(0));
+    mem.setSize(4);
+    assert(ins->o(0).GetPGPR() == ins->i(1).GetPGPR());
+    j.lock().xadd(mem, make_gpr(ins->o(0)));
+}
+
+// Generic rmw with lock cmpxchg loop, old value in eax, new value in edx
+template <typename F>
+ALWAYS_INLINE void QEmit::EmitAtomicRMW(qir::InstVMAtomic *ins, F &&compute)
+{
+    auto mem = make_vmem(ins->i(0));
+    mem.setSize(4);
+    auto pval = make_gpr(ins->i(1));
+    assert(ins->o(0).GetPGPR() == asmjit::x86::Gp::kIdAx);
+    assert(pval.id() != asmjit::x86::Gp::kIdAx &&
+           pval.id() != asmjit::x86::Gp::kIdDx);
+
+    auto l_retry = j.newLabel();
+    j.mov(asmjit::x86::eax, mem);
+    j.bind(l_retry);
+    j.mov(asmjit::x86::edx, pval);
+    compute(asmjit::x86::edx);
+    j.lock().cmpxchg(mem, asmjit::x86::edx, asmjit::x86::eax);
+    j.jne(l_retry);
+}
+
+void QEmit::Emit_amoxor(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) { j.xor_(tmp, asmjit::x86::eax); });
+}
+
+void QEmit::Emit_amoand(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) { j.and_(tmp, asmjit::x86::eax); });
+}
+
+void QEmit::Emit_amoor(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) { j.or_(tmp, asmjit::x86::eax); });
+}
+
+void QEmit::Emit_amomin(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) {
+        j.cmp(asmjit::x86::eax, tmp);
+        j.cmovl(tmp, asmjit::x86::eax);
+    });
+}
+
+void QEmit::Emit_amomax(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) {
+        j.cmp(asmjit::x86::eax, tmp);
+        j.cmovg(tmp, asmjit::x86::eax);
+    });
+}
+
+void QEmit::Emit_amominu(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) {
+        j.cmp(asmjit::x86::eax, tmp);
+        j.cmovb(tmp, asmjit::x86::eax);
+    });
+}
+
+void QEmit::Emit_amomaxu(qir::InstVMAtomic *ins)
+{
+    EmitAtomicRMW(ins, [&](auto tmp) {
+        j.cmp(asmjit::x86::eax, tmp);
+        j.cmova(tmp, asmjit::x86::eax);
+    });
+}
+
 void QEmit::Emit_setcc(qir::InstSetcc *ins)
 {
     auto prd = make_gpr(ins->o(0));
@@ -361,6 +646,18 @@ void QEmit::Emit_mov(qir::InstUnop *ins)
         j.emit(asmjit::x86::Inst::kIdXor, prd, prd);
         return;
     }
+    // FPR copies, spills and fills
+    if (vrd.IsFPR() || vs0.IsFPR()) {
+        using asmjit::x86::Inst;
+        if (vrd.IsFPR() && vs0.IsFPR()) {
+            j.movaps(make_xmm(vrd), make_xmm(vs0));
+        } else {
+            bool dbl = vrd.GetType() == qir::VType::F64;
+            j.emit(dbl ? Inst::kIdMovsd : Inst::kIdMovss, make_operand(vrd),
+                   make_operand(vs0));
+        }
+        return;
+    }
     j.emit(asmjit::x86::Inst::kIdMov, make_operand(vrd), make_operand(vs0));
 }
 
@@ -421,4 +718,836 @@ void QEmit::Emit_sll(qir::InstBinop *ins)
     EmitInstBinop<asmjit::x86::Inst::kIdShl>(ins);
 }
 
+void QEmit::Emit_mul(qir::InstBinop *ins)
+{
+    EmitInstBinop<asmjit::x86::Inst::kIdImul>(ins);
+}
+
+// Fixed-register forms, see ARCH_OP_CT_LIST: rs1 in eax, rd in eax/edx
+static inline asmjit::x86::Gp muldiv_rs2(qir::InstBinop *ins)
+{
+    assert(ins->i(0).GetPGPR() == asmjit::x86::Gp::kIdAx);
+    auto rs2 = make_gpr(ins->i(1));
+    assert(rs2.id() != asmjit::x86::Gp::kIdAx &&
+           rs2.id() != asmjit::x86::Gp::kIdDx);
+    return rs2;
+}
+
+void QEmit::Emit_mulh(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    j.imul(asmjit::x86::edx, asmjit::x86::eax, rs2);
+}
+
+void QEmit::Emit_mulhsu(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    j.movsxd(asmjit::x86::rax, asmjit::x86::eax);
+    j.mov(asmjit::x86::edx, rs2);
+    j.imul(asmjit::x86::rax, asmjit::x86::rdx);
+    j.shr(asmjit::x86::rax, 32);
+    j.mov(asmjit::x86::edx, asmjit::x86::eax);
+}
+
+void QEmit::Emit_mulhu(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    j.mul(asmjit::x86::edx, asmjit::x86::eax, rs2);
+}
+
+// RISC-V division never traps: x/0 and INT_MIN/-1 are handled inline
+void QEmit::Emit_div(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    auto l_zero = j.newLabel();
+    auto l_div = j.newLabel();
+    auto l_done = j.newLabel();
+
+    j.test(rs2, rs2);
+    j.jz(l_zero);
+    j.cmp(rs2, -1);
+    j.jne(l_div);
+    j.neg(asmjit::x86::eax);
+    j.jmp(l_done);
+    j.bind(l_div);
+    j.cdq();
+    j.idiv(asmjit::x86::edx, asmjit::x86::eax, rs2);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(asmjit::x86::eax, -1);
+    j.bind(l_done);
+}
+
+void QEmit::Emit_divu(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    auto l_zero = j.newLabel();
+    auto l_done = j.newLabel();
+
+    j.test(rs2, rs2);
+    j.jz(l_zero);
+    j.xor_(asmjit::x86::edx, asmjit::x86::edx);
+    j.div(asmjit::x86::edx, asmjit::x86::eax, rs2);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(asmjit::x86::eax, -1);
+    j.bind(l_done);
+}
+
+void QEmit::Emit_rem(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    auto l_zero = j.newLabel();
+    auto l_div = j.newLabel();
+    auto l_done = j.newLabel();
+
+    j.test(rs2, rs2);
+    j.jz(l_zero);
+    j.cmp(rs2, -1);
+    j.jne(l_div);
+    j.xor_(asmjit::x86::edx, asmjit::x86::edx);
+    j.jmp(l_done);
+    j.bind(l_div);
+    j.cdq();
+    j.idiv(asmjit::x86::edx, asmjit::x86::eax, rs2);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(asmjit::x86::edx, asmjit::x86::eax);
+    j.bind(l_done);
+}
+
+void QEmit::Emit_remu(qir::InstBinop *ins)
+{
+    auto rs2 = muldiv_rs2(ins);
+    auto l_zero = j.newLabel();
+    auto l_done = j.newLabel();
+
+    j.test(rs2, rs2);
+    j.jz(l_zero);
+    j.xor_(asmjit::x86::edx, asmjit::x86::edx);
+    j.div(asmjit::x86::edx, asmjit::x86::eax, rs2);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(asmjit::x86::edx, asmjit::x86::eax);
+    j.bind(l_done);
+}
+
+/* Bit manipulation, encodings of missing host extensions are replaced by
+ * fallback sequences. Constraints are chosen accordingly in ArchTraits::init
+ */
+void QEmit::Emit_clz(qir::InstUnop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps = make_gpr(ins->i(0));
+
+    if (ArchTraits::has_lzcnt) {
+        j.lzcnt(prd, ps);
+        return;
+    }
+    assert(prd == ps);
+    auto l_zero = j.newLabel();
+    auto l_done = j.newLabel();
+    j.test(prd, prd);
+    j.jz(l_zero);
+    j.bsr(prd, prd);
+    j.xor_(prd, 31);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(prd, 32);
+    j.bind(l_done);
+}
+
+void QEmit::Emit_ctz(qir::InstUnop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps = make_gpr(ins->i(0));
+
+    if (ArchTraits::has_bmi1) {
+        j.tzcnt(prd, ps);
+        return;
+    }
+    assert(prd == ps);
+    auto l_zero = j.newLabel();
+    auto l_done = j.newLabel();
+    j.test(prd, prd);
+    j.jz(l_zero);
+    j.bsf(prd, prd);
+    j.jmp(l_done);
+    j.bind(l_zero);
+    j.mov(prd, 32);
+    j.bind(l_done);
+}
+
+void QEmit::Emit_cpop(qir::InstUnop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps = make_gpr(ins->i(0));
+
+    if (ArchTraits::has_popcnt) {
+        j.popcnt(prd, ps);
+        return;
+    }
+    assert(prd == ps);
+    auto tmp = asmjit::x86::eax;
+    j.mov(tmp, prd);
+    j.shr(tmp, 1);
+    j.and_(tmp, 0x55555555);
+    j.sub(prd, tmp);
+    j.mov(tmp, prd);
+    j.shr(tmp, 2);
+    j.and_(prd, 0x33333333);
+    j.and_(tmp, 0x33333333);
+    j.add(prd, tmp);
+    j.mov(tmp, prd);
+    j.shr(tmp, 4);
+    j.add(prd, tmp);
+    j.and_(prd, 0x0f0f0f0f);
+    j.imul(prd, prd, 0x01010101);
+    j.shr(prd, 24);
+}
+
+void QEmit::Emit_bswap(qir::InstUnop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    assert(prd == make_gpr(ins->i(0)));
+    j.bswap(prd);
+}
+
+void QEmit::Emit_andn(qir::InstBinop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps0 = make_gpr(ins->i(0));
+    auto ps1 = make_gpr(ins->i(1));
+
+    if (ArchTraits::has_bmi1) {
+        j.andn(prd, ps1, ps0);
+        return;
+    }
+    // rs2 is restored, it is not aliased with rd
+    assert(prd == ps0 && prd != ps1);
+    j.not_(ps1);
+    j.and_(prd, ps1);
+    j.not_(ps1);
+}
+
+// Rotation amount is masked by the host as in RISC-V
+template <asmjit::x86::Inst::Id Op>
+ALWAYS_INLINE void QEmit::EmitRotate(qir::InstBinop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps0 = make_gpr(ins->i(0));
+    auto vs1 = ins->i(1);
+
+    if (vs1.IsConst()) {
+        u32 amount = vs1.GetConst() & 31;
+        if (ArchTraits::has_bmi2) {
+            if constexpr (Op == asmjit::x86::Inst::kIdRol)
+                amount = (32 - amount) & 31;
+            j.rorx(prd, ps0, amount);
+            return;
+        }
+        assert(prd == ps0);
+        j.emit(Op, prd, asmjit::imm(amount));
+        return;
+    }
+    assert(vs1.GetPGPR() == asmjit::x86::Gp::kIdCx);
+    if (prd != ps0)
+        j.mov(prd, ps0);
+    j.emit(Op, prd, asmjit::x86::cl);
+}
+
+void QEmit::Emit_rol(qir::InstBinop *ins)
+{
+    EmitRotate<asmjit::x86::Inst::kIdRol>(ins);
+}
+
+void QEmit::Emit_ror(qir::InstBinop *ins)
+{
+    EmitRotate<asmjit::x86::Inst::kIdRor>(ins);
+}
+
+template <asmjit::x86::CondCode CC>
+ALWAYS_INLINE void QEmit::EmitMinMax(qir::InstBinop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto ps1 = make_gpr(ins->i(1));
+
+    assert(prd == make_gpr(ins->i(0)));
+    j.cmp(prd, ps1);
+    j.emit(asmjit::x86::Inst::cmovccFromCond(CC), prd, ps1);
+}
+
+void QEmit::Emit_min(qir::InstBinop *ins)
+{
+    EmitMinMax<asmjit::x86::CondCode::kSignedGT>(ins);
+}
+
+void QEmit::Emit_max(qir::InstBinop *ins)
+{
+    EmitMinMax<asmjit::x86::CondCode::kSignedLT>(ins);
+}
+
+void QEmit::Emit_minu(qir::InstBinop *ins)
+{
+    EmitMinMax<asmjit::x86::CondCode::kUnsignedGT>(ins);
+}
+
+void QEmit::Emit_maxu(qir::InstBinop *ins)
+{
+    EmitMinMax<asmjit::x86::CondCode::kUnsignedLT>(ins);
+}
+
+// Register bit offset is taken modulo 32 by the host
+template <asmjit::x86::Inst::Id Op>
+ALWAYS_INLINE void QEmit::EmitBitop(qir::InstBinop *ins)
+{
+    auto prd = make_gpr(ins->o(0));
+    auto vs1 = ins->i(1);
+
+    assert(prd == make_gpr(ins->i(0)));
+    if (vs1.IsConst())
+        j.emit(Op, prd, asmjit::imm(vs1.GetConst() & 31));
+    else
+        j.emit(Op, prd, make_gpr(vs1));
+}
+
+void QEmit::Emit_bset(qir::InstBinop *ins)
+{
+    EmitBitop<asmjit::x86::Inst::kIdBts>(ins);
+}
+
+void QEmit::Emit_bclr(qir::InstBinop *ins)
+{
+    EmitBitop<asmjit::x86::Inst::kIdBtr>(ins);
+}
+
+void QEmit::Emit_binv(qir::InstBinop *ins)
+{
+    EmitBitop<asmjit::x86::Inst::kIdBtc>(ins);
+}
+
+/* Scalar FP vregs live in xmm registers, xmm0 and xmm1 are scratch. F32 is
+ * NaN-boxed in the low qword, outputs never share a register with inputs
+ */
+static inline bool is_f64(qir::VOperand opr)
+{
+    assert(opr.IsPFPR());
+    return opr.GetType() == qir::VType::F64;
+}
+
+// Sets the upper half of F32 to ones
+void QEmit::EmitFBox(asmjit::x86::Xmm rd)
+{
+    auto x0 = asmjit::x86::xmm0;
+
+    j.pcmpeqd(x0, x0);
+    j.unpcklps(rd, x0);
+}
+
+// Replaces host NaN by canonical one, F32 is NaN-boxed
+void QEmit::EmitFResult(asmjit::x86::Xmm rd, bool dbl)
+{
+    auto l_done = j.newLabel();
+
+    if (dbl)
+        j.ucomisd(rd, rd);
+    else
+        j.ucomiss(rd, rd);
+    j.jnp(l_done);
+    j.pcmpeqd(rd, rd);
+    if (dbl) {
+        j.psllq(rd, 52);
+        j.psrlq(rd, 1);
+    } else {
+        j.pslld(rd, 23);
+        j.psrld(rd, 1);
+    }
+    j.bind(l_done);
+    if (!dbl)
+        EmitFBox(rd);
+}
+
+template <asmjit::x86::Inst::Id OpS, asmjit::x86::Inst::Id OpD>
+ALWAYS_INLINE void QEmit::EmitInstFBinop(qir::InstFBinop *ins)
+{
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+
+    j.movaps(prd, make_xmm(ins->i(0)));
+    j.emit(dbl ? OpD : OpS, prd, make_xmm(ins->i(1)));
+    EmitFResult(prd, dbl);
+}
+
+void QEmit::Emit_fadd(qir::InstFBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitInstFBinop<Inst::kIdAddss, Inst::kIdAddsd>(ins);
+}
+
+void QEmit::Emit_fsub(qir::InstFBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitInstFBinop<Inst::kIdSubss, Inst::kIdSubsd>(ins);
+}
+
+void QEmit::Emit_fmul(qir::InstFBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitInstFBinop<Inst::kIdMulss, Inst::kIdMulsd>(ins);
+}
+
+void QEmit::Emit_fdiv(qir::InstFBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitInstFBinop<Inst::kIdDivss, Inst::kIdDivsd>(ins);
+}
+
+// RISC-V returns the non-NaN operand and orders -0.0 < +0.0, SSE min/max
+// return the second operand in both cases
+void QEmit::EmitFMinMax(qir::InstFBinop *ins, bool is_max)
+{
+    using asmjit::x86::Inst;
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+    auto ps1 = make_xmm(ins->i(1));
+    auto ucomi = dbl ? Inst::kIdUcomisd : Inst::kIdUcomiss;
+    auto l_unord = j.newLabel();
+    auto l_ne = j.newLabel();
+    auto l_done = j.newLabel();
+
+    j.movaps(prd, make_xmm(ins->i(0)));
+    j.emit(ucomi, prd, ps1);
+    j.jp(l_unord);
+    j.jne(l_ne);
+    // Equal values differ in sign only if zeros
+    if (is_max)
+        j.andps(prd, ps1);
+    else
+        j.orps(prd, ps1);
+    j.jmp(l_done);
+    j.bind(l_ne);
+    if (is_max)
+        j.emit(dbl ? Inst::kIdMaxsd : Inst::kIdMaxss, prd, ps1);
+    else
+        j.emit(dbl ? Inst::kIdMinsd : Inst::kIdMinss, prd, ps1);
+    j.jmp(l_done);
+    j.bind(l_unord);
+    j.emit(ucomi, prd, prd);
+    j.jnp(l_done);
+    j.movaps(prd, ps1);  // canonicalized if both are NaN
+    j.bind(l_done);
+    EmitFResult(prd, dbl);
+}
+
+void QEmit::Emit_fmin(qir::InstFBinop *ins)
+{
+    EmitFMinMax(ins, false);
+}
+
+void QEmit::Emit_fmax(qir::InstFBinop *ins)
+{
+    EmitFMinMax(ins, true);
+}
+
+// Sign injection is bitwise, NaN operands are not canonicalized
+void QEmit::EmitFSgnj(qir::InstFBinop *ins)
+{
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+    auto ps0 = make_xmm(ins->i(0));
+    auto x0 = asmjit::x86::xmm0;
+    auto x1 = asmjit::x86::xmm1;
+
+    // Sign bit mask
+    j.pcmpeqd(x0, x0);
+    if (dbl)
+        j.psllq(x0, 63);
+    else
+        j.pslld(x0, 31);
+    j.movaps(x1, make_xmm(ins->i(1)));
+    switch (ins->GetOpcode()) {
+    case qir::Op::_fsgnj:
+        j.andps(x1, x0);
+        break;
+    case qir::Op::_fsgnjn:
+        j.andnps(x1, x0);
+        break;
+    case qir::Op::_fsgnjx:
+        j.andps(x1, x0);
+        j.movaps(prd, ps0);
+        j.xorps(prd, x1);
+        if (!dbl)
+            EmitFBox(prd);
+        return;
+    default:
+        unreachable("");
+    }
+    j.andnps(x0, ps0);
+    j.movaps(prd, x0);
+    j.orps(prd, x1);
+    if (!dbl)
+        EmitFBox(prd);
+}
+
+void QEmit::Emit_fsgnj(qir::InstFBinop *ins)
+{
+    EmitFSgnj(ins);
+}
+
+void QEmit::Emit_fsgnjn(qir::InstFBinop *ins)
+{
+    EmitFSgnj(ins);
+}
+
+void QEmit::Emit_fsgnjx(qir::InstFBinop *ins)
+{
+    EmitFSgnj(ins);
+}
+
+void QEmit::Emit_fsqrt(qir::InstFUnop *ins)
+{
+    using asmjit::x86::Inst;
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+
+    j.emit(dbl ? Inst::kIdSqrtsd : Inst::kIdSqrtss, prd, make_xmm(ins->i(0)));
+    EmitFResult(prd, dbl);
+}
+
+void QEmit::Emit_fcvt(qir::InstFUnop *ins)
+{
+    using asmjit::x86::Inst;
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+
+    assert(dbl != is_f64(ins->i(0)));
+    j.emit(dbl ? Inst::kIdCvtss2sd : Inst::kIdCvtsd2ss, prd,
+           make_xmm(ins->i(0)));
+    EmitFResult(prd, dbl);
+}
+
+// F32 which is not NaN-boxed reads as canonical NaN, as in the interpreter
+void QEmit::Emit_funbox(qir::InstFUnop *ins)
+{
+    auto prd = make_xmm(ins->o(0));
+    auto ps = make_xmm(ins->i(0));
+    auto x0 = asmjit::x86::xmm0;
+    auto x1 = asmjit::x86::xmm1;
+
+    assert(!is_f64(ins->o(0)));
+    // Select mask, all ones if the upper half is all ones
+    j.pcmpeqd(x0, x0);
+    j.pcmpeqd(x0, ps);
+    j.pshufd(x0, x0, 0x55);
+    // Canonical NaN
+    j.pcmpeqd(x1, x1);
+    j.pslld(x1, 23);
+    j.psrld(x1, 1);
+    j.movaps(prd, ps);
+    j.andps(prd, x0);
+    j.andnps(x0, x1);
+    j.orps(prd, x0);
+}
+
+void QEmit::Emit_fmvfi(qir::InstFMov *ins)
+{
+    j.movd(make_gpr(ins->o(0)), make_xmm(ins->i(0)));
+}
+
+void QEmit::Emit_fmvif(qir::InstFMov *ins)
+{
+    auto prd = make_xmm(ins->o(0));
+
+    assert(!is_f64(ins->o(0)));
+    j.movd(prd, make_gpr(ins->i(0)));
+    EmitFBox(prd);
+}
+
+void QEmit::Emit_vmfload(qir::InstVMFLoad *ins)
+{
+    bool dbl = is_f64(ins->o(0));
+    auto prd = make_xmm(ins->o(0));
+    auto mem = make_vmem(ins->i(0));
+
+    if (dbl) {
+        mem.setSize(8);
+        j.movsd(prd, mem);
+    } else {
+        mem.setSize(4);
+        j.movss(prd, mem);
+        EmitFBox(prd);
+    }
+}
+
+void QEmit::Emit_vmfstore(qir::InstVMFStore *ins)
+{
+    bool dbl = is_f64(ins->i(1));
+    auto ps = make_xmm(ins->i(1));
+    auto mem = make_vmem(ins->i(0));
+
+    if (dbl) {
+        mem.setSize(8);
+        j.movsd(mem, ps);
+    } else {
+        mem.setSize(4);
+        j.movss(mem, ps);
+    }
+}
+
+// comiss signals on quiet NaN as required by flt/fle, feq is quiet
+void QEmit::Emit_fcmp(qir::InstFCmp *ins)
+{
+    using asmjit::x86::Inst;
+    auto prd = make_gpr(ins->o(0));
+    auto lhs = make_xmm(ins->i(0));
+    auto rhs = make_xmm(ins->i(1));
+    bool dbl = is_f64(ins->i(0));
+
+    j.xor_(prd, prd);
+    switch (ins->cc) {
+    case qir::CondCode::EQ: {
+        auto l_done = j.newLabel();
+        j.emit(dbl ? Inst::kIdUcomisd : Inst::kIdUcomiss, lhs, rhs);
+        j.jp(l_done);
+        j.sete(prd.r8());
+        j.bind(l_done);
+        break;
+    }
+    case qir::CondCode::LT:
+        j.emit(dbl ? Inst::kIdComisd : Inst::kIdComiss, rhs, lhs);
+        j.seta(prd.r8());
+        break;
+    case qir::CondCode::LE:
+        j.emit(dbl ? Inst::kIdComisd : Inst::kIdComiss, rhs, lhs);
+        j.setae(prd.r8());
+        break;
+    default:
+        unreachable("");
+    }
+}
+
+// Host returns INT_MIN on overflow and NaN, RISC-V saturates to INT_MAX
+// unless the source is negative
+void QEmit::Emit_fcvtfi(qir::InstFCvtFI *ins)
+{
+    using asmjit::x86::Inst;
+    auto prd = make_gpr(ins->o(0));
+    auto src = make_xmm(ins->i(0));
+    bool dbl = is_f64(ins->i(0));
+    auto x0 = asmjit::x86::xmm0;
+    auto x1 = asmjit::x86::xmm1;
+    auto l_done = j.newLabel();
+
+    assert(ins->sgn == qir::VSign::S);
+    auto cvt = dbl ? Inst::kIdCvttsd2si : Inst::kIdCvttss2si;
+    if (ins->rm == qir::FRound::ZERO) {
+        j.emit(cvt, prd, src);
+    } else {
+        // roundss/roundsd immediate matches FRound, inexact is signalled
+        assert(ArchTraits::has_sse41);
+        j.emit(dbl ? Inst::kIdRoundsd : Inst::kIdRoundss, x0, src,
+               asmjit::Imm(to_underlying(ins->rm)));
+        j.emit(cvt, prd, x0);
+    }
+    // Saturation by the sign of source, NaN gives INT_MAX
+    j.cmp(prd, std::numeric_limits<i32>::min());
+    j.jne(l_done);
+    j.xorps(x1, x1);
+    j.emit(dbl ? Inst::kIdUcomisd : Inst::kIdUcomiss, x1, src);
+    j.ja(l_done);
+    j.mov(prd, std::numeric_limits<i32>::max());
+    j.bind(l_done);
+}
+
+// Result is never NaN
+void QEmit::Emit_fcvtif(qir::InstFCvtIF *ins)
+{
+    using asmjit::x86::Inst;
+    auto prd = make_xmm(ins->o(0));
+    auto ps = make_gpr(ins->i(0));
+    bool dbl = is_f64(ins->o(0));
+    auto cvt = dbl ? Inst::kIdCvtsi2sd : Inst::kIdCvtsi2ss;
+
+    j.xorps(prd, prd);  // break dependency on upper part
+    if (ins->sgn == qir::VSign::U) {
+        // Zero-extended value is converted exactly by 64-bit form
+        j.mov(ps, ps);
+        j.emit(cvt, prd, ps.r64());
+    } else {
+        j.emit(cvt, prd, ps);
+    }
+    if (!dbl)
+        EmitFBox(prd);
+}
+
+/* Vector operands are V128 or V256 state slots, processed by AVX2 in
+ * xmm0/ymm0 and xmm1/ymm1. Upper ymm halves are cleared after use to keep
+ * SSE scalar code free of transition penalties
+ */
+static inline bool is_v256(qir::VOperand opr)
+{
+    assert(opr.IsGSlot());
+    return opr.GetType() == qir::VType::V256;
+}
+
+static inline asmjit::x86::Vec make_vec(u8 id, bool wide)
+{
+    if (wide)
+        return asmjit::x86::ymm(id);
+    return asmjit::x86::xmm(id);
+}
+
+void QEmit::Emit_vecld(qir::InstVecLoad *ins)
+{
+    auto &vrd = ins->o(0);
+    bool wide = is_v256(vrd);
+    auto v0 = make_vec(0, wide);
+    auto mem = make_vmem(ins->i(0));
+    mem.setSize(VTypeToSize(vrd.GetType()));
+
+    j.vmovdqu(v0, mem);
+    j.vmovdqu(make_slot(vrd), v0);
+    if (wide)
+        j.vzeroupper();
+}
+
+void QEmit::Emit_vecst(qir::InstVecStore *ins)
+{
+    auto &vdata = ins->i(1);
+    bool wide = is_v256(vdata);
+    auto v0 = make_vec(0, wide);
+    auto mem = make_vmem(ins->i(0));
+    mem.setSize(VTypeToSize(vdata.GetType()));
+
+    j.vmovdqu(v0, make_slot(vdata));
+    j.vmovdqu(mem, v0);
+    if (wide)
+        j.vzeroupper();
+}
+
+// Op is selected by element size, kIdNone if there is no host instruction
+template <asmjit::x86::Inst::Id OpB,
+          asmjit::x86::Inst::Id OpW,
+          asmjit::x86::Inst::Id OpD>
+ALWAYS_INLINE void QEmit::EmitVecBinop(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    auto &vrd = ins->o(0);
+    auto &vrs = ins->i(1);
+    bool wide = is_v256(vrd);
+    auto v0 = make_vec(0, wide);
+    auto v1 = make_vec(1, wide);
+
+    Inst::Id op, bcast;
+    switch (ins->sew) {
+    case qir::VType::I8:
+        op = OpB;
+        bcast = Inst::kIdVpbroadcastb;
+        break;
+    case qir::VType::I16:
+        op = OpW;
+        bcast = Inst::kIdVpbroadcastw;
+        break;
+    case qir::VType::I32:
+        op = OpD;
+        bcast = Inst::kIdVpbroadcastd;
+        break;
+    default:
+        unreachable("");
+    }
+    assert(op != Inst::kIdNone);
+
+    j.vmovdqu(v0, make_slot(ins->i(0)));
+    if (vrs.IsSlot()) {
+        j.emit(op, v0, v0, make_slot(vrs));
+    } else {
+        j.vmovd(asmjit::x86::xmm1, make_gpr(vrs));
+        j.emit(bcast, v1, asmjit::x86::xmm1);
+        j.emit(op, v0, v0, v1);
+    }
+
+    // Tail bytes are taken from the old value, tidx is zero-extended
+    auto tidx = make_gpr(ins->i(2));
+    auto mask = asmjit::x86::ptr(R_STATE, tidx.r64(), 0,
+                                 offsetof(CPUState, vtail_mask),
+                                 VTypeToSize(vrd.GetType()));
+    j.vmovdqu(v1, mask);
+    j.vpblendvb(v0, v0, make_slot(vrd), v1);
+    j.vmovdqu(make_slot(vrd), v0);
+    if (wide)
+        j.vzeroupper();
+}
+
+void QEmit::Emit_vecadd(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdVpaddb, Inst::kIdVpaddw, Inst::kIdVpaddd>(ins);
+}
+
+void QEmit::Emit_vecsub(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdVpsubb, Inst::kIdVpsubw, Inst::kIdVpsubd>(ins);
+}
+
+void QEmit::Emit_vecmul(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdNone, Inst::kIdVpmullw, Inst::kIdVpmulld>(ins);
+}
+
+void QEmit::Emit_vecand(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdVpand, Inst::kIdVpand, Inst::kIdVpand>(ins);
+}
+
+void QEmit::Emit_vecor(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdVpor, Inst::kIdVpor, Inst::kIdVpor>(ins);
+}
+
+void QEmit::Emit_vecxor(qir::InstVecBinop *ins)
+{
+    using asmjit::x86::Inst;
+    EmitVecBinop<Inst::kIdVpxor, Inst::kIdVpxor, Inst::kIdVpxor>(ins);
+}
+
+void QEmit::Emit_icount(qir::InstICount *ins)
+{
+    auto instret = asmjit::x86::qword_ptr(R_STATE, offsetof(CPUState, instret));
+    j.add(instret, ins->n);
+}
+
+// Not serialized, reordering against nearby guest code is acceptable
+void QEmit::Emit_rdtsc(qir::InstRdtsc *ins)
+{
+    using asmjit::x86::rax;
+    using asmjit::x86::rdx;
+    auto prd = make_gpr(ins->o(0));
+    auto tmp = prd.r64();
+
+    j.rdtsc();
+    j.shl(rdx, 32);
+    j.or_(rax, rdx);
+    if (ins->scaled) {
+        // Clock address differs between runs
+        if (relocs)
+            relocs->relocatable = false;
+        // Anchor is moved by HostClock::Update, read it from memory
+        auto field = [&](size_t offs) {
+            return asmjit::x86::qword_ptr(tmp, offs);
+        };
+        j.mov(tmp, (uptr) &HostClock::Get());
+        j.sub(rax, field(offsetof(HostClock, tsc0)));
+        j.mul(field(offsetof(HostClock, mult)));
+        j.shrd(rax, rdx, HostClock::shift);
+        j.add(rax, field(offsetof(HostClock, ns0)));
+    }
+    if (ins->hi)
+        j.shr(rax, 32);
+    j.mov(prd, asmjit::x86::eax);
+}
+
 }  // namespace dbt::qcg
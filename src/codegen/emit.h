@@ -12,7 +12,8 @@ struct QEmit {
     QEmit(qir::Region *region,
           CompilerRuntime *cruntime_,
           qir::CodeSegment *segment_,
-          bool is_leaf_);
+          bool is_leaf_,
+          RegionRelocs *relocs_);
 
     void SetBlock(qir::Block *bb_)
     {
@@ -39,9 +40,30 @@ struct QEmit {
 private:
     void FrameSetup();
     void FrameDestroy();
+    void EmitBranchSlot(u32 gip);
+    void EmitRasContinuations();
+    void EmitBrindICs();
 
     template <asmjit::x86::Inst::Id Op>
     ALWAYS_INLINE void EmitInstBinop(qir::InstBinop *ins);
+    template <typename F>
+    ALWAYS_INLINE void EmitAtomicRMW(qir::InstVMAtomic *ins, F &&compute);
+    template <asmjit::x86::Inst::Id Op>
+    ALWAYS_INLINE void EmitRotate(qir::InstBinop *ins);
+    template <asmjit::x86::CondCode CC>
+    ALWAYS_INLINE void EmitMinMax(qir::InstBinop *ins);
+    template <asmjit::x86::Inst::Id Op>
+    ALWAYS_INLINE void EmitBitop(qir::InstBinop *ins);
+    template <asmjit::x86::Inst::Id OpS, asmjit::x86::Inst::Id OpD>
+    ALWAYS_INLINE void EmitInstFBinop(qir::InstFBinop *ins);
+    void EmitFMinMax(qir::InstFBinop *ins, bool is_max);
+    void EmitFSgnj(qir::InstFBinop *ins);
+    void EmitFBox(asmjit::x86::Xmm rd);
+    void EmitFResult(asmjit::x86::Xmm rd, bool dbl);
+    template <asmjit::x86::Inst::Id OpB,
+              asmjit::x86::Inst::Id OpW,
+              asmjit::x86::Inst::Id OpD>
+    ALWAYS_INLINE void EmitVecBinop(qir::InstVecBinop *ins);
 
     struct JitErrorHandler : asmjit::ErrorHandler {
         virtual void handleError(UNUSED asmjit::Error err,
@@ -60,18 +82,33 @@ private:
 
     CompilerRuntime *cruntime{};
     qir::CodeSegment *segment{};
+    RegionRelocs *relocs{};  // host addresses are loaded from state if set
 
     RuntimeStubTab const &stub_tab{*RuntimeStubTab::GetGlobal()};
 
     bool is_leaf;
     u32 spillframe_sp_offs;
 
-    asmjit::JitRuntime jrt{};
-    asmjit::CodeHolder jcode{};
-    asmjit::x86::Assembler j{};
-    JitErrorHandler jerr{};
+    // Assembler state is reused by regions compiled in the same thread
+    struct Context {
+        asmjit::CodeHolder jcode{};
+        asmjit::x86::Assembler j{};
+        JitErrorHandler jerr{};
+
+        std::vector<asmjit::Label> labels;
+        // Return address stack continuations, emitted past region code
+        std::vector<std::pair<asmjit::Label, u32>> ras_conts;
+        std::vector<asmjit::Label> brind_ics;
+    };
+    static thread_local Context ctx;
+
+    asmjit::CodeHolder &jcode{ctx.jcode};
+    asmjit::x86::Assembler &j{ctx.j};
+    JitErrorHandler &jerr{ctx.jerr};
 
-    std::vector<asmjit::Label> labels;
+    std::vector<asmjit::Label> &labels{ctx.labels};
+    std::vector<std::pair<asmjit::Label, u32>> &ras_conts{ctx.ras_conts};
+    std::vector<asmjit::Label> &brind_ics{ctx.brind_ics};
 };
 
 }  // namespace dbt::qcg
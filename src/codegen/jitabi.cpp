@@ -18,7 +18,7 @@ struct _RetPair {
  *			| ....		|  Execution loop
  *	trampoline call +---------------+-----------------------
  *			| link+fp|saved |  qcg spill frame, created in trampoline
- *			+---------------+  no callee saved regs expected
+ *			+---------------+  callee saved regs hold pinned gprs
  *			| qcg locals	|  returning to this frame is not allowed
  *  	       tailcall +---------------+-----------------------
  *			| link+pad  	|  Translated region frame
@@ -28,6 +28,38 @@ struct _RetPair {
  *			| ....		|  qcgstub_* frame
  */
 
+// State offsets of PinnedRegs::PREGS, read by trampoline and escape stubs
+extern "C" u32 qcg_pinned_offs[PinnedRegs::PREGS.size()];
+u32 qcg_pinned_offs[PinnedRegs::PREGS.size()] = {
+    offsetof(CPUState, pinned_scratch), offsetof(CPUState, pinned_scratch),
+    offsetof(CPUState, pinned_scratch), offsetof(CPUState, pinned_scratch)};
+
+u8 PinnedRegs::count{0};
+std::array<u16, PinnedRegs::PREGS.size()> PinnedRegs::offs{};
+
+void PinnedRegs::Init(std::span<u16 const> state_offs)
+{
+    if (state_offs.size() > PREGS.size())
+        Panic("too many pinned registers");
+    count = state_offs.size();
+    for (u8 i = 0; i < count; ++i) {
+        offs[i] = state_offs[i];
+        qcg_pinned_offs[i] = state_offs[i];
+    }
+}
+
+static_assert(PinnedRegs::PREGS[0] == asmjit::x86::Gp::kIdBx);
+static_assert(PinnedRegs::PREGS[1] == asmjit::x86::Gp::kIdR12);
+static_assert(PinnedRegs::PREGS[2] == asmjit::x86::Gp::kIdR14);
+static_assert(PinnedRegs::PREGS[3] == asmjit::x86::Gp::kIdR15);
+
+#define PINNED_LOAD(idx, reg)                          \
+    "movl	qcg_pinned_offs+" #idx "*4(%rip), %eax\n\t" \
+    "movl	(%r13,%rax), %" reg "\n\t"
+#define PINNED_STORE(idx, reg)                         \
+    "movl	qcg_pinned_offs+" #idx "*4(%rip), %ecx\n\t" \
+    "movl	%" reg ", (%r13,%rcx)\n\t"
+
 static_assert((qcg::ArchTraits::spillframe_size & 15) == 0);
 static_assert(qcg::ArchTraits::STATE == asmjit::x86::Gp::kIdR13);
 static_assert(qcg::ArchTraits::MEMBASE == asmjit::x86::Gp::kIdBp);
@@ -44,7 +76,9 @@ HELPER_ASM ppoint::BranchSlot *trampoline_to_jit(CPUState *state,
         "pushq	%r14\n\t"
         "pushq	%r15\n\t"
         "movq 	%rdi, %r13\n\t"    // STATE
-        "movq	%rsi, %rbp\n\t");  // MEMBASE
+        "movq	%rsi, %rbp\n\t"    // MEMBASE
+        PINNED_LOAD(0, "ebx") PINNED_LOAD(1, "r12d")
+        PINNED_LOAD(2, "r14d") PINNED_LOAD(3, "r15d"));
     asm("sub     	$%c0, %%rsp\n\t"
         :
         : "i"(qcg::ArchTraits::spillframe_size + 8));
@@ -59,6 +93,8 @@ HELPER_ASM ppoint::BranchSlot *trampoline_to_jit(CPUState *state,
 // Escape from translated code, forward rax(slot) to caller
 HELPER_ASM void qcgstub_escape_link()
 {
+    asm(PINNED_STORE(0, "ebx") PINNED_STORE(1, "r12d")
+        PINNED_STORE(2, "r14d") PINNED_STORE(3, "r15d"));
     asm("addq   	$%c0, %%rsp"
         :
         : "i"(qcg::ArchTraits::spillframe_size + 16));
@@ -74,6 +110,8 @@ HELPER_ASM void qcgstub_escape_link()
 // Escape from translated code, return nullptr(slot) to caller
 HELPER_ASM void qcgstub_escape_brind()
 {
+    asm(PINNED_STORE(0, "ebx") PINNED_STORE(1, "r12d")
+        PINNED_STORE(2, "r14d") PINNED_STORE(3, "r15d"));
     asm("addq   	$%c0, %%rsp"
         :
         : "i"(qcg::ArchTraits::spillframe_size + 16));
@@ -91,12 +129,22 @@ HELPER_ASM void qcgstub_escape_brind()
 static ALWAYS_INLINE _RetPair TryLinkBranch(CPUState *state,
                                             ppoint::BranchSlot *slot)
 {
+    tcache::CountEvent(&tcache::ThreadCounters::lazy_links);
     auto found = tcache::Lookup(slot->gip);
     if (likely(found)) {
-        slot->Link(found->tcode.ptr);
-        tcache::RecordLink(slot, found, slot->flags.cross_segment);
+        tcache::LinkBranch(slot, found);
         return {slot, found->tcode.ptr};
     }
+    // Compile without unwinding to Execute, but if tcache was flushed to do
+    // so then slot is gone
+    u32 flush_count = tcache::FlushCount();
+    if (auto *tb = TryCompileInPlace(slot->gip)) {
+        if (likely(tcache::FlushCount() == flush_count))
+            tcache::LinkBranch(slot, tb);
+        else
+            state->ResetRAS();
+        return {slot, tb->tcode.ptr};
+    }
     state->ip = slot->gip;
     return {slot, (void *) qcgstub_escape_link};
 }
@@ -117,12 +165,17 @@ HELPER _RetPair qcg_TryLinkBranchJIT(CPUState *state, void *retaddr)
                          ppoint::BranchSlot::FromCallPtrRetaddr(retaddr));
 }
 
-// Indirect branch slowpath
-HELPER void *qcgstub_brind(CPUState *state, u32 gip)
+// Indirect branch slowpath, ic is the inline cache of a site with free entries
+HELPER void *qcgstub_brind(CPUState *state,
+                           u32 gip,
+                           tcache::BrindCacheEntry *ic)
 {
     state->ip = gip;
+    tcache::CountEvent(&tcache::ThreadCounters::brind_misses);
     auto *found = tcache::Lookup(gip);
     if (likely(found)) {
+        if (ic)
+            tcache::FillBrindIC(ic, found);
         tcache::CacheBrind(found);
         return (void *) found->tcode.ptr;
     }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstring>
+#include <span>
+
 #include "codegen/arch_traits.h"
 
 namespace dbt
@@ -45,11 +48,23 @@ private:
         CallTab x3;
     } __attribute__((packed, may_alias)) code;
 
-    template <typename P, typename... Args>
-    P *CreatePatch(Args &&...args)
+    // Patch is published with a single aligned qword store, so threads
+    // executing the slot see either old or new code. Bytes past the first
+    // qword are written beforehand and must be dead in the current patch.
+    template <typename P>
+    void CommitPatch(P const &patch)
     {
-        static_assert(sizeof(P) <= sizeof(code));
-        return new (&code) P(args...);
+        static_assert(sizeof(P) <= sizeof(code) && sizeof(code) <= 16);
+        assert(((uptr) &code & 7) == 0);
+        u8 buf[16];
+        memcpy(buf, &code, sizeof(code));
+        memcpy(buf, &patch, sizeof(P));
+        if constexpr (sizeof(P) > sizeof(u64))
+            memcpy((u8 *) &code + sizeof(u64), buf + sizeof(u64),
+                   sizeof(P) - sizeof(u64));
+        u64 head;
+        memcpy(&head, buf, sizeof(head));
+        __atomic_store_n((u64 *) &code, head, __ATOMIC_RELEASE);
     }
 
 public:
@@ -76,17 +91,24 @@ public:
 
 inline void BranchSlot::LinkLazyJIT()
 {
-    CreatePatch<Call64Abs>()->imm = (uptr) (*RuntimeStubTab::GetGlobal())
+    Call64Abs patch;
+    patch.imm = (uptr) (*RuntimeStubTab::GetGlobal())
         [RuntimeStubId::id_link_branch_jit];
+    CommitPatch(patch);
 }
 
 inline void BranchSlot::Link(void *to)
 {
     iptr rel = (iptr) to - ((iptr) &code + sizeof(Jump32Rel));
     if ((i32) rel == rel) {
-        CreatePatch<Jump32Rel>()->imm = rel;
+        Jump32Rel patch;
+        patch.imm = rel;
+        CommitPatch(patch);
     } else {
-        CreatePatch<Jump64Abs>()->imm = (uptr) to;
+        // Not atomic over Call64Abs, unreachable within the code_pool
+        Jump64Abs patch;
+        patch.imm = (uptr) to;
+        CommitPatch(patch);
     }
 }
 
@@ -96,4 +118,29 @@ extern "C" ppoint::BranchSlot *trampoline_to_jit(CPUState *state,
                                                  void *vmem,
                                                  void *tc_ptr);
 
+// Guest registers pinned to callee-saved host registers for the whole
+// execution. They are loaded in trampoline_to_jit, written back by escape
+// stubs and survive qcgstub_* calls. Configured once before translation.
+struct PinnedRegs {
+    static constexpr std::array<qir::RegN, 4> PREGS = {
+        qcg::ArchTraits::RBX, qcg::ArchTraits::R12, qcg::ArchTraits::R14,
+        qcg::ArchTraits::R15};
+
+    static void Init(std::span<u16 const> state_offs);
+
+    // Host register of pinned state slot, or RegNBad
+    static qir::RegN Lookup(u16 state_offs)
+    {
+        for (u8 i = 0; i < count; ++i) {
+            if (offs[i] == state_offs)
+                return PREGS[i];
+        }
+        return qir::RegNBad;
+    }
+
+private:
+    static u8 count;
+    static std::array<u16, PREGS.size()> offs;
+};
+
 }  // namespace dbt::jitabi
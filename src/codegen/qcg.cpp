@@ -18,7 +18,8 @@ private:
 std::span<u8> GenerateCode(CompilerRuntime *cruntime,
                            qir::CodeSegment *segment,
                            qir::Region *r,
-                           u32 ip)
+                           u32 ip,
+                           RegionRelocs *relocs)
 {
     ArchTraits::init();
     MachineRegionInfo mregion_info;
@@ -27,7 +28,7 @@ std::span<u8> GenerateCode(CompilerRuntime *cruntime,
 
     QRegAllocPass::run(r);
 
-    QEmit ce(r, cruntime, segment, !mregion_info.has_calls);
+    QEmit ce(r, cruntime, segment, !mregion_info.has_calls, relocs);
     QCodegen cg(r, &ce);
     cg.Run(ip);
 
@@ -35,6 +36,28 @@ std::span<u8> GenerateCode(CompilerRuntime *cruntime,
     return code;
 }
 
+bool HasVectorOps()
+{
+    ArchTraits::init();
+    return ArchTraits::has_avx2;
+}
+
+bool HasFRoundOps()
+{
+    ArchTraits::init();
+    return ArchTraits::has_sse41;
+}
+
+u32 HostFeatureBits()
+{
+    ArchTraits::init();
+    u32 bits = 0, n = 0;
+#define _(name) bits |= (u32) ArchTraits::has_##name << n++;
+    ARCH_HOST_FEATURES(_)
+#undef _
+    return bits;
+}
+
 struct QCodegenVisitor : qir::InstVisitor<QCodegenVisitor, void> {
 public:
     QCodegenVisitor(QCodegen *cg_) : cg(cg_) {}
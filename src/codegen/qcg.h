@@ -5,10 +5,19 @@
 
 namespace dbt::qcg
 {
+// relocs is filled if not nullptr, code is emitted relocatable then
 std::span<u8> GenerateCode(CompilerRuntime *cruntime,
                            qir::CodeSegment *segment,
                            qir::Region *r,
-                           u32 ip);
+                           u32 ip,
+                           RegionRelocs *relocs);
+
+// Vector QIR ops are supported only if host has AVX2
+bool HasVectorOps();
+// fcvtfi rounding other than ZERO is supported only if host has SSE4.1
+bool HasFRoundOps();
+// Bit set of host ISA extensions generated code may depend on
+u32 HostFeatureBits();
 
 struct MachineRegionInfo {
     bool has_calls = false;
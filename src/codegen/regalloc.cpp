@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "codegen/arch_traits.h"
+#include "codegen/jitabi.h"
 #include "codegen/qcg.h"
 #include "ir/qir_builder.h"
 
@@ -8,6 +11,14 @@ struct QRegAlloc {
     static constexpr auto N_PREGS = ArchTraits::GPR_NUM;
     static constexpr auto PREGS_POOL = ArchTraits::GPR_POOL;
     static constexpr auto MAX_VREGS = 512;  // TODO: reuse temps
+    static_assert(ArchTraits::XMM_NUM == N_PREGS);
+
+    // FP vregs are allocated to xmm registers, the rest to gprs
+    enum RegClass : u8 {
+        CLASS_GPR,
+        CLASS_XMM,
+        N_CLASSES,
+    };
 
     struct RTrack {
         RTrack() {}
@@ -17,7 +28,11 @@ struct QRegAlloc {
         static constexpr auto NO_SPILL = static_cast<u16>(-1);
 
         qir::VType type{};
+        RegClass rc{};
         bool is_global{};
+        bool is_bound{};  // global kept in preg for the whole region
+        bool is_dirty{};  // bound and written in region
+        bool is_pinned{};  // bound for the whole execution, see PinnedRegs
         u16 spill_offs{NO_SPILL};
 
     private:
@@ -37,12 +52,45 @@ struct QRegAlloc {
     QRegAlloc(qir::Region *region_);
     void Run();
 
-    qir::RegN AllocPReg(RegMask desire, RegMask avoid);
+    // Globals accessed in several blocks of the region are bound to these
+    // registers, so they survive intra-region branches
+    static constexpr std::array<qir::RegN, 4> BIND_PREGS = {
+        ArchTraits::RBX, ArchTraits::R12, ArchTraits::R14, ArchTraits::R15};
+    void BindGlobals();
+    void BlockEntry();
+
+    // Backward liveness of globals, valid for instructions of the input ir
+    void ComputeLiveness();
+    qir::GlobalsMask LiveAfter(qir::Inst *ins) const
+    {
+        return live_after[ins->GetId()];
+    }
+    bool IsLive(qir::GlobalsMask live, RTrack *v) const
+    {
+        return live & ((qir::GlobalsMask) 1 << (v - &vregs[0]));
+    }
+
+    static bool IsVReg(qir::VOperand opr)
+    {
+        return opr.IsVGPR() || opr.IsVFPR();
+    }
+    static qir::RegN GetVReg(qir::VOperand opr)
+    {
+        return opr.IsVGPR() ? opr.GetVGPR() : opr.GetVFPR();
+    }
+    static qir::VOperand MakePReg(RegClass rc, qir::VType type, qir::RegN p)
+    {
+        return rc == CLASS_XMM ? qir::VOperand::MakePFPR(type, p)
+                               : qir::VOperand::MakePGPR(type, p);
+    }
+
+    qir::RegN AllocPReg(RegClass rc, RegMask desire, RegMask avoid);
     void EmitSpill(RTrack *v);
     void EmitFill(RTrack *v);
     void EmitMov(qir::VOperand pdst, qir::VOperand psrc);
-    void Spill(qir::RegN p);
+    void Spill(RegClass rc, qir::RegN p);
     void Spill(RTrack *v);
+    void SpillIfLive(RTrack *v, qir::GlobalsMask live);
     void SyncSpill(RTrack *v);
     template <bool kill>
     void Release(RTrack *v);
@@ -54,11 +102,13 @@ struct QRegAlloc {
     RTrack *AddTrackLocal(qir::VType type);
 
     void Prologue();
-    void BlockBoundary();
-    void RegionBoundary();
+    void BlockBoundary(qir::GlobalsMask live);
+    void RegionBoundary(qir::GlobalsMask live);
 
     void AllocOp(qir::Inst *ins);
-    void CallOp(bool use_globals = true);
+    void CallOp(qir::GlobalsMask live,
+                qir::GlobalsMask uses,
+                qir::GlobalsMask defs);
 
     static constexpr u16 frame_size{ArchTraits::spillframe_size};
 
@@ -66,12 +116,14 @@ struct QRegAlloc {
     qir::VRegsInfo const *vregs_info{};
     qir::Builder qb{nullptr};
 
-    RegMask fixed{ArchTraits::GPR_FIXED};
+    std::array<RegMask, N_CLASSES> fixed{ArchTraits::GPR_FIXED,
+                                         ArchTraits::XMM_FIXED};
     u16 frame_cur{0};
 
     u16 n_vregs{0};
     std::array<RTrack, MAX_VREGS> vregs{};
-    std::array<RTrack *, N_PREGS> p2v{nullptr};
+    std::array<std::array<RTrack *, N_PREGS>, N_CLASSES> p2v{};
+    std::vector<qir::GlobalsMask> live_after;
 };
 
 QRegAlloc::QRegAlloc(qir::Region *region_)
@@ -82,7 +134,14 @@ QRegAlloc::QRegAlloc(qir::Region *region_)
 
     for (u16 i = 0; i < n_globals; ++i) {
         auto *gr = vregs_info->GetGlobalInfo(i);
-        AddTrackGlobal(gr->type, gr->state_offs);
+        auto *v = AddTrackGlobal(gr->type, gr->state_offs);
+        auto p = jitabi::PinnedRegs::Lookup(gr->state_offs);
+        if (p != qir::RegNBad) {
+            v->is_bound = v->is_pinned = true;
+            v->is_dirty = true;  // state slot is stale in translated code
+            v->p = p;
+            fixed[CLASS_GPR].Set(p);
+        }
     }
 
     for (u16 i = n_globals; i < n_all; ++i) {
@@ -91,17 +150,17 @@ QRegAlloc::QRegAlloc(qir::Region *region_)
     }
 }
 
-qir::RegN QRegAlloc::AllocPReg(RegMask desire, RegMask avoid)
+qir::RegN QRegAlloc::AllocPReg(RegClass rc, RegMask desire, RegMask avoid)
 {
     RegMask target = desire & ~avoid;
     for (qir::RegN p = 0; p < N_PREGS; ++p) {
-        if (!p2v[p] && target.Test(p))
+        if (!p2v[rc][p] && target.Test(p))
             return p;
     }
 
     for (qir::RegN p = 0; p < N_PREGS; ++p) {
         if (target.Test(p)) {
-            Spill(p);
+            Spill(rc, p);
             return p;
         }
     }
@@ -112,17 +171,17 @@ void QRegAlloc::EmitSpill(RTrack *v)
 {
     if (!v->is_global && (v->spill_offs == RTrack::NO_SPILL))
         AllocFrameSlot(v);
-    auto pgpr = qir::VOperand::MakePGPR(v->type, v->p);
+    auto preg = MakePReg(v->rc, v->type, v->p);
     qb.Create_mov(qir::VOperand::MakeSlot(v->is_global, v->type, v->spill_offs),
-                  pgpr);
+                  preg);
 }
 
 void QRegAlloc::EmitFill(RTrack *v)
 {
     assert(v->spill_offs != RTrack::NO_SPILL);
-    auto pgpr = qir::VOperand::MakePGPR(v->type, v->p);
+    auto preg = MakePReg(v->rc, v->type, v->p);
     qb.Create_mov(
-        pgpr, qir::VOperand::MakeSlot(v->is_global, v->type, v->spill_offs));
+        preg, qir::VOperand::MakeSlot(v->is_global, v->type, v->spill_offs));
 }
 
 void QRegAlloc::EmitMov(qir::VOperand dst, qir::VOperand src)
@@ -130,9 +189,9 @@ void QRegAlloc::EmitMov(qir::VOperand dst, qir::VOperand src)
     qb.Create_mov(dst, src);
 }
 
-void QRegAlloc::Spill(qir::RegN p)
+void QRegAlloc::Spill(RegClass rc, qir::RegN p)
 {
-    RTrack *v = p2v[p];
+    RTrack *v = p2v[rc][p];
     if (!v)
         return;
     Spill(v);
@@ -144,6 +203,140 @@ void QRegAlloc::Spill(RTrack *v)
     Release<false>(v);
 }
 
+// Dead globals are dropped without spill
+void QRegAlloc::SpillIfLive(RTrack *v, qir::GlobalsMask live)
+{
+    if (IsLive(live, v))
+        SyncSpill(v);
+    Release<false>(v);
+}
+
+void QRegAlloc::ComputeLiveness()
+{
+    assert(vregs_info->NumGlobals() <= sizeof(qir::GlobalsMask) * 8);
+    live_after.assign(region->GetNumInsts(), qir::GlobalsAll);
+    std::vector<qir::GlobalsMask> live_in(region->GetNumBlocks(), 0);
+
+    auto gmask = [&](qir::VOperandSpan oprs) {
+        qir::GlobalsMask m = 0;
+        for (u8 i = 0; i < oprs.size(); ++i) {
+            if (IsVReg(oprs[i]) && vregs_info->IsGlobal(GetVReg(oprs[i])))
+                m |= (qir::GlobalsMask) 1 << GetVReg(oprs[i]);
+        }
+        return m;
+    };
+
+    // Regions are small and mostly acyclic, iterate to fixpoint
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto &bb : region->GetBlocks()) {
+            // Blocks without successors leave the region
+            auto live = bb.GetSuccs().empty() ? qir::GlobalsAll : 0;
+            for (auto *succ : bb.GetSuccs())
+                live |= live_in[succ->GetId()];
+
+            auto &ilist = bb.ilist;
+            for (auto iit = ilist.end(); iit != ilist.begin();) {
+                auto *ins = &*--iit;
+                switch (ins->GetOpcode()) {
+                case qir::Op::_gbr:
+                    live = static_cast<qir::InstGBr *>(ins)->live;
+                    break;
+                case qir::Op::_gbrind:
+                    live = qir::GlobalsAll;
+                    break;
+                default:
+                    break;
+                }
+                live_after[ins->GetId()] = live;
+                live &= ~gmask(ins->outputs());
+                live |= gmask(ins->inputs());
+                if (ins->GetOpcode() == qir::Op::_hcall)
+                    live |= static_cast<qir::InstHcall *>(ins)->uses;
+            }
+            if (live_in[bb.GetId()] != live) {
+                live_in[bb.GetId()] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+void QRegAlloc::BindGlobals()
+{
+    auto n_globals = vregs_info->NumGlobals();
+    if (region->GetNumBlocks() < 2)
+        return;
+
+    struct Usage {
+        u32 n_uses{0};
+        u32 n_blocks{0};
+        u32 last_bb{(u32) -1};
+        bool written{false};
+    };
+    std::vector<Usage> usage(n_globals);
+
+    for (auto &bb : region->GetBlocks()) {
+        for (auto &ins : bb.ilist) {
+            // Calls may access guest state, keep the default scheme
+            if (ins.GetFlags() & qir::Inst::HAS_CALLS)
+                return;
+            auto account = [&](qir::VOperand &opr, bool is_out) {
+                if (!opr.IsVGPR() || !vregs_info->IsGlobal(opr.GetVGPR()))
+                    return;
+                auto &u = usage[opr.GetVGPR()];
+                u.n_uses++;
+                u.written |= is_out;
+                if (u.last_bb != bb.GetId()) {
+                    u.last_bb = bb.GetId();
+                    u.n_blocks++;
+                }
+            };
+            auto outs = ins.outputs();
+            for (u8 i = 0; i < outs.size(); ++i)
+                account(outs[i], true);
+            auto ins_ = ins.inputs();
+            for (u8 i = 0; i < ins_.size(); ++i)
+                account(ins_[i], false);
+        }
+    }
+
+    std::vector<qir::RegN> pregs;
+    for (auto p : BIND_PREGS) {
+        if (!fixed[CLASS_GPR].Test(p))
+            pregs.push_back(p);
+    }
+
+    std::vector<qir::RegN> cand;
+    for (qir::RegN i = 0; i < n_globals; ++i) {
+        if (usage[i].n_blocks > 1 && !vregs[i].is_pinned)
+            cand.push_back(i);
+    }
+    std::sort(cand.begin(), cand.end(), [&](qir::RegN a, qir::RegN b) {
+        return usage[a].n_uses > usage[b].n_uses;
+    });
+    if (cand.size() > pregs.size())
+        cand.resize(pregs.size());
+
+    for (size_t k = 0; k < cand.size(); ++k) {
+        auto *v = &vregs[cand[k]];
+        v->is_bound = true;
+        v->is_dirty = usage[cand[k]].written;
+        v->p = pregs[k];
+        fixed[CLASS_GPR].Set(v->p);
+    }
+}
+
+// State of bound globals is conservative at block entry
+void QRegAlloc::BlockEntry()
+{
+    for (qir::RegN i = 0; i < n_vregs; ++i) {
+        auto *v = &vregs[i];
+        if (v->is_bound)
+            v->spill_synced = !v->is_dirty;
+    }
+}
+
 void QRegAlloc::SyncSpill(RTrack *v)
 {
     if (v->spill_synced)  // or fixed
@@ -164,6 +357,8 @@ void QRegAlloc::SyncSpill(RTrack *v)
 template <bool kill>
 void QRegAlloc::Release(RTrack *v)
 {
+    if (v->is_bound)
+        return;
     bool release_reg = (v->loc == RTrack::Location::REG);
     if (v->is_global) {  // return if fixed
         v->loc = RTrack::Location::MEM;
@@ -172,7 +367,7 @@ void QRegAlloc::Release(RTrack *v)
                       : RTrack::Location::MEM;  // TODO: liveness
     }
     if (release_reg)
-        p2v[v->p] = nullptr;
+        p2v[v->rc][v->p] = nullptr;
 }
 
 void QRegAlloc::AllocFrameSlot(RTrack *v)
@@ -192,9 +387,9 @@ void QRegAlloc::Fill(RTrack *v, RegMask desire, RegMask avoid)
 {
     switch (v->loc) {
     case RTrack::Location::MEM:
-        v->p = AllocPReg(desire, avoid);
+        v->p = AllocPReg(v->rc, desire, avoid);
         v->loc = RTrack::Location::REG;
-        p2v[v->p] = v;
+        p2v[v->rc][v->p] = v;
         v->spill_synced = true;
         EmitFill(v);
         return;
@@ -218,6 +413,7 @@ QRegAlloc::RTrack *QRegAlloc::AddTrackGlobal(qir::VType type, u16 state_offs)
     auto *v = AddTrack();
     v->is_global = true;
     v->type = type;
+    v->rc = qir::VTypeIsFloat(type) ? CLASS_XMM : CLASS_GPR;
     v->spill_offs = state_offs;
     return v;
 }
@@ -227,16 +423,32 @@ QRegAlloc::RTrack *QRegAlloc::AddTrackLocal(qir::VType type)
     auto *v = AddTrack();
     v->is_global = false;
     v->type = type;
+    v->rc = qir::VTypeIsFloat(type) ? CLASS_XMM : CLASS_GPR;
     v->spill_offs = RTrack::NO_SPILL;
     return v;
 }
 
 void QRegAlloc::Prologue()
 {
+    ComputeLiveness();
+    BindGlobals();
+
+    auto &entry_bb = *region->GetBlocks().begin();
+    qb = qir::Builder(&entry_bb, entry_bb.ilist.begin());
+
     for (qir::RegN i = 0; i < n_vregs; ++i) {
         auto *v = &vregs[i];
 
-        if (v->is_global) {
+        if (v->is_pinned) {
+            // Already loaded by trampoline
+            v->loc = RTrack::Location::REG;
+            p2v[v->rc][v->p] = v;
+        } else if (v->is_bound) {
+            v->loc = RTrack::Location::REG;
+            p2v[v->rc][v->p] = v;
+            v->spill_synced = true;
+            EmitFill(v);
+        } else if (v->is_global) {
             v->loc = RTrack::Location::MEM;
         } else {
             v->loc = RTrack::Location::DEAD;
@@ -244,20 +456,23 @@ void QRegAlloc::Prologue()
     }
 }
 
-void QRegAlloc::BlockBoundary()
+void QRegAlloc::BlockBoundary(qir::GlobalsMask live)
 {
     for (qir::RegN i = 0; i < n_vregs; ++i) {
-        if (vregs[i].is_global)  // TODO: locals escape BB
-            Spill(&vregs[i]);    // skip if fixed
+        auto *v = &vregs[i];
+        if (v->is_global && !v->is_bound)  // TODO: locals escape BB
+            SpillIfLive(v, live);
     }
 }
 
-void QRegAlloc::RegionBoundary()
+void QRegAlloc::RegionBoundary(qir::GlobalsMask live)
 {
     for (qir::RegN i = 0; i < n_vregs; ++i) {
         auto vreg = &vregs[i];
-        if (vreg->is_global) {
-            Spill(vreg);
+        if (vreg->is_pinned) {
+            continue;
+        } else if (vreg->is_global) {
+            SpillIfLive(vreg, live);
         } else {
             Release<false>(vreg);
         }
@@ -273,6 +488,7 @@ void QRegAlloc::AllocOp(qir::Inst *ins)
     auto &op_info = GetOpInfo(ins->GetOpcode());
     auto *op_ct = op_info.ra_ct;
     auto *op_order = op_info.ra_order;
+    auto clobber = op_info.ra_clobber ? *op_info.ra_clobber : RegMask(0);
     assert(op_ct);
 
     auto avoid = fixed;
@@ -282,31 +498,42 @@ void QRegAlloc::AllocOp(qir::Inst *ins)
         auto ct = op_ct[dst_n + i];
 
         auto opr = &srcl[i];
-        if (!opr->IsVGPR())
+        if (!IsVReg(*opr))
             continue;
-        auto src = &vregs[opr->GetVGPR()];
-        Fill(src, ct.cr, avoid);
+        auto src = &vregs[GetVReg(*opr)];
+        auto rc = src->rc;
+        Fill(src, ct.cr, avoid[rc]);
         auto p = src->p;
         if (!ct.cr.Test(p)) {
-            p = AllocPReg(ct.cr, avoid);
-            qb.Create_mov(qir::VOperand::MakePGPR(src->type, p),
-                          qir::VOperand::MakePGPR(src->type, src->p));
+            p = AllocPReg(rc, ct.cr, avoid[rc]);
+            qb.Create_mov(MakePReg(rc, src->type, p),
+                          MakePReg(rc, src->type, src->p));
             if constexpr (false) {  // TODO(tuning): different dep. distance,
                                     // check perf
-                p2v[src->p] = nullptr;
-                p2v[p] = src;
+                p2v[rc][src->p] = nullptr;
+                p2v[rc][p] = src;
                 src->p = p;
             }
         }
 
-        avoid.Set(p);
-        *opr = qir::VOperand::MakePGPR(opr->GetType(), p);
+        avoid[rc].Set(p);
+        *opr = MakePReg(rc, opr->GetType(), p);
+    }
+
+    // Inputs are consumed before clobbered registers are overwritten
+    for (qir::RegN p = 0; p < N_PREGS; ++p) {
+        if (clobber.Test(p))
+            Spill(CLASS_GPR, p);
     }
+    avoid[CLASS_GPR] = avoid[CLASS_GPR] & ~clobber;
 
+    // Memory faults are either fatal or resumed transparently, so globals
+    // which are dead after the access need no sync
     if (ins->GetFlags() & qir::Inst::Flags::SIDEEFF) {
+        auto live = LiveAfter(ins);
         for (int i = 0; i < n_vregs; ++i) {
             auto *v = &vregs[i];
-            if (v->is_global)
+            if (v->is_global && !v->is_pinned && IsLive(live, v))
                 SyncSpill(v);
         }
     }
@@ -316,57 +543,87 @@ void QRegAlloc::AllocOp(qir::Inst *ins)
         auto ct = op_ct[i];
 
         auto opr = &dstl[i];
-        if (!opr->IsVGPR())
+        if (!IsVReg(*opr))
             continue;
-        auto dst = &vregs[opr->GetVGPR()];
+        auto dst = &vregs[GetVReg(*opr)];
+        auto rc = dst->rc;
 
         // TODO(tuning): forcefull renaming, check perf
-        if constexpr (true) {
+        if (dst->is_bound) {
+            if (!ct.cr.Test(dst->p)) {
+                // Fixed output register, copy to the bound preg afterwards
+                auto p = AllocPReg(rc, ct.cr, avoid[rc]);
+                auto next = qb.GetIterator();
+                qir::Builder(qb.GetBlock(), ++next)
+                    .Create_mov(MakePReg(rc, dst->type, dst->p),
+                                MakePReg(rc, dst->type, p));
+                dst->spill_synced = false;
+                avoid[rc].Set(p);
+                *opr = MakePReg(rc, opr->GetType(), p);
+                continue;
+            }
+        } else if constexpr (true) {
             if (ct.has_alias) {
                 // QSel guarantees there will be the same VReg, so dst already
                 // matches ct
             } else {
-                auto p = AllocPReg(ct.cr, avoid);
+                auto p = AllocPReg(rc, ct.cr, avoid[rc]);
                 if (dst->loc == RTrack::Location::REG) {
-                    p2v[dst->p] = nullptr;
+                    p2v[rc][dst->p] = nullptr;
                 }
                 dst->loc = RTrack::Location::REG;
-                p2v[p] = dst;
+                p2v[rc][p] = dst;
                 dst->p = p;
             }
         } else {
             if (dst->loc != RTrack::Location::REG) {
-                dst->p = AllocPReg(ct.cr, avoid);
-                p2v[dst->p] = dst;
+                dst->p = AllocPReg(rc, ct.cr, avoid[rc]);
+                p2v[rc][dst->p] = dst;
                 dst->loc = RTrack::Location::REG;
             } else if (!ct.cr.Test(dst->p)) {
-                auto p = AllocPReg(ct.cr, avoid);
-                p2v[dst->p] = nullptr;
-                p2v[p] = dst;
+                auto p = AllocPReg(rc, ct.cr, avoid[rc]);
+                p2v[rc][dst->p] = nullptr;
+                p2v[rc][p] = dst;
                 dst->p = p;
             }
         }
         dst->spill_synced = false;
-        avoid.Set(dst->p);
-        *opr = qir::VOperand::MakePGPR(opr->GetType(), dst->p);
+        avoid[rc].Set(dst->p);
+        *opr = MakePReg(rc, opr->GetType(), dst->p);
     }
 }
 
 // TODO: resurrect allocation for helpers
-void QRegAlloc::CallOp(bool use_globals)
+// Pinned globals survive the call, but stubs may read them from state, those
+// written by the stub are reloaded
+void QRegAlloc::CallOp(qir::GlobalsMask live,
+                       qir::GlobalsMask uses,
+                       qir::GlobalsMask defs)
 {
-    for (u8 p = 0; p < N_PREGS; ++p) {
-        if (ArchTraits::GPR_CALL_CLOBBER.Test(p))
-            Spill(p);
-    }
+    auto next = qb.GetIterator();
+    qir::Builder post(qb.GetBlock(), ++next);
 
-    if (use_globals) {
-        for (u8 i = 0; i < n_vregs; ++i) {
-            auto *v = &vregs[i];
-            if (v->is_global)
-                Spill(v);
+    for (qir::RegN i = 0; i < n_vregs; ++i) {
+        auto *v = &vregs[i];
+        if (v->is_pinned) {
+            SpillIfLive(v, uses);
+            if (IsLive(defs, v)) {
+                post.Create_mov(
+                    qir::VOperand::MakePGPR(v->type, v->p),
+                    qir::VOperand::MakeSlot(true, v->type, v->spill_offs));
+                v->spill_synced = true;
+            }
+        } else if (v->is_global) {
+            SpillIfLive(v, live | uses);
         }
     }
+
+    // xmm registers are not preserved across calls
+    for (u8 p = 0; p < N_PREGS; ++p) {
+        if (ArchTraits::GPR_CALL_CLOBBER.Test(p))
+            Spill(CLASS_GPR, p);
+        Spill(CLASS_XMM, p);
+    }
 }
 
 struct QRegAllocVisitor : qir::InstVisitor<QRegAllocVisitor, void> {
@@ -383,35 +640,72 @@ public:
 
     void visitInstSetcc(qir::InstSetcc *ins) { ra->AllocOp(ins); }
 
-    void visitInstBr(UNUSED qir::InstBr *ins)
+    void visitInstBr(qir::InstBr *ins)
     {
         // has no voperands
-        ra->BlockBoundary();
+        ra->BlockBoundary(ra->LiveAfter(ins));
     }
 
     void visitInstBrcc(qir::InstBrcc *ins)
     {
         ra->AllocOp(ins);
-        ra->BlockBoundary();
+        ra->BlockBoundary(ra->LiveAfter(ins));
     }
 
-    void visitInstGBr(UNUSED qir::InstGBr *ins)
+    void visitInstGBr(qir::InstGBr *ins)
     {
         // has no voperands
-        ra->RegionBoundary();
+        ra->RegionBoundary(ins->live);
     }
 
     void visitInstGBrind(qir::InstGBrind *ins)
     {
         ra->AllocOp(ins);
-        ra->RegionBoundary();
+        ra->RegionBoundary(qir::GlobalsAll);
     }
 
+    void visitInstRasPush(UNUSED qir::InstRasPush *ins) {}
+
     void visitInstVMLoad(qir::InstVMLoad *ins) { ra->AllocOp(ins); }
 
     void visitInstVMStore(qir::InstVMStore *ins) { ra->AllocOp(ins); }
 
-    void visitInstHcall(UNUSED qir::InstHcall *ins) { ra->CallOp(true); }
+    void visitInstVMLr(qir::InstVMLr *ins) { ra->AllocOp(ins); }
+
+    void visitInstVMSc(qir::InstVMSc *ins) { ra->AllocOp(ins); }
+
+    void visitInstVMAtomic(qir::InstVMAtomic *ins) { ra->AllocOp(ins); }
+
+    void visitInstFUnop(qir::InstFUnop *ins) { ra->AllocOp(ins); }
+
+    void visitInstFBinop(qir::InstFBinop *ins) { ra->AllocOp(ins); }
+
+    void visitInstFCmp(qir::InstFCmp *ins) { ra->AllocOp(ins); }
+
+    void visitInstFCvtFI(qir::InstFCvtFI *ins) { ra->AllocOp(ins); }
+
+    void visitInstFCvtIF(qir::InstFCvtIF *ins) { ra->AllocOp(ins); }
+
+    void visitInstFMov(qir::InstFMov *ins) { ra->AllocOp(ins); }
+
+    void visitInstVMFLoad(qir::InstVMFLoad *ins) { ra->AllocOp(ins); }
+
+    void visitInstVMFStore(qir::InstVMFStore *ins) { ra->AllocOp(ins); }
+
+    void visitInstVecLoad(qir::InstVecLoad *ins) { ra->AllocOp(ins); }
+
+    void visitInstVecStore(qir::InstVecStore *ins) { ra->AllocOp(ins); }
+
+    void visitInstVecBinop(qir::InstVecBinop *ins) { ra->AllocOp(ins); }
+
+    void visitInstICount(UNUSED qir::InstICount *ins) {}
+
+    void visitInstRdtsc(qir::InstRdtsc *ins) { ra->AllocOp(ins); }
+
+    void visitInstHcall(qir::InstHcall *ins)
+    {
+        ra->CallOp(ra->LiveAfter(ins), ins->uses, ins->defs);
+    }
 
     void visit_sll(qir::InstBinop *ins) { ra->AllocOp(ins); }
 
@@ -429,6 +723,7 @@ void QRegAlloc::Run()
 
     for (auto &bb : region->GetBlocks()) {
         auto &ilist = bb.ilist;
+        BlockEntry();
 
         for (auto iit = ilist.begin(); iit != ilist.end(); ++iit) {
             qb = qir::Builder(&bb, iit);
@@ -102,10 +102,50 @@ public:
 
     void visitInstGBrind(qir::InstGBrind *ins) { sel->SelectOperands(ins); }
 
+    void visitInstRasPush(UNUSED qir::InstRasPush *ins) {}
+
     void visitInstVMLoad(qir::InstVMLoad *ins) { sel->SelectOperands(ins); }
 
     void visitInstVMStore(qir::InstVMStore *ins) { sel->SelectOperands(ins); }
 
+    void visitInstVMLr(qir::InstVMLr *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVMSc(qir::InstVMSc *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVMAtomic(qir::InstVMAtomic *ins)
+    {
+        sel->SelectOperands(ins);
+    }
+
+    void visitInstFUnop(qir::InstFUnop *ins) { sel->SelectOperands(ins); }
+
+    void visitInstFBinop(qir::InstFBinop *ins) { sel->SelectOperands(ins); }
+
+    void visitInstFCmp(qir::InstFCmp *ins) { sel->SelectOperands(ins); }
+
+    void visitInstFCvtFI(qir::InstFCvtFI *ins) { sel->SelectOperands(ins); }
+
+    void visitInstFCvtIF(qir::InstFCvtIF *ins) { sel->SelectOperands(ins); }
+
+    void visitInstFMov(qir::InstFMov *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVMFLoad(qir::InstVMFLoad *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVMFStore(qir::InstVMFStore *ins)
+    {
+        sel->SelectOperands(ins);
+    }
+
+    void visitInstVecLoad(qir::InstVecLoad *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVecStore(qir::InstVecStore *ins) { sel->SelectOperands(ins); }
+
+    void visitInstVecBinop(qir::InstVecBinop *ins) { sel->SelectOperands(ins); }
+
+    void visitInstICount(UNUSED qir::InstICount *ins) {}
+
+    void visitInstRdtsc(qir::InstRdtsc *ins) { sel->SelectOperands(ins); }
+
     void visitInstHcall(UNUSED qir::InstHcall *ins) {}
 
     void visit_sll(qir::InstBinop *ins) { sel->SelectOperands(ins); }
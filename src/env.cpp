@@ -14,6 +14,8 @@
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cfenv>
 #include <cstring>
 #include <ctime>
 #include <vector>
@@ -23,6 +25,7 @@
 #include "mmu.h"
 
 #include "syscalls.h"
+#include "util/hostclock.h"
 
 namespace dbt
 {
@@ -33,6 +36,8 @@ struct env::ElfImage {
     uabi_ulong entry; /* The address where the program's execution begins */
     uabi_ulong brk;   /* The initial value for the heap end address, associated
                          with the `brk` system call for memory allocation. */
+    std::vector<std::pair<u32, u32>> exec_segs; /* PF_X segments */
+    std::vector<u32> code_roots; /* entry and STT_FUNC symbols */
 };
 env::ElfImage env::exe_elf_image{};
 
@@ -71,14 +76,22 @@ void env::InitThread(CPUState *state, ElfImage *elf)
     assert(!(elf->stack_start & 15));
     state->gpr[2] = elf->stack_start;
     state->ip = elf->entry;
+    // Guest fflags are accrued in host MXCSR, frm is RNE
+    feclearexcept(FE_ALL_EXCEPT);
+    fesetround(FE_TONEAREST);
 }
 
-static void dbt_sigaction_memory(UNUSED int signo,
+static void dbt_sigaction_memory(int signo,
                                  siginfo_t *sinfo,
                                  UNUSED void *uctx_raw)
 {
     if (!mmu::check_h2g(sinfo->si_addr))
         Panic("Memory fault in host address space");
+    // Store to translated code, the faulting access is restarted
+    if (signo == SIGSEGV && sinfo->si_code == SEGV_ACCERR &&
+        HandleCodeWriteFault(mmu::h2g(sinfo->si_addr))) {
+        return;
+    }
     Panic("Memory fault in guest address space.");
 }
 
@@ -200,8 +213,16 @@ static uabi_long linux_llseek(uabi_uint fd,
     return 0;
 }
 
+// The kernel fails with EFAULT instead of faulting on stores to protected code
+// pages, translations of output buffers are dropped before the host syscall
+static inline void InvalidateOutputBuffer(void *buf, size_t len)
+{
+    InvalidateCodeRange(mmu::h2g(buf), len);
+}
+
 static uabi_long linux_read(uabi_uint fd, char *buf, uabi_size_t count)
 {
+    InvalidateOutputBuffer(buf, count);
     return rcerrno(read(fd, buf, count));
 }
 
@@ -222,6 +243,7 @@ static uabi_long linux_readlinkat(uabi_int dfd,
     } else {
         pathbuf[0] = 0;
     }
+    InvalidateOutputBuffer(buf, std::max(bufsiz, 0));
     return rcerrno(readlinkat(dfd, pathbuf, buf, bufsiz));
 }
 
@@ -230,6 +252,7 @@ using uabi_stat64 = struct stat;
 static uabi_long linux_fstat64(uabi_uint fd, uabi_stat64 *statbuf)
 {
     // TODO: verify!!!
+    InvalidateOutputBuffer(statbuf, sizeof(*statbuf));
     return rcerrno(fstatat(fd, "", statbuf, 0));
 }
 
@@ -266,6 +289,7 @@ using uabi_new_utsname = struct utsname;
 
 static uabi_long linux_uname(uabi_new_utsname *name)
 {
+    InvalidateOutputBuffer(name, sizeof(*name));
     uabi_long rc = uname(name);
     strcpy(name->machine, "riscv32");
     return rcerrno(rc);
@@ -352,8 +376,8 @@ static uabi_long linux_brk(uabi_ulong newbrk)
 
 static uabi_long linux_munmap(uabi_ulong gaddr, uabi_size_t len)
 {
-    // TODO: implement in mmu
-    return rcerrno(munmap(mmu::g2h(gaddr), len));
+    InvalidateCodeRange(gaddr, len);
+    return rcerrno(mmu::munmap(gaddr, len));
 }
 
 static uabi_long linux_mmap2(uabi_ulong gaddr,
@@ -364,6 +388,8 @@ static uabi_long linux_mmap2(uabi_ulong gaddr,
                              uabi_ulong off)
 {
     // TODO: file maps in mmu
+    if (flags & MAP_FIXED)
+        InvalidateCodeRange(gaddr, len);
     void *ret = mmu::mmap(gaddr, len, prot, flags, fd, off);
     if (ret == MAP_FAILED)
         return (uabi_long) -errno;
@@ -375,8 +401,16 @@ static uabi_long linux_mprotect(uabi_ulong start,
                                 uabi_size_t len,
                                 uabi_ulong prot)
 {
-    // TODO: implement in mmu
-    return rcerrno(mprotect(mmu::g2h(start), len, prot));
+    InvalidateCodeRange(start, len);
+    return rcerrno(mmu::mprotect(start, len, prot));
+}
+
+// Stores to translated code are caught by write faults, nothing left to flush
+static uabi_long linux_riscv_flush_icache(UNUSED uabi_ulong start,
+                                         UNUSED uabi_ulong end,
+                                         UNUSED uabi_ulong flags)
+{
+    return 0;
 }
 
 using uabi_pid_t = uabi_int;
@@ -415,6 +449,7 @@ static uabi_long linux_prlimit64(uabi_pid_t pid,
 
 static uabi_long linux_getrandom(char *buf, uabi_size_t count, uabi_uint flags)
 {
+    InvalidateOutputBuffer(buf, count);
     return rcerrno(getrandom(buf, count, flags));
 }
 
@@ -433,6 +468,7 @@ static uabi_long linux_statx(uabi_int dfd,
     } else {
         pathbuf[0] = 0;
     }
+    InvalidateOutputBuffer(buffer, sizeof(*buffer));
     return rcerrno(statx(dfd, pathbuf, flags, mask, buffer));
 }
 
@@ -446,10 +482,19 @@ struct uabi__kernel_timespec {
  * It appears that newlib is using millisecond resolution for time manipulation,
  * while clock_gettime expects nanoseconds in the timespec struct.
  * Further investigations are needed.
+ * CLOCK_MONOTONIC is passed through, the time CSR counts in its timebase.
  */
-static uabi_long linux_clock_gettime64(UNUSED clockid_t which_clock,
+static uabi_long linux_clock_gettime64(clockid_t which_clock,
                                        uabi__kernel_timespec *ktp)
 {
+    if (which_clock == CLOCK_MONOTONIC) {
+        timespec ts;
+        if (uabi_long rc = rcerrno(clock_gettime(CLOCK_MONOTONIC, &ts)))
+            return rc;
+        ktp->tv_sec = ts.tv_sec;
+        ktp->tv_nsec = ts.tv_nsec;
+        return 0;
+    }
     clock_t t = clock();
     ktp->tv_sec = t / CLOCKS_PER_SEC;
     ktp->tv_nsec = (t % CLOCKS_PER_SEC) * (1e3 / CLOCKS_PER_SEC);
@@ -467,6 +512,8 @@ void env::SyscallLinux(CPUState *state)
         (uabi_long) state->gpr[14], (uabi_long) state->gpr[15],
         (uabi_long) state->gpr[16]};
     uabi_long syscallno = state->gpr[17];
+    // Syscalls are frequent enough to keep the time CSR anchored
+    HostClock::UpdateIfUsed();
 
     auto do_syscall = [&args]<typename RV, typename... Args>(RV (*h)(Args...)) {
         static_assert(sizeof...(Args) <= args.size());
@@ -511,6 +558,7 @@ void env::SyscallLinux(CPUState *state)
             HANDLE(linux_munmap)
             HANDLE(linux_mmap2)
             HANDLE(linux_mprotect)
+            HANDLE(linux_riscv_flush_icache)
             HANDLE(linux_prlimit64)
             HANDLE(linux_getrandom)
             HANDLE(linux_statx)
@@ -551,8 +599,8 @@ void env::BootElf(const char *path, ElfImage *elf)
     elf->stack_start = mmu::h2g(stk_ptr) + stk_size;
 }
 
-// -march=rv32i -O2 -fpic -fpie -static
-// -march=rv32i -O2 -fpic -fpie -static -ffreestanding -nostartfiles -nolibc
+// -march=rv32imafdc -O2 -fpic -fpie -static
+// -march=rv32imafdc -O2 -fpic -fpie -static -ffreestanding -nostartfiles -nolibc
 void env::LoadElf(int fd, ElfImage *elf)
 {
     auto &ehdr = elf->ehdr;
@@ -576,6 +624,7 @@ void env::LoadElf(int fd, ElfImage *elf)
     elf->load_addr = -1;
     elf->brk = 0;
     elf->entry = elf->ehdr.e_entry;
+    elf->exec_segs.clear();
 
     for (size_t i = 0; i < ehdr.e_phnum; ++i) {
         auto *phdr = &phtab[i];
@@ -616,9 +665,49 @@ void env::LoadElf(int fd, ElfImage *elf)
             mmu::mmap(vaddr_ps, len, prot, MAP_FIXED | MAP_PRIVATE | MAP_ANON);
         }
 
+        if ((phdr->p_flags & PF_X) && phdr->p_memsz)
+            elf->exec_segs.push_back({vaddr, vaddr + phdr->p_memsz});
         elf->load_addr = std::min(elf->load_addr, vaddr - phdr->p_offset);
         elf->brk = std::max(elf->brk, vaddr + phdr->p_memsz);
     }
+    LoadCodeRoots(fd, elf);
+}
+
+// Function symbols are optional, stripped images give the entry only
+void env::LoadCodeRoots(int fd, ElfImage *elf)
+{
+    auto &ehdr = elf->ehdr;
+    elf->code_roots.assign({elf->entry});
+    if (ehdr.e_shentsize != sizeof(Elf32_Shdr))
+        return;
+
+    std::vector<Elf32_Shdr> shtab(ehdr.e_shnum);
+    ssize_t shtab_sz = sizeof(Elf32_Shdr) * ehdr.e_shnum;
+    if (pread(fd, shtab.data(), shtab_sz, ehdr.e_shoff) != shtab_sz)
+        return;
+
+    for (auto const &shdr : shtab) {
+        if (shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize != sizeof(Elf32_Sym))
+            continue;
+        std::vector<Elf32_Sym> syms(shdr.sh_size / sizeof(Elf32_Sym));
+        ssize_t syms_sz = sizeof(Elf32_Sym) * syms.size();
+        if (pread(fd, syms.data(), syms_sz, shdr.sh_offset) != syms_sz)
+            continue;
+        for (auto const &sym : syms) {
+            if (ELF32_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_value)
+                elf->code_roots.push_back(sym.st_value);
+        }
+    }
+}
+
+std::span<std::pair<u32, u32> const> env::ExecSegments(ElfImage *elf)
+{
+    return elf->exec_segs;
+}
+
+std::span<u32 const> env::CodeRoots(ElfImage *elf)
+{
+    return elf->code_roots;
 }
 
 static uabi_ulong AllocArgVectorStr(uabi_ulong stk, void const *str, u16 sz)
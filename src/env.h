@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 #include "guest/rv32_cpu.h"
 
 namespace dbt
@@ -24,6 +26,11 @@ struct env {
     static void InitThread(CPUState *state, ElfImage *elf);
     static void InitSignals(CPUState *state);
 
+    // [begin, end) guest ranges of PF_X segments
+    static std::span<std::pair<u32, u32> const> ExecSegments(ElfImage *elf);
+    // Known guest code addresses, for ahead-of-time translation
+    static std::span<u32 const> CodeRoots(ElfImage *elf);
+
     int Execute(CPUState *state);
 
     void SyscallLinux(CPUState *state);
@@ -33,6 +40,7 @@ struct env {
 
 private:
     static void LoadElf(int elf_fd, ElfImage *elf);
+    static void LoadCodeRoots(int elf_fd, ElfImage *elf);
 };
 
 }  // namespace dbt
@@ -1,12 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include "execute.h"
 #include "codegen/jitabi.h"
 #include "guest/rv32_cpu.h"
+#include "guest/rv32_discover.h"
+#include "guest/rv32_interp.h"
 #include "guest/rv32_ops.h"
 #include "ir/compile.h"
+#include "pcache.h"
 
 namespace dbt
 {
-sigjmp_buf trap_unwind_env;
+thread_local sigjmp_buf trap_unwind_env;
 
 static inline bool HandleTrap(CPUState *state)
 {
@@ -17,32 +24,208 @@ static inline bool HandleTrap(CPUState *state)
 struct JITCompilerRuntime final : CompilerRuntime {
     void *AllocateCode(size_t sz, uint align) override
     {
-        return tcache::AllocateCode(sz, align);
+        region_tb = tcache::AllocateTBlock(sz, align);
+        return region_tb ? region_tb->tcode.ptr : nullptr;
     }
 
-    bool AllowsRelocation() const override { return false; }
+    bool AllowsRelocation() const override { return pcache::IsEnabled(); }
+
+    // Stores to the pages after this point fault and bump CodeWriteCount
+    void BeginRegion(std::span<IpRange const> ipranges) override
+    {
+        code_write_count = mmu::CodeWriteCount();
+        for (auto const &range : ipranges) {
+            mmu::ProtectCode(rounddown(range.first, mmu::PAGE_SIZE));
+            mmu::ProtectCode(CodeLastPage(range.first));
+        }
+    }
 
-    void *AnnounceRegion(u32 ip, std::span<u8> const &code) override
+    void *AnnounceRegion(u32 ip,
+                         std::span<u8> const &code,
+                         std::span<IpRange const> ipranges,
+                         RegionRelocs const *relocs) override
     {
-        // TODO: concurrent tcache
-        auto tb = tcache::AllocateTBlock();
-        if (tb == nullptr)
-            Panic();
+        auto tb = region_tb;
         tb->ip = ip;
         tb->tcode = TBlock::TCode{code.data(), code.size()};
-        tcache::Insert(tb);
+        // Later writes to the pages reach pcache::InvalidatePage
+        if (relocs && code_write_count == mmu::CodeWriteCount())
+            pcache::Record(ip, code, ipranges, *relocs);
+        if (auto *indexed = tcache::Insert(tb); indexed != tb)
+            return (void *) indexed;
+
+        u32 entry_page = rounddown(ip, mmu::PAGE_SIZE);
+        for (auto const &range : ipranges) {
+            u32 page = rounddown(range.first, mmu::PAGE_SIZE);
+            if (page != entry_page)
+                tcache::AddPageDependency(tb, page);
+            u32 last = CodeLastPage(range.first);
+            if (last != page && last != entry_page)
+                tcache::AddPageDependency(tb, last);
+        }
+
+        // Guest code was modified during translation, a racing write fault
+        // may have missed the region
+        if (unlikely(code_write_count != mmu::CodeWriteCount())) {
+            for (auto const &range : ipranges) {
+                tcache::InvalidatePage(rounddown(range.first, mmu::PAGE_SIZE));
+                tcache::InvalidatePage(CodeLastPage(range.first));
+            }
+        }
         return (void *) tb;
     }
+
+private:
+    static thread_local u32 code_write_count;
+    static thread_local TBlock *region_tb;  // from AllocateCode
 };
 
-static inline IpRange GetCompilationIPRange(u32 ip)
+thread_local u32 JITCompilerRuntime::code_write_count;
+thread_local TBlock *JITCompilerRuntime::region_tb;
+
+static JITCompilerRuntime jit_runtime{};
+
+// Translation ranges never cross a page, region entries may
+static inline IpRange GetCompilationIPRange(u32 ip,
+                                            std::vector<u32> const &entries)
 {
-    u32 upper = roundup(ip, mmu::PAGE_SIZE);
+    u32 upper = rounddown(ip, mmu::PAGE_SIZE) + mmu::PAGE_SIZE;
     if (auto *tb_upper = tcache::LookupUpperBound(ip))
         upper = std::min(upper, tb_upper->ip);
+    for (auto e : entries) {
+        if (e > ip)
+            upper = std::min(upper, e);
+    }
     return {ip, upper};
 }
 
+// Stitch blocks along the hottest successors recorded by the interpreter
+// tier, closed loops become intra-region branches
+static constexpr u32 REGION_MAX_ENTRIES = 16;
+
+static inline std::vector<u32> FormRegionEntries(u32 ip)
+{
+    std::vector<u32> entries{ip};
+    u32 succ;
+    while (entries.size() < REGION_MAX_ENTRIES &&
+           rv32::InterpTier::GetHotSuccessor(entries.back(), &succ)) {
+        if (std::find(entries.begin(), entries.end(), succ) != entries.end())
+            break;
+        if (tcache::Lookup(succ))
+            break;
+        entries.push_back(succ);
+    }
+    return entries;
+}
+
+static inline qir::CompilerJob
+MakeCompilerJob(qir::CompilerJob::IpRangesSet &&ipranges)
+{
+    u32 gip_page = rounddown(ipranges[0].first, mmu::PAGE_SIZE);
+    return qir::CompilerJob(&jit_runtime, (uptr) mmu::base,
+                            qir::CodeSegment(gip_page, mmu::PAGE_SIZE),
+                            std::move(ipranges));
+}
+
+static inline qir::CompilerJob MakeCompilerJob(u32 ip)
+{
+    auto entries = FormRegionEntries(ip);
+    qir::CompilerJob::IpRangesSet ipranges;
+    for (auto e : entries)
+        ipranges.push_back(GetCompilationIPRange(e, entries));
+    return MakeCompilerJob(std::move(ipranges));
+}
+
+TBlock *TryCompileInPlace(u32 ip)
+{
+    if (qir::CompilerPool::IsActive() || !rv32::InterpTier::IsHot(ip))
+        return nullptr;
+    auto job = MakeCompilerJob(ip);
+    return (TBlock *) qir::CompilerDoJob(job);
+}
+
+void CompileAhead(std::span<IpRange const> segs,
+                  std::span<u32 const> roots,
+                  u32 n_threads)
+{
+    auto entries = rv32::CodeDiscovery::Run(segs, roots);
+    std::atomic<size_t> next{0};
+
+    // Single range regions, cut at the next entry like GetCompilationIPRange
+    // does with tcache. Blocks loaded from pcache are kept
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < entries.size()) {
+            u32 ip = entries[i];
+            if (tcache::Lookup(ip))
+                continue;
+            u32 upper = rounddown(ip, mmu::PAGE_SIZE) + mmu::PAGE_SIZE;
+            if (i + 1 < entries.size())
+                upper = std::min(upper, entries[i + 1]);
+            auto job = MakeCompilerJob({{ip, upper}});
+            // Code cache is full, the rest is left to Execute
+            if (!qir::CompilerDoJob(job))
+                next = entries.size();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (u32 n = 1; n < n_threads; ++n)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+}
+
+bool InvalidateCode(u32 pvaddr)
+{
+    if (!mmu::UnprotectCode(pvaddr))
+        return false;
+    tcache::InvalidatePage(pvaddr);
+    rv32::InterpTier::InvalidatePage(pvaddr);
+    pcache::InvalidatePage(pvaddr);
+    return true;
+}
+
+void InvalidateCodeRange(u32 vaddr, u32 len)
+{
+    u64 end = (u64) vaddr + len;
+    for (u64 p = rounddown(vaddr, mmu::PAGE_SIZE); p < end; p += mmu::PAGE_SIZE)
+        InvalidateCode(p);
+}
+
+u32 CodeLastPage(u32 ip)
+{
+    u32 page = rounddown(ip, mmu::PAGE_SIZE);
+    u32 next = page + mmu::PAGE_SIZE;
+    if (next == 0)
+        return page;
+    auto last_half = *(u16 *) mmu::g2h(next - sizeof(u16));
+    return rv32::insn::Length(last_half) == 4 ? next : page;
+}
+
+bool HandleCodeWriteFault(u32 gaddr)
+{
+    // Last store restarted without unprotecting, and CodeWriteCount then
+    static thread_local u32 retried_gaddr = -1;
+    static thread_local u32 retried_count;
+
+    u32 page = rounddown(gaddr, mmu::PAGE_SIZE);
+    if (!mmu::IsGuestWritable(page))
+        return false;
+    if (InvalidateCode(page))
+        return true;
+    // Another thread may have dropped the protection after the fault, the
+    // store is restarted. Faulting again with no code pages unprotected in
+    // the meantime means another cause
+    u32 count = mmu::CodeWriteCount();
+    if (retried_gaddr == gaddr && retried_count == count)
+        return false;
+    retried_gaddr = gaddr;
+    retried_count = count;
+    return true;
+}
+
 void Execute(CPUState *state)
 {
     sigsetjmp(dbt::trap_unwind_env, 0);
@@ -54,24 +237,42 @@ void Execute(CPUState *state)
         assert(state->gpr[0] == 0);
         assert(!branch_slot || branch_slot->gip == state->ip);
 
+        if (unlikely(tcache::IsEvictionPending())) {
+            tcache::EvictPending();
+            branch_slot = nullptr;  // may point to evicted code
+        }
+
         TBlock *tb = tcache::Lookup(state->ip);
         if (tb == nullptr) {
-            auto jrt = JITCompilerRuntime();
-            u32 gip_page = rounddown(state->ip, mmu::PAGE_SIZE);
-            qir::CompilerJob job(&jrt, (uptr) mmu::base,
-                                 qir::CodeSegment(gip_page, mmu::PAGE_SIZE),
-                                 {GetCompilationIPRange(state->ip)});
+            if (rv32::InterpTier::ExecuteIfCold(state, mmu::base)) {
+                branch_slot = nullptr;
+                continue;
+            }
+            auto job = MakeCompilerJob(state->ip);
+            if (qir::CompilerPool::IsActive()) {
+                // Make progress in interpreter while the region compiles
+                qir::CompilerPool::Enqueue(std::move(job));
+                rv32::InterpTier::Execute(state, mmu::base);
+                branch_slot = nullptr;
+                continue;
+            }
             tb = (TBlock *) qir::CompilerDoJob(job);
+            if (tb == nullptr) {  // code cache is full until eviction
+                rv32::InterpTier::Execute(state, mmu::base);
+                branch_slot = nullptr;
+                continue;
+            }
         }
 
         if (branch_slot) {
-            branch_slot->Link(tb->tcode.ptr);
-            tcache::RecordLink(branch_slot, tb,
-                               branch_slot->flags.cross_segment);
+            tcache::LinkBranch(branch_slot, tb);
         } else {
             tcache::CacheBrind(tb);
         }
 
+        if (unlikely(state->ras_flush_count != tcache::FlushCount()))
+            state->ResetRAS();
+        tcache::CountEvent(&tcache::ThreadCounters::dispatches);
         branch_slot =
             jitabi::trampoline_to_jit(state, mmu::base, tb->tcode.ptr);
     }
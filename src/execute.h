@@ -1,12 +1,15 @@
 #pragma once
 
 #include <csetjmp>
+#include <span>
 
 #include "guest/rv32_cpu.h"
+#include "ir/compile.h"
 
 namespace dbt
 {
-extern sigjmp_buf trap_unwind_env;
+// Set by Execute in each guest thread, compiler threads never raise traps
+extern thread_local sigjmp_buf trap_unwind_env;
 
 ALWAYS_INLINE void RaiseTrap()
 {
@@ -15,4 +18,24 @@ ALWAYS_INLINE void RaiseTrap()
 
 void Execute(CPUState *state);
 
+// Compile region at ip in the calling thread if Execute would do so, also
+// called from link stubs. Returns nullptr if it's left to Execute
+TBlock *TryCompileInPlace(u32 ip);
+
+// Translate code statically reachable from roots in segs before the guest
+// starts, using n_threads. Execute still picks up the rest
+void CompileAhead(std::span<IpRange const> segs,
+                  std::span<u32 const> roots,
+                  u32 n_threads);
+
+// Self-modifying code: drops translations of the code page at pvaddr and
+// unprotects it. Returns false if the page was not protected as code
+bool InvalidateCode(u32 pvaddr);
+void InvalidateCodeRange(u32 vaddr, u32 len);
+// Page of the last code byte fetched for the code page of ip, the next page
+// if a 32-bit instruction may start in the last halfword
+u32 CodeLastPage(u32 ip);
+// Returns false if the write fault at gaddr is a guest one
+bool HandleCodeWriteFault(u32 gaddr);
+
 }  // namespace dbt
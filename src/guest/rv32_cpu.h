@@ -2,7 +2,7 @@
 
 #include <array>
 
-#include "guest/rv32_ops.h"
+#include "guest/rv32_insn.h"
 #include "runtime_stubs.h"
 #include "tcache.h"
 #include "util/common.h"
@@ -22,6 +22,21 @@ enum class TrapCode : u32 {
 struct CPUStateImpl {
     bool IsTrapPending() { return trapno == TrapCode::NONE; }
 
+    void ResetRAS()
+    {
+        ras_gip.fill(tcache::BrindCacheEntry::GIP_EMPTY);
+        ras_top = 0;
+        ras_flush_count = tcache::FlushCount();
+    }
+
+    static constexpr std::array<u8, 64> MakeVTailMask()
+    {
+        std::array<u8, 64> m{};
+        for (u32 i = 32; i < m.size(); ++i)
+            m[i] = 0xff;
+        return m;
+    }
+
     using gpr_t = u32;
     static constexpr u8 gpr_num = 32; /* general-purpose registers numbers */
 
@@ -29,10 +44,52 @@ struct CPUStateImpl {
     gpr_t ip{};
     TrapCode trapno{};
 
+    using fpr_t = u64;
+    static constexpr u8 fpr_num = 32;
+
+    // Single-precision values are NaN-boxed
+    std::array<fpr_t, fpr_num> fpr{};
+    // fcsr, host MXCSR holds exception flags raised since the last access and
+    // follows frm, see rv32_interp.cpp
+    u32 fflags{};
+    u32 frm{};
+
+    // RVV, register groups are adjacent in vreg. VLEN is fixed, JIT maps
+    // groups of 128 and 256 bits to xmm and ymm registers
+    static constexpr u32 VLEN = 128;
+    static constexpr u32 VLENB = VLEN / 8;
+    static constexpr u8 vreg_num = 32;
+    using vreg_t = std::array<u8, VLENB>;
+
+    alignas(32) std::array<vreg_t, vreg_num> vreg{};
+    u32 vl{};
+    u32 vtype{insn::VTYPE::VILL};
+    u32 vstart{};
+    // Loaded at offset 32 - nbytes, gives a mask of bytes past nbytes in
+    // vector registers, used by JIT to keep tail elements undisturbed
+    alignas(32) std::array<u8, 64> vtail_mask{MakeVTailMask()};
+
     tcache::L1BrindCache *l1_brind_cache{&tcache::l1_brind_cache};
+    u8 *tcode_base{tcache::CodeBase()};  // for relocatable regions
+
+    // Return address stack, pushed by calls and checked by returns in JIT
+    // code. ras_host holds continuation BranchSlots in caller regions
+    static constexpr u32 RAS_SIZE = 32;
+    std::array<u32, RAS_SIZE> ras_gip{};
+    std::array<void *, RAS_SIZE> ras_host{};
+    u32 ras_top{};
+    u32 ras_flush_count{(u32) -1};  // ras is reset on mismatch with tcache
     RuntimeStubTab stub_tab{};
 
+    // LR/SC reservation, SC succeeds if the reserved word is unchanged
+    u32 lr_addr{(u32) -1};
+    u32 lr_val{};
+
+    // Retired instructions, exact at range exits and counter CSR reads
+    u64 instret{};
+
     uptr sp_unwindptr{};
+    u32 pinned_scratch{};  // backs unused pinned register slots
 };
 
 // qmc config, also used to synchronize JIT debug tracing
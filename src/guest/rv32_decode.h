@@ -1,6 +1,7 @@
 #pragma once
 
 #include "guest/rv32_insn.h"
+#include "guest/rv32_rvc.h"
 
 namespace dbt::rv32::insn
 {
@@ -8,9 +9,10 @@ template <typename Provider>
 struct Decoder {
     using DType = decltype(Provider::_illegal);
 
-    static DType Decode(void *insn)
+    // Takes instruction returned by Fetch()
+    static DType Decode(u32 raw)
     {
-        auto in = *reinterpret_cast<DecodeParams *>(insn);
+        DecodeParams in{{DecodeRaw(raw)}};
 #define OP(name) return Provider::_##name;
 #define OP_ILLEGAL OP(illegal)
 
@@ -86,13 +88,51 @@ struct Decoder {
             case 0b111:
                 OP(andi);
             case 0b001:
-                OP(slli);
+                switch (in.funct7()) {
+                case 0b0000000:
+                    OP(slli);
+                case 0b0100100:
+                    OP(bclri);
+                case 0b0010100:
+                    OP(bseti);
+                case 0b0110100:
+                    OP(binvi);
+                case 0b0110000:
+                    switch (in.rs2()) {
+                    case 0b00000:
+                        OP(clz);
+                    case 0b00001:
+                        OP(ctz);
+                    case 0b00010:
+                        OP(cpop);
+                    case 0b00100:
+                        OP(sextb);
+                    case 0b00101:
+                        OP(sexth);
+                    default:
+                        OP_ILLEGAL;
+                    }
+                default:
+                    OP_ILLEGAL;
+                }
             case 0b101:
                 switch (in.funct7()) {
                 case 0b0000000:
                     OP(srli);
                 case 0b0100000:
                     OP(srai);
+                case 0b0110000:
+                    OP(rori);
+                case 0b0100100:
+                    OP(bexti);
+                case 0b0010100:
+                    if (in.rs2() != 0b00111)
+                        OP_ILLEGAL;
+                    OP(orcb);
+                case 0b0110100:
+                    if (in.rs2() != 0b11000)
+                        OP_ILLEGAL;
+                    OP(rev8);
                 default:
                     OP_ILLEGAL;
                 }
@@ -100,16 +140,106 @@ struct Decoder {
                 OP_ILLEGAL;
             }
         case 0b0110011: /* r-type arithm */
-            switch (in.funct3()) {
-            case 0b000:
-                switch (in.funct7()) {
-                case 0b0000000:
-                    OP(add);
-                case 0b0100000:
+            if (in.funct7() == 0b0000001) { /* RV32M */
+                switch (in.funct3()) {
+                case 0b000:
+                    OP(mul);
+                case 0b001:
+                    OP(mulh);
+                case 0b010:
+                    OP(mulhsu);
+                case 0b011:
+                    OP(mulhu);
+                case 0b100:
+                    OP(div);
+                case 0b101:
+                    OP(divu);
+                case 0b110:
+                    OP(rem);
+                case 0b111:
+                    OP(remu);
+                }
+            }
+            switch (in.funct7()) { /* Zba, Zbb, Zbs */
+            case 0b0000000:
+            case 0b0100000:
+                break;
+            case 0b0010000:
+                switch (in.funct3()) {
+                case 0b010:
+                    OP(sh1add);
+                case 0b100:
+                    OP(sh2add);
+                case 0b110:
+                    OP(sh3add);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b0000101:
+                switch (in.funct3()) {
+                case 0b100:
+                    OP(min);
+                case 0b101:
+                    OP(minu);
+                case 0b110:
+                    OP(max);
+                case 0b111:
+                    OP(maxu);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b0110000:
+                switch (in.funct3()) {
+                case 0b001:
+                    OP(rol);
+                case 0b101:
+                    OP(ror);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b0000100:
+                if (in.funct3() != 0b100 || in.rs2())
+                    OP_ILLEGAL;
+                OP(zexth);
+            case 0b0100100:
+                switch (in.funct3()) {
+                case 0b001:
+                    OP(bclr);
+                case 0b101:
+                    OP(bext);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b0010100:
+                if (in.funct3() != 0b001)
+                    OP_ILLEGAL;
+                OP(bset);
+            case 0b0110100:
+                if (in.funct3() != 0b001)
+                    OP_ILLEGAL;
+                OP(binv);
+            default:
+                OP_ILLEGAL;
+            }
+            if (in.funct7() == 0b0100000) {
+                switch (in.funct3()) {
+                case 0b000:
                     OP(sub);
+                case 0b101:
+                    OP(sra);
+                case 0b100:
+                    OP(xnor);
+                case 0b110:
+                    OP(orn);
+                case 0b111:
+                    OP(andn);
                 default:
                     OP_ILLEGAL;
                 }
+            }
+            switch (in.funct3()) {
+            case 0b000:
+                OP(add);
             case 0b001:
                 OP(sll);
             case 0b010:
@@ -119,14 +249,7 @@ struct Decoder {
             case 0b100:
                 OP(xor);
             case 0b101:
-                switch (in.funct7()) {
-                case 0b0000000:
-                    OP(srl);
-                case 0b0100000:
-                    OP(sra);
-                default:
-                    OP_ILLEGAL;
-                }
+                OP(srl);
             case 0b110:
                 OP(or);
             case 0b111:
@@ -134,6 +257,295 @@ struct Decoder {
             default:
                 OP_ILLEGAL;
             }
+        case 0b0101111: /* RV32A */
+            if (in.funct3() != 0b010)
+                OP_ILLEGAL;
+            switch (in.funct5()) {
+            case 0b00010:
+                if (in.rs2())
+                    OP_ILLEGAL;
+                OP(lrw);
+            case 0b00011:
+                OP(scw);
+            case 0b00001:
+                OP(amoswapw);
+            case 0b00000:
+                OP(amoaddw);
+            case 0b00100:
+                OP(amoxorw);
+            case 0b01100:
+                OP(amoandw);
+            case 0b01000:
+                OP(amoorw);
+            case 0b10000:
+                OP(amominw);
+            case 0b10100:
+                OP(amomaxw);
+            case 0b11000:
+                OP(amominuw);
+            case 0b11100:
+                OP(amomaxuw);
+            default:
+                OP_ILLEGAL;
+            }
+#define OP_VLS(name)             \
+    if (in.funct6() || in.rs2()) \
+        OP_ILLEGAL;              \
+    OP(name);
+        case 0b0000111: /* flX, vleX */
+            switch (in.funct3()) {
+            case 0b010:
+                OP(flw);
+            case 0b011:
+                OP(fld);
+            case 0b000:
+                OP_VLS(vle8v);
+            case 0b101:
+                OP_VLS(vle16v);
+            case 0b110:
+                OP_VLS(vle32v);
+            default:
+                OP_ILLEGAL;
+            }
+        case 0b0100111: /* fsX, vseX */
+            switch (in.funct3()) {
+            case 0b010:
+                OP(fsw);
+            case 0b011:
+                OP(fsd);
+            case 0b000:
+                OP_VLS(vse8v);
+            case 0b101:
+                OP_VLS(vse16v);
+            case 0b110:
+                OP_VLS(vse32v);
+            default:
+                OP_ILLEGAL;
+            }
+#undef OP_VLS
+        case 0b1010111: /* RVV */
+            switch (in.funct3()) {
+            case 0b111: /* OPCFG */
+                if (!(in.raw >> 31))
+                    OP(vsetvli);
+                if ((in.raw >> 30) == 0b11)
+                    OP(vsetivli);
+                if (in.funct7() == 0b1000000)
+                    OP(vsetvl);
+                OP_ILLEGAL;
+            case 0b000: /* OPIVV */
+                switch (in.funct6()) {
+                case 0b000000:
+                    OP(vaddvv);
+                case 0b000010:
+                    OP(vsubvv);
+                case 0b001001:
+                    OP(vandvv);
+                case 0b001010:
+                    OP(vorvv);
+                case 0b001011:
+                    OP(vxorvv);
+                case 0b010111:
+                    if (!in.vm() || in.rs2())
+                        OP_ILLEGAL;
+                    OP(vmvvv);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b100: /* OPIVX */
+                switch (in.funct6()) {
+                case 0b000000:
+                    OP(vaddvx);
+                case 0b000010:
+                    OP(vsubvx);
+                case 0b001001:
+                    OP(vandvx);
+                case 0b001010:
+                    OP(vorvx);
+                case 0b001011:
+                    OP(vxorvx);
+                case 0b010111:
+                    if (!in.vm() || in.rs2())
+                        OP_ILLEGAL;
+                    OP(vmvvx);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b011: /* OPIVI */
+                switch (in.funct6()) {
+                case 0b000000:
+                    OP(vaddvi);
+                case 0b001001:
+                    OP(vandvi);
+                case 0b001010:
+                    OP(vorvi);
+                case 0b001011:
+                    OP(vxorvi);
+                case 0b010111:
+                    if (!in.vm() || in.rs2())
+                        OP_ILLEGAL;
+                    OP(vmvvi);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b010: /* OPMVV */
+                switch (in.funct6()) {
+                case 0b000000:
+                    OP(vredsum);
+                case 0b100101:
+                    OP(vmulvv);
+                case 0b010000:
+                    if (!in.vm() || in.rs1())
+                        OP_ILLEGAL;
+                    OP(vmvxs);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b110: /* OPMVX */
+                switch (in.funct6()) {
+                case 0b100101:
+                    OP(vmulvx);
+                case 0b010000:
+                    if (!in.vm() || in.rs2())
+                        OP_ILLEGAL;
+                    OP(vmvsx);
+                default:
+                    OP_ILLEGAL;
+                }
+            default:
+                OP_ILLEGAL;
+            }
+#define OP_FP(name)  \
+    if (in.fmt())    \
+        OP(name##d); \
+    OP(name##s);
+        case 0b1000011:
+        case 0b1000111:
+        case 0b1001011:
+        case 0b1001111: /* fused multiply-add */
+            if (in.fmt() > 0b01 || !IsValidRM(in.funct3()))
+                OP_ILLEGAL;
+            switch (in.opcode()) {
+            case 0b1000011:
+                OP_FP(fmadd);
+            case 0b1000111:
+                OP_FP(fmsub);
+            case 0b1001011:
+                OP_FP(fnmsub);
+            default:
+                OP_FP(fnmadd);
+            }
+        case 0b1010011: /* RV32F/D */
+            if (in.fmt() > 0b01)
+                OP_ILLEGAL;
+            switch (in.funct5()) {
+            case 0b00000:
+            case 0b00001:
+            case 0b00010:
+            case 0b00011:
+            case 0b01011:
+            case 0b01000:
+            case 0b11000:
+            case 0b11010:
+                if (!IsValidRM(in.funct3()))
+                    OP_ILLEGAL;
+                break;
+            default:
+                break;
+            }
+            switch (in.funct5()) {
+            case 0b00000:
+                OP_FP(fadd);
+            case 0b00001:
+                OP_FP(fsub);
+            case 0b00010:
+                OP_FP(fmul);
+            case 0b00011:
+                OP_FP(fdiv);
+            case 0b01011:
+                if (in.rs2())
+                    OP_ILLEGAL;
+                OP_FP(fsqrt);
+            case 0b00100:
+                switch (in.funct3()) {
+                case 0b000:
+                    OP_FP(fsgnj);
+                case 0b001:
+                    OP_FP(fsgnjn);
+                case 0b010:
+                    OP_FP(fsgnjx);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b00101:
+                switch (in.funct3()) {
+                case 0b000:
+                    OP_FP(fmin);
+                case 0b001:
+                    OP_FP(fmax);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b01000:
+                if (in.fmt() == 0b00 && in.rs2() == 0b00001)
+                    OP(fcvtsd);
+                if (in.fmt() == 0b01 && in.rs2() == 0b00000)
+                    OP(fcvtds);
+                OP_ILLEGAL;
+            case 0b10100:
+                switch (in.funct3()) {
+                case 0b010:
+                    OP_FP(feq);
+                case 0b001:
+                    OP_FP(flt);
+                case 0b000:
+                    OP_FP(fle);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b11000:
+                switch (in.rs2()) {
+                case 0b00000:
+                    OP_FP(fcvtw);
+                case 0b00001:
+                    OP_FP(fcvtwu);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b11010:
+                switch (in.rs2()) {
+                case 0b00000:
+                    if (in.fmt())
+                        OP(fcvtdw);
+                    OP(fcvtsw);
+                case 0b00001:
+                    if (in.fmt())
+                        OP(fcvtdwu);
+                    OP(fcvtswu);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b11100:
+                if (in.rs2())
+                    OP_ILLEGAL;
+                switch (in.funct3()) {
+                case 0b000:
+                    if (in.fmt())
+                        OP_ILLEGAL;
+                    OP(fmvxw);
+                case 0b001:
+                    OP_FP(fclass);
+                default:
+                    OP_ILLEGAL;
+                }
+            case 0b11110:
+                if (in.fmt() || in.rs2() || in.funct3())
+                    OP_ILLEGAL;
+                OP(fmvwx);
+            default:
+                OP_ILLEGAL;
+            }
+#undef OP_FP
         case 0b0001111:
             switch (in.funct3()) {  // TODO: check other fields
             case 0b000:
@@ -144,8 +556,10 @@ struct Decoder {
                 OP_ILLEGAL;
             }
         case 0b1110011:
-            switch (in.funct3() | in.rd() | in.rs1()) {
-            case 0:
+            switch (in.funct3()) {
+            case 0b000:
+                if (in.rd() | in.rs1())
+                    OP_ILLEGAL;
                 switch (in.funct12()) {
                 case 0b000000000000:
                     OP(ecall);
@@ -154,8 +568,20 @@ struct Decoder {
                 default:
                     OP_ILLEGAL;
                 }
+            case 0b001:
+                OP(csrrw);
+            case 0b010:
+                OP(csrrs);
+            case 0b011:
+                OP(csrrc);
+            case 0b101:
+                OP(csrrwi);
+            case 0b110:
+                OP(csrrsi);
+            case 0b111:
+                OP(csrrci);
             default:
-                OP_ILLEGAL; /* csr* */
+                OP_ILLEGAL;
             }
 
         default:
@@ -170,10 +596,26 @@ private:
     struct DecodeParams : public Base {
         INSN_FIELD(funct3);
         INSN_FIELD(funct7);
+        INSN_FIELD(funct5);
         INSN_FIELD(funct12);
+        INSN_FIELD(fmt);
+        INSN_FIELD(funct6);
+        INSN_FIELD(vm);
         INSN_FIELD(rd)
         INSN_FIELD(rs1)
+        INSN_FIELD(rs2)
+
+    protected:
+        using _fmt = bf_range<u8, 25, 26>;
+        using _funct6 = bf_range<u8, 26, 31>;
+        using _vm = bf_range<u8, 25, 25>;
     };
+
+    // 0b101 and 0b110 are reserved
+    static constexpr bool IsValidRM(u8 rm)
+    {
+        return rm != 0b101 && rm != 0b110;
+    }
 };
 
 }  // namespace dbt::rv32::insn
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include "guest/rv32_cpu.h"
+#include "guest/rv32_decode.h"
+#include "guest/rv32_discover.h"
+#include "mmu.h"
+
+namespace dbt::rv32
+{
+struct ScanInfo {
+    insn::Op op;
+    u32 flags;
+};
+
+struct ScanProvider {
+#define OP(name, format_, flags_)                         \
+    static constexpr ScanInfo _##name{insn::Op::_##name, \
+                                      insn::Insn_##name::flags};
+    RV32_OPCODE_LIST()
+#undef OP
+};
+
+// Block boundaries follow RV32Translator::TranslateIPRange, so that every
+// entry pushed is one Execute would look up. Returns false if it's not code
+static bool ScanBlock(u32 ip, u32 seg_end, std::vector<u32> *succs)
+{
+    u32 page_end = rounddown(ip, mmu::PAGE_SIZE) + mmu::PAGE_SIZE;
+
+    for (u32 n = 0; n < TB_MAX_INSNS; ++n) {
+        if (ip >= page_end)
+            break;
+        u16 lo;
+        if (seg_end - ip < sizeof(lo))
+            return false;
+        memcpy(&lo, mmu::g2h(ip), sizeof(lo));
+        if (seg_end - ip < insn::Length(lo))
+            return false;
+
+        auto raw = insn::Fetch(mmu::g2h(ip));
+        auto info = insn::Decoder<ScanProvider>::Decode(raw);
+        u32 next = ip + insn::Length(raw);
+
+        switch (info.op) {
+        case insn::Op::_illegal:
+            return false;
+        case insn::Op::_jal: {
+            insn::Insn_jal i{raw};
+            succs->push_back(ip + i.imm());
+            if (i.rd())
+                succs->push_back(next);
+            return true;
+        }
+        case insn::Op::_jalr: {
+            insn::Insn_jalr i{raw};
+            if (i.rd())
+                succs->push_back(next);
+            return true;
+        }
+        case insn::Op::_beq:
+        case insn::Op::_bne:
+        case insn::Op::_blt:
+        case insn::Op::_bge:
+        case insn::Op::_bltu:
+        case insn::Op::_bgeu:
+            succs->push_back(ip + insn::B{raw}.imm());
+            succs->push_back(next);
+            return true;
+        case insn::Op::_ebreak:
+            return true;
+        default:
+            // fence.i and ecall resume at the next instruction
+            if (info.flags & (insn::Flags::Branch | insn::Flags::Trap)) {
+                succs->push_back(next);
+                return true;
+            }
+            break;
+        }
+        ip = next;
+    }
+    succs->push_back(ip);
+    return true;
+}
+
+std::vector<u32> CodeDiscovery::Run(std::span<IpRange const> segs,
+                                    std::span<u32 const> roots)
+{
+    auto seg_end = [&](u32 ip) -> u32 {
+        for (auto const &[beg, end] : segs) {
+            if (ip >= beg && ip < end)
+                return end;
+        }
+        return 0;
+    };
+
+    std::unordered_set<u32> visited;
+    std::vector<u32> worklist(roots.begin(), roots.end());
+    std::vector<u32> entries;
+    std::vector<u32> succs;
+
+    while (!worklist.empty()) {
+        u32 ip = worklist.back();
+        worklist.pop_back();
+        u32 end = seg_end(ip);
+        if (!end || ip % insn::IALIGN || !visited.insert(ip).second)
+            continue;
+        succs.clear();
+        if (!ScanBlock(ip, end, &succs))
+            continue;
+        entries.push_back(ip);
+        worklist.insert(worklist.end(), succs.begin(), succs.end());
+    }
+
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+}  // namespace dbt::rv32
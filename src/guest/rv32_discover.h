@@ -0,0 +1,19 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "ir/compile.h"
+
+namespace dbt::rv32
+{
+// Static code discovery for ahead-of-time translation
+struct CodeDiscovery {
+    // Sorted entries of blocks reachable from roots over direct branches,
+    // calls and fallthroughs within segs. Blocks running into an illegal
+    // instruction are taken for data and dropped
+    static std::vector<u32> Run(std::span<IpRange const> segs,
+                                std::span<u32 const> roots);
+};
+
+}  // namespace dbt::rv32
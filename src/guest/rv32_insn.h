@@ -18,6 +18,15 @@ enum Types : u32 {
 };
 }
 
+// Instruction size by its lowest halfword, 16-bit if RV32C
+ALWAYS_INLINE constexpr u8 Length(u32 raw)
+{
+    return (raw & 3) == 3 ? 4 : 2;
+}
+
+// Branch targets are halfword aligned with RV32C
+static constexpr u32 IALIGN = 2;
+
 #define INSN_FIELD(name) \
     ALWAYS_INLINE constexpr auto name() { return _##name::decode(raw); }
 #define INSN_FIELD_SC(name, scale)              \
@@ -38,6 +47,7 @@ protected:
     using _rs2 = bf_range<u8, 20, 24>;
     using _funct3 = bf_range<u8, 12, 14>;
     using _funct7 = bf_range<u8, 25, 31>;
+    using _funct5 = bf_range<u8, 27, 31>;
     using _funct12 = bf_range<u16, 20, 31>;
 
     static constexpr Flags::Types gen_flags = Flags::None;
@@ -52,6 +62,14 @@ protected:
     static constexpr Flags::Types gen_flags = Flags::HasRd;
 };
 
+struct R1 : public Base {  // unary, rs2 field is a part of opcode
+    INSN_FIELD(rd)
+    INSN_FIELD(rs1)
+
+protected:
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
 struct I : public Base {
     INSN_FIELD(rd)
     INSN_FIELD(rs1)
@@ -128,6 +146,248 @@ protected:
         static_cast<Flags::Types>(Flags::HasRd | Flags::MayTrap);
 };
 
+// F/D formats, FPR fields are named apart from GPR ones
+struct FR : public Base {
+    INSN_FIELD(frd)
+    INSN_FIELD(frs1)
+    INSN_FIELD(frs2)
+    INSN_FIELD(rm)
+
+protected:
+    using _frd = _rd;
+    using _frs1 = _rs1;
+    using _frs2 = _rs2;
+    using _rm = _funct3;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct FR4 : public FR {
+    INSN_FIELD(frs3)
+
+protected:
+    using _frs3 = _funct5;
+};
+
+struct FRX : public Base {  // fpr to gpr
+    INSN_FIELD(rd)
+    INSN_FIELD(frs1)
+    INSN_FIELD(frs2)
+    INSN_FIELD(rm)
+
+protected:
+    using _frs1 = _rs1;
+    using _frs2 = _rs2;
+    using _rm = _funct3;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+struct FXR : public Base {  // gpr to fpr
+    INSN_FIELD(frd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(rm)
+
+protected:
+    using _frd = _rd;
+    using _rm = _funct3;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct FI : public Base {  // fp loads
+    INSN_FIELD(frd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(imm)
+
+protected:
+    using _frd = _rd;
+    using _imm = bf_seq<i16, bf_pt<20, 30>, bf_pt<31, 31>>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct FS : public Base {  // fp stores
+    INSN_FIELD(rs1)
+    INSN_FIELD(frs2)
+    INSN_FIELD(imm)
+
+protected:
+    using _frs2 = _rs2;
+    using _imm = bf_seq<i16, bf_pt<7, 11>, bf_pt<25, 30>, bf_pt<31, 31>>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct CSR : public Base {
+    INSN_FIELD(rd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(csr)
+
+protected:
+    using _csr = _funct12;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+struct CSRI : public Base {  // rs1 field holds zero-extended immediate
+    INSN_FIELD(rd)
+    INSN_FIELD(uimm)
+    INSN_FIELD(csr)
+
+protected:
+    using _uimm = _rs1;
+    using _csr = _funct12;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+// RVV formats, vector register fields are named apart from GPR ones
+struct VCFG : public Base {  // vsetvli
+    INSN_FIELD(rd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(zimm)
+
+protected:
+    using _zimm = bf_range<u16, 20, 30>;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+struct VCFGI : public Base {  // vsetivli, rs1 field holds avl
+    INSN_FIELD(rd)
+    INSN_FIELD(uimm)
+    INSN_FIELD(zimm)
+
+protected:
+    using _uimm = _rs1;
+    using _zimm = bf_range<u16, 20, 29>;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+struct VLS : public Base {  // unit-stride, vd is vs3 for stores
+    INSN_FIELD(vd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(vm)
+
+protected:
+    using _vd = _rd;
+    using _vm = bf_range<u8, 25, 25>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct VV : public Base {
+    INSN_FIELD(vd)
+    INSN_FIELD(vs1)
+    INSN_FIELD(vs2)
+    INSN_FIELD(vm)
+
+protected:
+    using _vd = _rd;
+    using _vs1 = _rs1;
+    using _vs2 = _rs2;
+    using _vm = bf_range<u8, 25, 25>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct VX : public Base {
+    INSN_FIELD(vd)
+    INSN_FIELD(rs1)
+    INSN_FIELD(vs2)
+    INSN_FIELD(vm)
+
+protected:
+    using _vd = _rd;
+    using _vs2 = _rs2;
+    using _vm = bf_range<u8, 25, 25>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct VI : public Base {
+    INSN_FIELD(vd)
+    INSN_FIELD(simm)
+    INSN_FIELD(vs2)
+    INSN_FIELD(vm)
+
+protected:
+    using _vd = _rd;
+    using _simm = bf_range<i8, 15, 19>;
+    using _vs2 = _rs2;
+    using _vm = bf_range<u8, 25, 25>;
+    static constexpr Flags::Types gen_flags = Flags::None;
+};
+
+struct VXS : public Base {  // vector element to gpr
+    INSN_FIELD(rd)
+    INSN_FIELD(vs2)
+
+protected:
+    using _vs2 = _rs2;
+    static constexpr Flags::Types gen_flags = Flags::HasRd;
+};
+
+// vtype fields, ELEN is 32 and fractional LMUL is not supported
+namespace VTYPE
+{
+enum : u32 {
+    VLMUL_MASK = 0b111,
+    VSEW_SHIFT = 3,
+    VSEW_MASK = 0b111 << VSEW_SHIFT,
+    VTA = 1 << 6,
+    VMA = 1 << 7,
+    VILL = 1u << 31,
+};
+
+// Returns vtype for vtypei, VILL if unsupported
+ALWAYS_INLINE constexpr u32 Check(u32 vtypei)
+{
+    u32 vsew = (vtypei & VSEW_MASK) >> VSEW_SHIFT;
+    u32 vlmul = vtypei & VLMUL_MASK;
+    if ((vtypei >> 8) || vsew > 2 || vlmul > 3)
+        return VILL;
+    return vtypei;
+}
+
+ALWAYS_INLINE constexpr u32 SEWBytes(u32 vtype)
+{
+    return 1u << ((vtype & VSEW_MASK) >> VSEW_SHIFT);
+}
+
+ALWAYS_INLINE constexpr u32 LMUL(u32 vtype)
+{
+    return 1u << (vtype & VLMUL_MASK);
+}
+
+ALWAYS_INLINE constexpr u32 VLMAX(u32 vtype, u32 vlenb)
+{
+    return vlenb * LMUL(vtype) / SEWBytes(vtype);
+}
+}  // namespace VTYPE
+
+// Rounding modes, dynamic one is taken from frm
+namespace RM
+{
+enum : u8 {
+    RNE = 0b000,
+    RTZ = 0b001,
+    RDN = 0b010,
+    RUP = 0b011,
+    RMM = 0b100,
+    DYN = 0b111,
+};
+}
+
+namespace CSRNo
+{
+enum : u16 {
+    FFLAGS = 0x001,
+    FRM = 0x002,
+    FCSR = 0x003,
+    VSTART = 0x008,
+    CYCLE = 0xc00,
+    TIME = 0xc01,
+    INSTRET = 0xc02,
+    VL = 0xc20,
+    VTYPE = 0xc21,
+    VLENB = 0xc22,
+    CYCLEH = 0xc80,
+    TIMEH = 0xc81,
+    INSTRETH = 0xc82,
+};
+}
+
 #define OP(name, format_, flags_)                                     \
     struct Insn_##name : format_ {                                    \
         using format = format_;                                       \
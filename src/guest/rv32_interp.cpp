@@ -1,10 +1,19 @@
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <unordered_map>
 
 #include "execute.h"
 #include "guest/rv32_cpu.h"
 #include "guest/rv32_decode.h"
+#include "guest/rv32_interp.h"
 #include "guest/rv32_ops.h"
 #include "mmu.h"
+#include "util/hostclock.h"
 
 namespace dbt
 {
@@ -41,7 +50,7 @@ namespace dbt::rv32
         if constexpr (flags & insn::Flags::Branch) {                           \
             state->ip = GET_GIP();                                             \
         } else {                                                               \
-            gip += 4;                                                          \
+            gip += insn::Length(insn_raw);                                     \
         }                                                                      \
     }                                                                          \
     extern "C" void __attribute__((used))                                      \
@@ -60,10 +69,10 @@ namespace dbt::rv32
     {                                                                  \
         bool pred = (type) s->gpr[i.rs1()] cond(type) s->gpr[i.rs2()]; \
         if (!pred) {                                                   \
-            SET_GIP(GET_GIP() + 4);                                    \
+            SET_GIP(GET_GIP() + insn::Length(i.raw));                  \
             return;                                                    \
         }                                                              \
-        if (unlikely(i.imm() % 4))                                     \
+        if (unlikely(i.imm() % insn::IALIGN))                          \
             RAISE_TRAP(TrapCode::UNALIGNED_IP);                        \
         SET_GIP(GET_GIP() + i.imm());                                  \
     }
@@ -103,17 +112,17 @@ HANDLER(auipc)
 }
 HANDLER(jal)
 {
-    if (unlikely(i.imm() % 4))
+    if (unlikely(i.imm() % insn::IALIGN))
         RAISE_TRAP(TrapCode::UNALIGNED_IP);
-    s->gpr[i.rd()] = GET_GIP() + 4;
+    s->gpr[i.rd()] = GET_GIP() + insn::Length(i.raw);
     SET_GIP(GET_GIP() + i.imm());
 }
 HANDLER(jalr)
 {
     u32 target = (s->gpr[i.rs1()] + i.imm()) & ~(u32) 1;
-    if (unlikely(target % 4))
+    if (unlikely(target % insn::IALIGN))
         RAISE_TRAP(TrapCode::UNALIGNED_IP);
-    s->gpr[i.rd()] = GET_GIP() + 4;
+    s->gpr[i.rd()] = GET_GIP() + insn::Length(i.raw);
     SET_GIP(target);
 }
 HANDLER_Branch(beq, u32, ==);
@@ -167,8 +176,880 @@ HANDLER(srl)
 }
 HANDLER_ArithmRR(or, u32, |);
 HANDLER_ArithmRR(and, u32, &);
+HANDLER_ArithmRR(mul, u32, *);
+HANDLER(mulh)
+{
+    i64 res = (i64) (i32) s->gpr[i.rs1()] * (i64) (i32) s->gpr[i.rs2()];
+    s->gpr[i.rd()] = res >> 32;
+}
+HANDLER(mulhsu)
+{
+    i64 res = (i64) (i32) s->gpr[i.rs1()] * (i64) s->gpr[i.rs2()];
+    s->gpr[i.rd()] = res >> 32;
+}
+HANDLER(mulhu)
+{
+    u64 res = (u64) s->gpr[i.rs1()] * (u64) s->gpr[i.rs2()];
+    s->gpr[i.rd()] = res >> 32;
+}
+HANDLER(div)
+{
+    i32 a = s->gpr[i.rs1()], b = s->gpr[i.rs2()];
+    if (unlikely(b == 0))
+        s->gpr[i.rd()] = -1;
+    else if (unlikely(b == -1))
+        s->gpr[i.rd()] = -(u32) a;
+    else
+        s->gpr[i.rd()] = a / b;
+}
+HANDLER(divu)
+{
+    u32 a = s->gpr[i.rs1()], b = s->gpr[i.rs2()];
+    s->gpr[i.rd()] = likely(b) ? a / b : -1;
+}
+HANDLER(rem)
+{
+    i32 a = s->gpr[i.rs1()], b = s->gpr[i.rs2()];
+    if (unlikely(b == 0))
+        s->gpr[i.rd()] = a;
+    else if (unlikely(b == -1))
+        s->gpr[i.rd()] = 0;
+    else
+        s->gpr[i.rd()] = a % b;
+}
+HANDLER(remu)
+{
+    u32 a = s->gpr[i.rs1()], b = s->gpr[i.rs2()];
+    s->gpr[i.rd()] = likely(b) ? a % b : a;
+}
+HANDLER(lrw)
+{
+    u32 addr = s->gpr[i.rs1()];
+    u32 val = __atomic_load_n((u32 *) (vmem + addr), __ATOMIC_ACQUIRE);
+    s->lr_addr = addr;
+    s->lr_val = val;
+    s->gpr[i.rd()] = val;
+}
+HANDLER(scw)
+{
+    u32 addr = s->gpr[i.rs1()];
+    u32 expected = s->lr_val;
+    bool ok = s->lr_addr == addr &&
+              __atomic_compare_exchange_n((u32 *) (vmem + addr), &expected,
+                                          s->gpr[i.rs2()], false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    s->lr_addr = -1;
+    s->gpr[i.rd()] = !ok;
+}
+
+template <typename F>
+static ALWAYS_INLINE u32 AtomicRMW(u32 *ptr, F &&fn)
+{
+    u32 old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(ptr, &old, fn(old), false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        ;
+    return old;
+}
+
+#define HANDLER_AmoFetch(name, builtin)                                   \
+    HANDLER(name)                                                         \
+    {                                                                     \
+        u32 *ptr = (u32 *) (vmem + s->gpr[i.rs1()]);                      \
+        s->gpr[i.rd()] = builtin(ptr, s->gpr[i.rs2()], __ATOMIC_SEQ_CST); \
+    }
+#define HANDLER_AmoMinMax(name, type, cmp)                               \
+    HANDLER(name)                                                        \
+    {                                                                    \
+        type val = s->gpr[i.rs2()];                                      \
+        s->gpr[i.rd()] = AtomicRMW(                                      \
+            (u32 *) (vmem + s->gpr[i.rs1()]),                            \
+            [val](u32 old) { return (u32) std::cmp((type) old, val); }); \
+    }
+HANDLER_AmoFetch(amoswapw, __atomic_exchange_n);
+HANDLER_AmoFetch(amoaddw, __atomic_fetch_add);
+HANDLER_AmoFetch(amoxorw, __atomic_fetch_xor);
+HANDLER_AmoFetch(amoandw, __atomic_fetch_and);
+HANDLER_AmoFetch(amoorw, __atomic_fetch_or);
+HANDLER_AmoMinMax(amominw, i32, min);
+HANDLER_AmoMinMax(amomaxw, i32, max);
+HANDLER_AmoMinMax(amominuw, u32, min);
+HANDLER_AmoMinMax(amomaxuw, u32, max);
+#define HANDLER_ShAdd(name, sh)                                       \
+    HANDLER(name)                                                     \
+    {                                                                 \
+        s->gpr[i.rd()] = (s->gpr[i.rs1()] << (sh)) + s->gpr[i.rs2()]; \
+    }
+#define HANDLER_MinMax(name, type, cmp)                \
+    HANDLER(name)                                      \
+    {                                                  \
+        type a = s->gpr[i.rs1()], b = s->gpr[i.rs2()]; \
+        s->gpr[i.rd()] = std::cmp(a, b);               \
+    }
+HANDLER_ShAdd(sh1add, 1);
+HANDLER_ShAdd(sh2add, 2);
+HANDLER_ShAdd(sh3add, 3);
+HANDLER(andn)
+{
+    s->gpr[i.rd()] = s->gpr[i.rs1()] & ~s->gpr[i.rs2()];
+}
+HANDLER(orn)
+{
+    s->gpr[i.rd()] = s->gpr[i.rs1()] | ~s->gpr[i.rs2()];
+}
+HANDLER(xnor)
+{
+    s->gpr[i.rd()] = ~(s->gpr[i.rs1()] ^ s->gpr[i.rs2()]);
+}
+HANDLER(clz)
+{
+    s->gpr[i.rd()] = std::countl_zero(s->gpr[i.rs1()]);
+}
+HANDLER(ctz)
+{
+    s->gpr[i.rd()] = std::countr_zero(s->gpr[i.rs1()]);
+}
+HANDLER(cpop)
+{
+    s->gpr[i.rd()] = std::popcount(s->gpr[i.rs1()]);
+}
+HANDLER_MinMax(max, i32, max);
+HANDLER_MinMax(maxu, u32, max);
+HANDLER_MinMax(min, i32, min);
+HANDLER_MinMax(minu, u32, min);
+HANDLER(sextb)
+{
+    s->gpr[i.rd()] = (i8) s->gpr[i.rs1()];
+}
+HANDLER(sexth)
+{
+    s->gpr[i.rd()] = (i16) s->gpr[i.rs1()];
+}
+HANDLER(zexth)
+{
+    s->gpr[i.rd()] = (u16) s->gpr[i.rs1()];
+}
+HANDLER(rol)
+{
+    s->gpr[i.rd()] = std::rotl(s->gpr[i.rs1()], s->gpr[i.rs2()] & 31);
+}
+HANDLER(ror)
+{
+    s->gpr[i.rd()] = std::rotr(s->gpr[i.rs1()], s->gpr[i.rs2()] & 31);
+}
+HANDLER(rori)
+{
+    s->gpr[i.rd()] = std::rotr(s->gpr[i.rs1()], i.imm());
+}
+HANDLER(orcb)
+{
+    u32 val = s->gpr[i.rs1()], res = 0;
+    for (u8 b = 0; b < 32; b += 8) {
+        if (val & (0xffu << b))
+            res |= 0xffu << b;
+    }
+    s->gpr[i.rd()] = res;
+}
+HANDLER(rev8)
+{
+    s->gpr[i.rd()] = __builtin_bswap32(s->gpr[i.rs1()]);
+}
+#define HANDLER_BitRR(name, expr)               \
+    HANDLER(name)                               \
+    {                                           \
+        u32 a = s->gpr[i.rs1()];                \
+        u32 bit = 1u << (s->gpr[i.rs2()] & 31); \
+        s->gpr[i.rd()] = expr;                  \
+    }
+#define HANDLER_BitRI(name, expr) \
+    HANDLER(name)                 \
+    {                             \
+        u32 a = s->gpr[i.rs1()];  \
+        u32 bit = 1u << i.imm();  \
+        s->gpr[i.rd()] = expr;    \
+    }
+HANDLER_BitRR(bclr, a & ~bit);
+HANDLER_BitRI(bclri, a & ~bit);
+HANDLER_BitRR(bext, !!(a & bit));
+HANDLER_BitRI(bexti, !!(a & bit));
+HANDLER_BitRR(binv, a ^ bit);
+HANDLER_BitRI(binvi, a ^ bit);
+HANDLER_BitRR(bset, a | bit);
+HANDLER_BitRI(bseti, a | bit);
+/* RV32F/D is computed with host SSE arithmetic, which matches RISC-V except
+ * for NaN propagation, so NaN results are canonicalized. Host rounding mode
+ * follows frm, static rounding modes are applied per instruction.
+ */
+template <typename T>
+struct FPTraits;
+
+template <>
+struct FPTraits<float> {
+    using bits_t = u32;
+    static constexpr bits_t canon_nan = 0x7fc00000;
+    static constexpr bits_t sign = 0x80000000;
+    static constexpr bits_t quiet = 0x00400000;
+};
+
+template <>
+struct FPTraits<double> {
+    using bits_t = u64;
+    static constexpr bits_t canon_nan = 0x7ff8000000000000;
+    static constexpr bits_t sign = 0x8000000000000000;
+    static constexpr bits_t quiet = 0x0008000000000000;
+};
+
+// Improperly NaN-boxed singles read as canonical NaN
+template <typename T>
+static ALWAYS_INLINE typename FPTraits<T>::bits_t GetFBits(CPUState *s, u8 r)
+{
+    u64 v = s->fpr[r];
+    if constexpr (std::is_same_v<T, float>) {
+        if (unlikely((v >> 32) != 0xffffffff))
+            return FPTraits<T>::canon_nan;
+    }
+    return v;
+}
+
+template <typename T>
+static ALWAYS_INLINE void SetFBits(CPUState *s,
+                                   u8 r,
+                                   typename FPTraits<T>::bits_t v)
+{
+    if constexpr (std::is_same_v<T, float>)
+        s->fpr[r] = v | ((u64) 0xffffffff << 32);
+    else
+        s->fpr[r] = v;
+}
+
+template <typename T>
+static ALWAYS_INLINE T GetF(CPUState *s, u8 r)
+{
+    return std::bit_cast<T>(GetFBits<T>(s, r));
+}
+
+template <typename T>
+static ALWAYS_INLINE void SetF(CPUState *s, u8 r, T v)
+{
+    SetFBits<T>(s, r,
+                std::isnan(v) ? FPTraits<T>::canon_nan
+                              : std::bit_cast<typename FPTraits<T>::bits_t>(v));
+}
+
+template <typename T>
+static ALWAYS_INLINE bool IsSNaN(T v)
+{
+    return std::isnan(v) &&
+           !(std::bit_cast<typename FPTraits<T>::bits_t>(v) &
+             FPTraits<T>::quiet);
+}
+
+// Keeps computation inside of RoundingScope
+template <typename T>
+static ALWAYS_INLINE T FPBarrier(T v)
+{
+    asm volatile("" : "+x"(v));
+    return v;
+}
+
+// RMM has no host equivalent and is approximated by RNE
+static int HostRounding(u8 rm)
+{
+    switch (rm) {
+    case insn::RM::RTZ:
+        return FE_TOWARDZERO;
+    case insn::RM::RDN:
+        return FE_DOWNWARD;
+    case insn::RM::RUP:
+        return FE_UPWARD;
+    default:
+        return FE_TONEAREST;
+    }
+}
+
+struct RoundingScope {
+    explicit RoundingScope(u8 rm)
+    {
+        if (likely(rm == insn::RM::DYN))
+            return;
+        saved = fegetround();
+        fesetround(HostRounding(rm));
+    }
+    ~RoundingScope()
+    {
+        if (saved >= 0)
+            fesetround(saved);
+    }
+    NO_COPY(RoundingScope)
+    NO_MOVE(RoundingScope)
+
+private:
+    int saved{-1};
+};
+
+template <typename T>
+static ALWAYS_INLINE T FMinMax(T a, T b, bool is_max)
+{
+    if (IsSNaN(a) || IsSNaN(b))
+        feraiseexcept(FE_INVALID);
+    if (std::isnan(a))
+        return b;
+    if (std::isnan(b))
+        return a;
+    if (a == b)  // -0.0 < +0.0
+        return std::signbit(a) == is_max ? b : a;
+    return is_max ? std::max(a, b) : std::min(a, b);
+}
+
+template <typename T>
+static ALWAYS_INLINE T FRoundInt(T v, u8 rm)
+{
+    switch (rm) {
+    case insn::RM::RTZ:
+        return std::trunc(v);
+    case insn::RM::RDN:
+        return std::floor(v);
+    case insn::RM::RUP:
+        return std::ceil(v);
+    case insn::RM::RMM:
+        return std::round(v);
+    default: {
+        RoundingScope rs(rm);
+        return FPBarrier(std::nearbyint(v));
+    }
+    }
+}
+
+// Out of range values and NaN saturate with invalid flag
+template <typename I, typename T>
+static I FCvtToInt(T v, u8 rm)
+{
+    constexpr T lo = std::is_signed_v<I> ? -0x1p31 : 0;
+    constexpr T hi = std::is_signed_v<I> ? 0x1p31 : 0x1p32;
+    if (std::isnan(v)) {
+        feraiseexcept(FE_INVALID);
+        return std::numeric_limits<I>::max();
+    }
+    T r = FRoundInt(v, rm);
+    if (!(r >= lo && r < hi)) {
+        feraiseexcept(FE_INVALID);
+        return r < 0 ? std::numeric_limits<I>::min()
+                     : std::numeric_limits<I>::max();
+    }
+    if (r != v)
+        feraiseexcept(FE_INEXACT);
+    return (I) r;
+}
+
+template <typename T>
+static u32 FClass(T v)
+{
+    bool neg = std::signbit(v);
+    switch (std::fpclassify(v)) {
+    case FP_INFINITE:
+        return neg ? 1 << 0 : 1 << 7;
+    case FP_NORMAL:
+        return neg ? 1 << 1 : 1 << 6;
+    case FP_SUBNORMAL:
+        return neg ? 1 << 2 : 1 << 5;
+    case FP_ZERO:
+        return neg ? 1 << 3 : 1 << 4;
+    default:
+        return IsSNaN(v) ? 1 << 8 : 1 << 9;
+    }
+}
+
+#define HANDLER_FLoad(name, T)                                              \
+    HANDLER(name)                                                           \
+    {                                                                       \
+        using B = FPTraits<T>::bits_t;                                      \
+        SetFBits<T>(s, i.frd(),                                             \
+                    unaligned_load<B>(vmem + (s->gpr[i.rs1()] + i.imm()))); \
+    }
+#define HANDLER_FStore(name, T)                                \
+    HANDLER(name)                                              \
+    {                                                          \
+        using B = FPTraits<T>::bits_t;                         \
+        unaligned_store<B>(vmem + (s->gpr[i.rs1()] + i.imm()), \
+                           (B) s->fpr[i.frs2()]);              \
+    }
+#define HANDLER_FFma(name, T, sa, sc)                            \
+    HANDLER(name)                                                \
+    {                                                            \
+        RoundingScope rs(i.rm());                                \
+        T a = GetF<T>(s, i.frs1()), b = GetF<T>(s, i.frs2()),    \
+          c = GetF<T>(s, i.frs3());                              \
+        SetF<T>(s, i.frd(), FPBarrier(std::fma(sa a, b, sc c))); \
+    }
+#define HANDLER_FBinop(name, T, op)                                       \
+    HANDLER(name)                                                         \
+    {                                                                     \
+        RoundingScope rs(i.rm());                                         \
+        SetF<T>(s, i.frd(),                                               \
+                FPBarrier(GetF<T>(s, i.frs1()) op GetF<T>(s, i.frs2()))); \
+    }
+#define HANDLER_FSqrt(name, T)                                           \
+    HANDLER(name)                                                        \
+    {                                                                    \
+        RoundingScope rs(i.rm());                                        \
+        SetF<T>(s, i.frd(), FPBarrier(std::sqrt(GetF<T>(s, i.frs1())))); \
+    }
+#define HANDLER_FSgnj(name, T, expr)                            \
+    HANDLER(name)                                               \
+    {                                                           \
+        auto a = GetFBits<T>(s, i.frs1());                      \
+        auto b = GetFBits<T>(s, i.frs2());                      \
+        constexpr auto sign = FPTraits<T>::sign;                \
+        SetFBits<T>(s, i.frd(), (a & ~sign) | ((expr) & sign)); \
+    }
+#define HANDLER_FMinMax(name, T, is_max)                                      \
+    HANDLER(name)                                                             \
+    {                                                                         \
+        SetF<T>(s, i.frd(),                                                   \
+                FMinMax(GetF<T>(s, i.frs1()), GetF<T>(s, i.frs2()), is_max)); \
+    }
+#define HANDLER_FCvtToInt(name, I, T)                                \
+    HANDLER(name)                                                    \
+    {                                                                \
+        s->gpr[i.rd()] = FCvtToInt<I>(GetF<T>(s, i.frs1()), i.rm()); \
+    }
+#define HANDLER_FCvtFromInt(name, T, I)                          \
+    HANDLER(name)                                                \
+    {                                                            \
+        RoundingScope rs(i.rm());                                \
+        SetF<T>(s, i.frd(), FPBarrier((T) (I) s->gpr[i.rs1()])); \
+    }
+#define HANDLER_FEq(name, T)                                  \
+    HANDLER(name)                                             \
+    {                                                         \
+        T a = GetF<T>(s, i.frs1()), b = GetF<T>(s, i.frs2()); \
+        if (IsSNaN(a) || IsSNaN(b))                           \
+            feraiseexcept(FE_INVALID);                        \
+        s->gpr[i.rd()] = a == b;                              \
+    }
+#define HANDLER_FCmp(name, T, op)                             \
+    HANDLER(name)                                             \
+    {                                                         \
+        T a = GetF<T>(s, i.frs1()), b = GetF<T>(s, i.frs2()); \
+        if (std::isnan(a) || std::isnan(b)) {                 \
+            feraiseexcept(FE_INVALID);                        \
+            s->gpr[i.rd()] = 0;                               \
+            return;                                           \
+        }                                                     \
+        s->gpr[i.rd()] = a op b;                              \
+    }
+#define HANDLER_FClass(name, T) \
+    HANDLER(name) { s->gpr[i.rd()] = FClass(GetF<T>(s, i.frs1())); }
+
+HANDLER_FLoad(flw, float);
+HANDLER_FStore(fsw, float);
+HANDLER_FFma(fmadds, float, +, +);
+HANDLER_FFma(fmsubs, float, +, -);
+HANDLER_FFma(fnmsubs, float, -, +);
+HANDLER_FFma(fnmadds, float, -, -);
+HANDLER_FBinop(fadds, float, +);
+HANDLER_FBinop(fsubs, float, -);
+HANDLER_FBinop(fmuls, float, *);
+HANDLER_FBinop(fdivs, float, /);
+HANDLER_FSqrt(fsqrts, float);
+HANDLER_FSgnj(fsgnjs, float, b);
+HANDLER_FSgnj(fsgnjns, float, ~b);
+HANDLER_FSgnj(fsgnjxs, float, a ^ b);
+HANDLER_FMinMax(fmins, float, false);
+HANDLER_FMinMax(fmaxs, float, true);
+HANDLER_FCvtToInt(fcvtws, i32, float);
+HANDLER_FCvtToInt(fcvtwus, u32, float);
+HANDLER(fmvxw)
+{
+    s->gpr[i.rd()] = s->fpr[i.frs1()];
+}
+HANDLER_FEq(feqs, float);
+HANDLER_FCmp(flts, float, <);
+HANDLER_FCmp(fles, float, <=);
+HANDLER_FClass(fclasss, float);
+HANDLER_FCvtFromInt(fcvtsw, float, i32);
+HANDLER_FCvtFromInt(fcvtswu, float, u32);
+HANDLER(fmvwx)
+{
+    SetFBits<float>(s, i.frd(), s->gpr[i.rs1()]);
+}
+HANDLER_FLoad(fld, double);
+HANDLER_FStore(fsd, double);
+HANDLER_FFma(fmaddd, double, +, +);
+HANDLER_FFma(fmsubd, double, +, -);
+HANDLER_FFma(fnmsubd, double, -, +);
+HANDLER_FFma(fnmaddd, double, -, -);
+HANDLER_FBinop(faddd, double, +);
+HANDLER_FBinop(fsubd, double, -);
+HANDLER_FBinop(fmuld, double, *);
+HANDLER_FBinop(fdivd, double, /);
+HANDLER_FSqrt(fsqrtd, double);
+HANDLER_FSgnj(fsgnjd, double, b);
+HANDLER_FSgnj(fsgnjnd, double, ~b);
+HANDLER_FSgnj(fsgnjxd, double, a ^ b);
+HANDLER_FMinMax(fmind, double, false);
+HANDLER_FMinMax(fmaxd, double, true);
+HANDLER(fcvtsd)
+{
+    RoundingScope rs(i.rm());
+    SetF<float>(s, i.frd(), FPBarrier((float) GetF<double>(s, i.frs1())));
+}
+HANDLER(fcvtds)
+{
+    SetF<double>(s, i.frd(), GetF<float>(s, i.frs1()));
+}
+HANDLER_FEq(feqd, double);
+HANDLER_FCmp(fltd, double, <);
+HANDLER_FCmp(fled, double, <=);
+HANDLER_FClass(fclassd, double);
+HANDLER_FCvtToInt(fcvtwd, i32, double);
+HANDLER_FCvtToInt(fcvtwud, u32, double);
+HANDLER_FCvtFromInt(fcvtdw, double, i32);
+HANDLER_FCvtFromInt(fcvtdwu, double, u32);
+
+/* RVV with VLEN=128 and ELEN=32. vstart is always zero, tail and masked-off
+ * elements are left undisturbed for any vta/vma
+ */
+template <typename T>
+static ALWAYS_INLINE T *VReg(CPUState *s, u8 reg)
+{
+    return reinterpret_cast<T *>(s->vreg[reg].data());
+}
+
+static ALWAYS_INLINE bool VActive(CPUState *s, bool vm, u32 idx)
+{
+    return vm || (s->vreg[0][idx / 8] >> (idx % 8) & 1);
+}
+
+// Register groups must be aligned to emul
+static ALWAYS_INLINE bool VCheck(CPUState *s,
+                                 u32 emul,
+                                 std::initializer_list<u8> regs)
+{
+    if (unlikely(s->vtype & insn::VTYPE::VILL))
+        return false;
+    for (auto r : regs) {
+        if (unlikely(r % emul))
+            return false;
+    }
+    return true;
+}
+
+// Calls f(T{}) with T of current SEW
+template <typename F>
+static ALWAYS_INLINE void VWithSEW(CPUState *s, F &&f)
+{
+    switch (insn::VTYPE::SEWBytes(s->vtype)) {
+    case 1:
+        return f(u8{});
+    case 2:
+        return f(u16{});
+    default:
+        return f(u32{});
+    }
+}
+
+static u32 VSetVl(CPUState *s, u32 avl, u32 vtypei)
+{
+    s->vtype = insn::VTYPE::Check(vtypei);
+    if (s->vtype & insn::VTYPE::VILL)
+        s->vl = 0;
+    else
+        s->vl = std::min(avl, insn::VTYPE::VLMAX(s->vtype, CPUState::VLENB));
+    return s->vl;
+}
+
+// rs1=x0 requests VLMAX, or keeps vl if rd=x0 as well
+static ALWAYS_INLINE u32 VAvl(CPUState *s, u8 rd, u8 rs1)
+{
+    if (rs1)
+        return s->gpr[rs1];
+    return rd ? ~(u32) 0 : s->vl;
+}
+
+HANDLER(vsetvli)
+{
+    s->gpr[i.rd()] = VSetVl(s, VAvl(s, i.rd(), i.rs1()), i.zimm());
+}
+HANDLER(vsetivli)
+{
+    s->gpr[i.rd()] = VSetVl(s, i.uimm(), i.zimm());
+}
+HANDLER(vsetvl)
+{
+    s->gpr[i.rd()] = VSetVl(s, VAvl(s, i.rd(), i.rs1()), s->gpr[i.rs2()]);
+}
+
+// Effective LMUL of eew-sized elements must be supported
+template <typename T>
+static ALWAYS_INLINE bool VCheckEEW(CPUState *s, u8 vd)
+{
+    u32 emul = sizeof(T) * insn::VTYPE::LMUL(s->vtype);
+    u32 sew = insn::VTYPE::SEWBytes(s->vtype);
+    if (emul < sew || emul > sew * 8)
+        return false;
+    return VCheck(s, emul / sew, {vd});
+}
+
+#define HANDLER_VLoad(name, T)                                 \
+    HANDLER(name)                                              \
+    {                                                          \
+        if (!VCheckEEW<T>(s, i.vd()))                          \
+            RAISE_TRAP(TrapCode::ILLEGAL_INSN);                \
+        T *d = VReg<T>(s, i.vd());                             \
+        u8 *src = vmem + s->gpr[i.rs1()];                      \
+        for (u32 k = 0; k < s->vl; ++k) {                      \
+            if (VActive(s, i.vm(), k))                         \
+                d[k] = unaligned_load<T>(src + k * sizeof(T)); \
+        }                                                      \
+    }
+#define HANDLER_VStore(name, T)                                \
+    HANDLER(name)                                              \
+    {                                                          \
+        if (!VCheckEEW<T>(s, i.vd()))                          \
+            RAISE_TRAP(TrapCode::ILLEGAL_INSN);                \
+        T *d = VReg<T>(s, i.vd());                             \
+        u8 *dst = vmem + s->gpr[i.rs1()];                      \
+        for (u32 k = 0; k < s->vl; ++k) {                      \
+            if (VActive(s, i.vm(), k))                         \
+                unaligned_store<T>(dst + k * sizeof(T), d[k]); \
+        }                                                      \
+    }
+// vd[k] = vs2[k] op src, a and b are u32 to avoid promotion to int
+#define HANDLER_VArith(name, src, op, ...)                          \
+    HANDLER(name)                                                   \
+    {                                                               \
+        if (!VCheck(s, insn::VTYPE::LMUL(s->vtype), {__VA_ARGS__})) \
+            RAISE_TRAP(TrapCode::ILLEGAL_INSN);                     \
+        VWithSEW(s, [&](auto tag) {                                 \
+            using T = decltype(tag);                                \
+            T *d = VReg<T>(s, i.vd());                              \
+            T *v2 = VReg<T>(s, i.vs2());                            \
+            for (u32 k = 0; k < s->vl; ++k) {                       \
+                if (VActive(s, i.vm(), k)) {                        \
+                    u32 a = v2[k], b = (T) (src);                   \
+                    d[k] = a op b;                                  \
+                }                                                   \
+            }                                                       \
+        });                                                         \
+    }
+#define HANDLER_VArithVV(name, op)                                        \
+    HANDLER_VArith(name##vv, VReg<T>(s, i.vs1())[k], op, i.vd(), i.vs1(), \
+                   i.vs2())
+#define HANDLER_VArithVX(name, op) \
+    HANDLER_VArith(name##vx, s->gpr[i.rs1()], op, i.vd(), i.vs2())
+#define HANDLER_VArithVI(name, op) \
+    HANDLER_VArith(name##vi, i.simm(), op, i.vd(), i.vs2())
+#define HANDLER_VMv(name, src, ...)                                 \
+    HANDLER(name)                                                   \
+    {                                                               \
+        if (!VCheck(s, insn::VTYPE::LMUL(s->vtype), {__VA_ARGS__})) \
+            RAISE_TRAP(TrapCode::ILLEGAL_INSN);                     \
+        VWithSEW(s, [&](auto tag) {                                 \
+            using T = decltype(tag);                                \
+            T *d = VReg<T>(s, i.vd());                              \
+            for (u32 k = 0; k < s->vl; ++k)                         \
+                d[k] = (src);                                       \
+        });                                                         \
+    }
+
+HANDLER_VLoad(vle8v, u8);
+HANDLER_VLoad(vle16v, u16);
+HANDLER_VLoad(vle32v, u32);
+HANDLER_VStore(vse8v, u8);
+HANDLER_VStore(vse16v, u16);
+HANDLER_VStore(vse32v, u32);
+HANDLER_VArithVV(vadd, +);
+HANDLER_VArithVX(vadd, +);
+HANDLER_VArithVI(vadd, +);
+HANDLER_VArithVV(vsub, -);
+HANDLER_VArithVX(vsub, -);
+HANDLER_VArithVV(vmul, *);
+HANDLER_VArithVX(vmul, *);
+HANDLER_VArithVV(vand, &);
+HANDLER_VArithVX(vand, &);
+HANDLER_VArithVI(vand, &);
+HANDLER_VArithVV(vor, |);
+HANDLER_VArithVX(vor, |);
+HANDLER_VArithVI(vor, |);
+HANDLER_VArithVV(vxor, ^);
+HANDLER_VArithVX(vxor, ^);
+HANDLER_VArithVI(vxor, ^);
+HANDLER_VMv(vmvvv, VReg<T>(s, i.vs1())[k], i.vd(), i.vs1());
+HANDLER_VMv(vmvvx, (T) s->gpr[i.rs1()], i.vd());
+HANDLER_VMv(vmvvi, (T) i.simm(), i.vd());
+// vd[0] = vs1[0] + sum(vs2), vd and vs1 are single registers
+HANDLER(vredsum)
+{
+    if (!VCheck(s, insn::VTYPE::LMUL(s->vtype), {i.vs2()}))
+        RAISE_TRAP(TrapCode::ILLEGAL_INSN);
+    if (!s->vl)
+        return;
+    VWithSEW(s, [&](auto tag) {
+        using T = decltype(tag);
+        T *v2 = VReg<T>(s, i.vs2());
+        u32 sum = VReg<T>(s, i.vs1())[0];
+        for (u32 k = 0; k < s->vl; ++k) {
+            if (VActive(s, i.vm(), k))
+                sum += v2[k];
+        }
+        VReg<T>(s, i.vd())[0] = sum;
+    });
+}
+HANDLER(vmvxs)
+{
+    if (!VCheck(s, 1, {}))
+        RAISE_TRAP(TrapCode::ILLEGAL_INSN);
+    VWithSEW(s, [&](auto tag) {
+        using T = decltype(tag);
+        using S = std::make_signed_t<T>;
+        s->gpr[i.rd()] = (i32) (S) VReg<T>(s, i.vs2())[0];
+    });
+}
+HANDLER(vmvsx)
+{
+    if (!VCheck(s, 1, {}))
+        RAISE_TRAP(TrapCode::ILLEGAL_INSN);
+    if (!s->vl)
+        return;
+    VWithSEW(s, [&](auto tag) {
+        using T = decltype(tag);
+        VReg<T>(s, i.vd())[0] = s->gpr[i.rs1()];
+    });
+}
+
+/* fcsr accesses are the only points where lazily accrued host exception
+ * flags are merged into fflags
+ */
+static u32 HostFPFlags()
+{
+    int ex = fetestexcept(FE_ALL_EXCEPT);
+    return (ex & FE_INEXACT ? 1u << 0 : 0) | (ex & FE_UNDERFLOW ? 1u << 1 : 0) |
+           (ex & FE_OVERFLOW ? 1u << 2 : 0) |
+           (ex & FE_DIVBYZERO ? 1u << 3 : 0) | (ex & FE_INVALID ? 1u << 4 : 0);
+}
+
+static bool ReadCSR(CPUState *s, u16 csr, u32 *val)
+{
+    switch (csr) {
+    case insn::CSRNo::FFLAGS:
+        *val = s->fflags | HostFPFlags();
+        return true;
+    case insn::CSRNo::FRM:
+        *val = s->frm;
+        return true;
+    case insn::CSRNo::FCSR:
+        *val = s->frm << 5 | s->fflags | HostFPFlags();
+        return true;
+    case insn::CSRNo::VSTART:
+        *val = s->vstart;
+        return true;
+    case insn::CSRNo::VL:
+        *val = s->vl;
+        return true;
+    case insn::CSRNo::VTYPE:
+        *val = s->vtype;
+        return true;
+    case insn::CSRNo::VLENB:
+        *val = CPUState::VLENB;
+        return true;
+    // cycle is host TSC, time has 1GHz timebase
+    case insn::CSRNo::CYCLE:
+        *val = HostClock::ReadTsc();
+        return true;
+    case insn::CSRNo::CYCLEH:
+        *val = HostClock::ReadTsc() >> 32;
+        return true;
+    case insn::CSRNo::TIME:
+    case insn::CSRNo::TIMEH: {
+        auto &clock = HostClock::Get();
+        clock.Update();
+        u64 ns = clock.Now();
+        *val = csr == insn::CSRNo::TIME ? ns : ns >> 32;
+        return true;
+    }
+    case insn::CSRNo::INSTRET:
+        *val = s->instret;
+        return true;
+    case insn::CSRNo::INSTRETH:
+        *val = s->instret >> 32;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Reserved frm values are not trapped on use, host keeps RNE
+static void WriteCSR(CPUState *s, u16 csr, u32 val)
+{
+    switch (csr) {
+    case insn::CSRNo::FFLAGS:
+        s->fflags = val & 0x1f;
+        feclearexcept(FE_ALL_EXCEPT);
+        return;
+    case insn::CSRNo::FRM:
+        s->frm = val & 0x7;
+        fesetround(HostRounding(s->frm));
+        return;
+    case insn::CSRNo::FCSR:
+        s->fflags = val & 0x1f;
+        s->frm = (val >> 5) & 0x7;
+        feclearexcept(FE_ALL_EXCEPT);
+        fesetround(HostRounding(s->frm));
+        return;
+    case insn::CSRNo::VSTART:
+        s->vstart = val & (CPUState::VLEN - 1);
+        return;
+    default:
+        unreachable("");
+    }
+}
+
+enum class CSROp { W, S, C };
+
+template <CSROp op>
+static ALWAYS_INLINE bool AccessCSR(CPUState *s,
+                                    u16 csr,
+                                    u8 rd,
+                                    u32 src,
+                                    bool write)
+{
+    u32 old;
+    if (!ReadCSR(s, csr, &old))
+        return false;
+    if (write && (csr >> 10) == 0b11)  // read-only
+        return false;
+    if (write) {
+        if constexpr (op == CSROp::W)
+            WriteCSR(s, csr, src);
+        else if constexpr (op == CSROp::S)
+            WriteCSR(s, csr, old | src);
+        else
+            WriteCSR(s, csr, old & ~src);
+    }
+    s->gpr[rd] = old;
+    return true;
+}
+
+// csrrs/csrrc with zero source do not write
+#define HANDLER_CSR(name, op, src, write)                          \
+    HANDLER(name)                                                  \
+    {                                                              \
+        if (!AccessCSR<CSROp::op>(s, i.csr(), i.rd(), src, write)) \
+            RAISE_TRAP(TrapCode::ILLEGAL_INSN);                    \
+    }
+HANDLER_CSR(csrrw, W, s->gpr[i.rs1()], true);
+HANDLER_CSR(csrrs, S, s->gpr[i.rs1()], i.rs1());
+HANDLER_CSR(csrrc, C, s->gpr[i.rs1()], i.rs1());
+HANDLER_CSR(csrrwi, W, i.uimm(), true);
+HANDLER_CSR(csrrsi, S, i.uimm(), i.uimm());
+HANDLER_CSR(csrrci, C, i.uimm(), i.uimm());
 HANDLER(fence) {}
-HANDLER(fencei) {}
+// Ends the block, stores to translated code are caught by write faults
+HANDLER(fencei)
+{
+    SET_GIP(GET_GIP() + insn::Length(i.raw));
+}
 HANDLER(ecall)
 {
     RAISE_TRAP(TrapCode::ECALL);
@@ -180,4 +1061,177 @@ HANDLER(ebreak)
     RaiseTrap();
 }
 
+struct InterpOp {
+    using Handler = void (*)(CPUState *, u32 &, u8 *, u32);
+
+    Handler h;
+    std::underlying_type_t<insn::Flags::Types> flags;
+};
+
+struct Interpreter {
+#define OP(name, format_, flags_) \
+    static constexpr InterpOp _##name{&H_##name, insn::Insn_##name::flags};
+    RV32_OPCODE_LIST()
+#undef OP
+};
+
+struct IBlock {
+    struct Insn {
+        InterpOp::Handler h;
+        u32 raw;
+    };
+
+    // Successors profile, collected for region formation
+    struct Succ {
+        u32 ip;
+        u32 count;
+    };
+
+    void RecordSucc(u32 sip)
+    {
+        for (auto &e : succs) {
+            if (e.ip == sip) {
+                e.count++;
+                return;
+            }
+        }
+        auto &victim = succs[0].count < succs[1].count ? succs[0] : succs[1];
+        victim = {sip, 1};
+    }
+
+    u32 ip;
+    u32 hotness;
+    std::array<Succ, 2> succs;
+    u32 n_insns;
+    Insn insns[];
+};
+
+struct IBlockCache {
+    IBlock *Lookup(u32 ip)
+    {
+        auto it = map.find(ip);
+        if (likely(it != map.end()))
+            return it->second;
+        return Decode(ip);
+    }
+
+    IBlock *Decode(u32 ip);
+
+    void Flush()
+    {
+        map.clear();
+        arena.Reset();
+    }
+
+    static constexpr size_t ARENA_SIZE = 16_MB;
+    MemArena arena{ARENA_SIZE};
+    std::unordered_map<u32, IBlock *> map;
+};
+
+static thread_local IBlockCache iblock_cache;
+
+u32 InterpTier::hot_threshold{0};
+
+IBlock *IBlockCache::Decode(u32 ip)
+{
+    using decoder = insn::Decoder<Interpreter>;
+    static constexpr auto stop_flags = insn::Flags::Branch | insn::Flags::Trap;
+
+    std::array<IBlock::Insn, TB_MAX_INSNS> buf;
+    u32 n = 0;
+    u32 gip = ip;
+    u32 page_end = rounddown(ip, mmu::PAGE_SIZE) + mmu::PAGE_SIZE;
+    mmu::ProtectCode(page_end - mmu::PAGE_SIZE);
+    mmu::ProtectCode(CodeLastPage(ip));
+    while (true) {
+        auto raw = insn::Fetch(mmu::g2h(gip));
+        auto op = decoder::Decode(raw);
+        buf[n++] = {op.h, raw};
+        gip += insn::Length(raw);
+        if ((op.flags & stop_flags) || n == TB_MAX_INSNS || gip >= page_end)
+            break;
+    }
+
+    size_t sz = sizeof(IBlock) + sizeof(IBlock::Insn) * n;
+    if (!arena.HasSpace(sz, alignof(IBlock)))
+        Flush();
+    auto *ib = (IBlock *) arena.Allocate(sz, alignof(IBlock));
+    ib->ip = ip;
+    ib->hotness = 0;
+    ib->succs = {};
+    ib->n_insns = n;
+    std::copy(buf.begin(), buf.begin() + n, ib->insns);
+    map.insert({ip, ib});
+    return ib;
+}
+
+static ALWAYS_INLINE void ExecuteIBlock(CPUState *state, u8 *vmem, IBlock *ib)
+{
+    u32 gip = ib->ip;
+    // Counted after the handler: trapping instructions don't retire
+    for (u32 i = 0; i < ib->n_insns; ++i) {
+        ib->insns[i].h(state, gip, vmem, ib->insns[i].raw);
+        state->instret++;
+    }
+    state->ip = gip;
+    ib->RecordSucc(gip);
+}
+
+void InterpTier::Execute(CPUState *state, u8 *vmem)
+{
+    ExecuteIBlock(state, vmem, iblock_cache.Lookup(state->ip));
+}
+
+bool InterpTier::ExecuteIfCold(CPUState *state, u8 *vmem)
+{
+    if (hot_threshold == 0)
+        return false;
+    auto *ib = iblock_cache.Lookup(state->ip);
+    if (ib->hotness >= hot_threshold)
+        return false;
+    ib->hotness++;
+    ExecuteIBlock(state, vmem, ib);
+    return true;
+}
+
+bool InterpTier::IsHot(u32 ip)
+{
+    if (hot_threshold == 0)
+        return true;
+    auto &map = iblock_cache.map;
+    auto it = map.find(ip);
+    return it != map.end() && it->second->hotness >= hot_threshold;
+}
+
+bool InterpTier::GetHotSuccessor(u32 ip, u32 *succ)
+{
+    auto &map = iblock_cache.map;
+    auto it = map.find(ip);
+    if (it == map.end())
+        return false;
+    auto &succs = it->second->succs;
+    auto &hot = succs[0].count >= succs[1].count ? succs[0] : succs[1];
+    if (hot.count * 2 <= succs[0].count + succs[1].count)
+        return false;
+    *succ = hot.ip;
+    return true;
+}
+
+void InterpTier::InvalidatePage(u32 pvaddr)
+{
+    auto &map = iblock_cache.map;
+    for (auto it = map.begin(); it != map.end();) {
+        if (rounddown(it->first, mmu::PAGE_SIZE) == pvaddr ||
+            CodeLastPage(it->first) == pvaddr)
+            it = map.erase(it);
+        else
+            ++it;
+    }
+}
+
+void InterpTier::Invalidate()
+{
+    iblock_cache.Flush();
+}
+
 }  // namespace dbt::rv32
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "guest/rv32_cpu.h"
+
+namespace dbt::rv32
+{
+// Interpreter tier, executes pre-decoded blocks over H_* handlers.
+// Decoded blocks are cached per thread and never cross a guest page.
+struct InterpTier {
+    // Interpret block at state->ip, state->ip points to the next block on
+    // return
+    static void Execute(CPUState *state, u8 *vmem);
+
+    // Same, but only while the block has been entered at most hot_threshold
+    // times. Returns false if the block is hot and should be compiled.
+    static bool ExecuteIfCold(CPUState *state, u8 *vmem);
+
+    // Block at ip would not be interpreted by ExecuteIfCold
+    static bool IsHot(u32 ip);
+
+    // Most frequent successor of the block at ip, if it dominates the
+    // recorded profile
+    static bool GetHotSuccessor(u32 ip, u32 *succ);
+
+    static void InvalidatePage(u32 pvaddr);
+    static void Invalidate();
+
+    static u32 hot_threshold;
+};
+
+}  // namespace dbt::rv32
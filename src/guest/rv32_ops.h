@@ -1,46 +1,192 @@
 #pragma once
 
-#define RV32_OPCODE_LIST()         \
-    OP(illegal, Base, Flags::Trap) \
-    /* RV32I */                    \
-    OP(lui, U, 0)                  \
-    OP(auipc, U, 0)                \
-    OP(jal, J, Flags::Branch)      \
-    OP(jalr, I, Flags::Branch)     \
-    OP(beq, B, Flags::Branch)      \
-    OP(bne, B, Flags::Branch)      \
-    OP(blt, B, Flags::Branch)      \
-    OP(bge, B, Flags::Branch)      \
-    OP(bltu, B, Flags::Branch)     \
-    OP(bgeu, B, Flags::Branch)     \
-    OP(lb, I, Flags::MayTrap)      \
-    OP(lh, I, Flags::MayTrap)      \
-    OP(lw, I, Flags::MayTrap)      \
-    OP(lbu, I, Flags::MayTrap)     \
-    OP(lhu, I, Flags::MayTrap)     \
-    OP(sb, S, Flags::MayTrap)      \
-    OP(sh, S, Flags::MayTrap)      \
-    OP(sw, S, Flags::MayTrap)      \
-    OP(addi, I, 0)                 \
-    OP(slti, I, 0)                 \
-    OP(sltiu, I, 0)                \
-    OP(xori, I, 0)                 \
-    OP(ori, I, 0)                  \
-    OP(andi, I, 0)                 \
-    OP(slli, IS, 0)                \
-    OP(srai, IS, 0)                \
-    OP(srli, IS, 0)                \
-    OP(sub, R, 0)                  \
-    OP(add, R, 0)                  \
-    OP(sll, R, 0)                  \
-    OP(slt, R, 0)                  \
-    OP(sltu, R, 0)                 \
-    OP(xor, R, 0)                  \
-    OP(sra, R, 0)                  \
-    OP(srl, R, 0)                  \
-    OP(or, R, 0)                   \
-    OP(and, R, 0)                  \
-    OP(fence, Base, 0)             \
-    OP(fencei, Base, 0)            \
-    OP(ecall, Base, Flags::Trap)   \
+#define RV32_OPCODE_LIST()           \
+    OP(illegal, Base, Flags::Trap)   \
+    /* RV32I */                      \
+    OP(lui, U, 0)                    \
+    OP(auipc, U, 0)                  \
+    OP(jal, J, Flags::Branch)        \
+    OP(jalr, I, Flags::Branch)       \
+    OP(beq, B, Flags::Branch)        \
+    OP(bne, B, Flags::Branch)        \
+    OP(blt, B, Flags::Branch)        \
+    OP(bge, B, Flags::Branch)        \
+    OP(bltu, B, Flags::Branch)       \
+    OP(bgeu, B, Flags::Branch)       \
+    OP(lb, I, Flags::MayTrap)        \
+    OP(lh, I, Flags::MayTrap)        \
+    OP(lw, I, Flags::MayTrap)        \
+    OP(lbu, I, Flags::MayTrap)       \
+    OP(lhu, I, Flags::MayTrap)       \
+    OP(sb, S, Flags::MayTrap)        \
+    OP(sh, S, Flags::MayTrap)        \
+    OP(sw, S, Flags::MayTrap)        \
+    OP(addi, I, 0)                   \
+    OP(slti, I, 0)                   \
+    OP(sltiu, I, 0)                  \
+    OP(xori, I, 0)                   \
+    OP(ori, I, 0)                    \
+    OP(andi, I, 0)                   \
+    OP(slli, IS, 0)                  \
+    OP(srai, IS, 0)                  \
+    OP(srli, IS, 0)                  \
+    OP(sub, R, 0)                    \
+    OP(add, R, 0)                    \
+    OP(sll, R, 0)                    \
+    OP(slt, R, 0)                    \
+    OP(sltu, R, 0)                   \
+    OP(xor, R, 0)                    \
+    OP(sra, R, 0)                    \
+    OP(srl, R, 0)                    \
+    OP(or, R, 0)                     \
+    OP(and, R, 0)                    \
+    /* RV32M */                      \
+    OP(mul, R, 0)                    \
+    OP(mulh, R, 0)                   \
+    OP(mulhsu, R, 0)                 \
+    OP(mulhu, R, 0)                  \
+    OP(div, R, 0)                    \
+    OP(divu, R, 0)                   \
+    OP(rem, R, 0)                    \
+    OP(remu, R, 0)                   \
+    /* RV32A */                      \
+    OP(lrw, A, 0)                    \
+    OP(scw, A, 0)                    \
+    OP(amoswapw, A, 0)               \
+    OP(amoaddw, A, 0)                \
+    OP(amoxorw, A, 0)                \
+    OP(amoandw, A, 0)                \
+    OP(amoorw, A, 0)                 \
+    OP(amominw, A, 0)                \
+    OP(amomaxw, A, 0)                \
+    OP(amominuw, A, 0)               \
+    OP(amomaxuw, A, 0)               \
+    /* Zba */                        \
+    OP(sh1add, R, 0)                 \
+    OP(sh2add, R, 0)                 \
+    OP(sh3add, R, 0)                 \
+    /* Zbb */                        \
+    OP(andn, R, 0)                   \
+    OP(orn, R, 0)                    \
+    OP(xnor, R, 0)                   \
+    OP(clz, R1, 0)                   \
+    OP(ctz, R1, 0)                   \
+    OP(cpop, R1, 0)                  \
+    OP(max, R, 0)                    \
+    OP(maxu, R, 0)                   \
+    OP(min, R, 0)                    \
+    OP(minu, R, 0)                   \
+    OP(sextb, R1, 0)                 \
+    OP(sexth, R1, 0)                 \
+    OP(zexth, R1, 0)                 \
+    OP(rol, R, 0)                    \
+    OP(ror, R, 0)                    \
+    OP(rori, IS, 0)                  \
+    OP(orcb, R1, 0)                  \
+    OP(rev8, R1, 0)                  \
+    /* Zbs */                        \
+    OP(bclr, R, 0)                   \
+    OP(bclri, IS, 0)                 \
+    OP(bext, R, 0)                   \
+    OP(bexti, IS, 0)                 \
+    OP(binv, R, 0)                   \
+    OP(binvi, IS, 0)                 \
+    OP(bset, R, 0)                   \
+    OP(bseti, IS, 0)                 \
+    /* RV32F */                      \
+    OP(flw, FI, Flags::MayTrap)      \
+    OP(fsw, FS, Flags::MayTrap)      \
+    OP(fmadds, FR4, 0)               \
+    OP(fmsubs, FR4, 0)               \
+    OP(fnmsubs, FR4, 0)              \
+    OP(fnmadds, FR4, 0)              \
+    OP(fadds, FR, 0)                 \
+    OP(fsubs, FR, 0)                 \
+    OP(fmuls, FR, 0)                 \
+    OP(fdivs, FR, 0)                 \
+    OP(fsqrts, FR, 0)                \
+    OP(fsgnjs, FR, 0)                \
+    OP(fsgnjns, FR, 0)               \
+    OP(fsgnjxs, FR, 0)               \
+    OP(fmins, FR, 0)                 \
+    OP(fmaxs, FR, 0)                 \
+    OP(fcvtws, FRX, 0)               \
+    OP(fcvtwus, FRX, 0)              \
+    OP(fmvxw, FRX, 0)                \
+    OP(feqs, FRX, 0)                 \
+    OP(flts, FRX, 0)                 \
+    OP(fles, FRX, 0)                 \
+    OP(fclasss, FRX, 0)              \
+    OP(fcvtsw, FXR, 0)               \
+    OP(fcvtswu, FXR, 0)              \
+    OP(fmvwx, FXR, 0)                \
+    /* RV32D */                      \
+    OP(fld, FI, Flags::MayTrap)      \
+    OP(fsd, FS, Flags::MayTrap)      \
+    OP(fmaddd, FR4, 0)               \
+    OP(fmsubd, FR4, 0)               \
+    OP(fnmsubd, FR4, 0)              \
+    OP(fnmaddd, FR4, 0)              \
+    OP(faddd, FR, 0)                 \
+    OP(fsubd, FR, 0)                 \
+    OP(fmuld, FR, 0)                 \
+    OP(fdivd, FR, 0)                 \
+    OP(fsqrtd, FR, 0)                \
+    OP(fsgnjd, FR, 0)                \
+    OP(fsgnjnd, FR, 0)               \
+    OP(fsgnjxd, FR, 0)               \
+    OP(fmind, FR, 0)                 \
+    OP(fmaxd, FR, 0)                 \
+    OP(fcvtsd, FR, 0)                \
+    OP(fcvtds, FR, 0)                \
+    OP(feqd, FRX, 0)                 \
+    OP(fltd, FRX, 0)                 \
+    OP(fled, FRX, 0)                 \
+    OP(fclassd, FRX, 0)              \
+    OP(fcvtwd, FRX, 0)               \
+    OP(fcvtwud, FRX, 0)              \
+    OP(fcvtdw, FXR, 0)               \
+    OP(fcvtdwu, FXR, 0)              \
+    /* RVV */                        \
+    OP(vsetvli, VCFG, 0)             \
+    OP(vsetivli, VCFGI, 0)           \
+    OP(vsetvl, R, 0)                 \
+    OP(vle8v, VLS, Flags::MayTrap)   \
+    OP(vle16v, VLS, Flags::MayTrap)  \
+    OP(vle32v, VLS, Flags::MayTrap)  \
+    OP(vse8v, VLS, Flags::MayTrap)   \
+    OP(vse16v, VLS, Flags::MayTrap)  \
+    OP(vse32v, VLS, Flags::MayTrap)  \
+    OP(vaddvv, VV, Flags::MayTrap)   \
+    OP(vaddvx, VX, Flags::MayTrap)   \
+    OP(vaddvi, VI, Flags::MayTrap)   \
+    OP(vsubvv, VV, Flags::MayTrap)   \
+    OP(vsubvx, VX, Flags::MayTrap)   \
+    OP(vmulvv, VV, Flags::MayTrap)   \
+    OP(vmulvx, VX, Flags::MayTrap)   \
+    OP(vandvv, VV, Flags::MayTrap)   \
+    OP(vandvx, VX, Flags::MayTrap)   \
+    OP(vandvi, VI, Flags::MayTrap)   \
+    OP(vorvv, VV, Flags::MayTrap)    \
+    OP(vorvx, VX, Flags::MayTrap)    \
+    OP(vorvi, VI, Flags::MayTrap)    \
+    OP(vxorvv, VV, Flags::MayTrap)   \
+    OP(vxorvx, VX, Flags::MayTrap)   \
+    OP(vxorvi, VI, Flags::MayTrap)   \
+    OP(vredsum, VV, Flags::MayTrap)  \
+    OP(vmvvv, VV, Flags::MayTrap)    \
+    OP(vmvvx, VX, Flags::MayTrap)    \
+    OP(vmvvi, VI, Flags::MayTrap)    \
+    OP(vmvxs, VXS, Flags::MayTrap)   \
+    OP(vmvsx, VX, Flags::MayTrap)    \
+    /* Zicsr */                      \
+    OP(csrrw, CSR, Flags::MayTrap)   \
+    OP(csrrs, CSR, Flags::MayTrap)   \
+    OP(csrrc, CSR, Flags::MayTrap)   \
+    OP(csrrwi, CSRI, Flags::MayTrap) \
+    OP(csrrsi, CSRI, Flags::MayTrap) \
+    OP(csrrci, CSRI, Flags::MayTrap) \
+    OP(fence, Base, 0)               \
+    OP(fencei, Base, Flags::Branch)  \
+    OP(ecall, Base, Flags::Trap)     \
     OP(ebreak, Base, Flags::Trap)
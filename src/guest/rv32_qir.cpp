@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <bit>
+
 #include "guest/rv32_qir.h"
+#include "codegen/qcg.h"
 #include "guest/rv32_cpu.h"
 #include "guest/rv32_decode.h"
 #include "guest/rv32_ops.h"
+#include "mmu.h"
 
 namespace dbt::qir::rv32
 {
@@ -11,7 +16,9 @@ enum {
     GPR_START = 0,
     GPR_END = 31,
     IP = GPR_END,
-    END,
+    FPR_START = IP + 1,
+    FPR_END = FPR_START + 32,
+    END = FPR_END,
 };
 }
 
@@ -38,6 +45,89 @@ static inline VOperand gprop(u8 id, VType type = VType::I32)
     return vgpr(id, type);
 }
 
+// FPR globals are F64, F32 operands access the low half
+static inline VOperand vfpr(u8 id, VType type)
+{
+    return VOperand::MakeVFPR(type, GlobalRegId::FPR_START + id);
+}
+
+// Vector registers are accessed in state as well, groups are adjacent
+static inline VOperand vvreg(u8 id, VType type)
+{
+    u16 offs = offsetof(CPUState, vreg) + CPUState::VLENB * id;
+    return VOperand::MakeSlot(true, type, offs);
+}
+
+static inline VOperand vvl()
+{
+    return VOperand::MakeSlot(true, VType::I32, offsetof(CPUState, vl));
+}
+
+static inline VOperand vvtype()
+{
+    return VOperand::MakeSlot(true, VType::I32, offsetof(CPUState, vtype));
+}
+
+static inline VType VSewType(u32 vtype)
+{
+    switch (insn::VTYPE::SEWBytes(vtype)) {
+    case 1:
+        return VType::I8;
+    case 2:
+        return VType::I16;
+    default:
+        return VType::I32;
+    }
+}
+
+// Guest registers accessed by instruction, x0 included
+struct RegUsage {
+    u32 uses;
+    u32 defs;
+    u32 flags;
+    u32 fuses{0};
+    u32 fdefs{0};
+};
+
+template <typename I>
+static RegUsage GetRegUsage(u32 raw)
+{
+    I i{raw};
+    RegUsage u{0, 0, I::flags};
+    if constexpr (requires { i.rs1(); })
+        u.uses |= 1u << i.rs1();
+    if constexpr (requires { i.rs2(); })
+        u.uses |= 1u << i.rs2();
+    if constexpr (requires { i.rd(); })
+        u.defs |= 1u << i.rd();
+    if constexpr (requires { i.frs1(); })
+        u.fuses |= 1u << i.frs1();
+    if constexpr (requires { i.frs2(); })
+        u.fuses |= 1u << i.frs2();
+    if constexpr (requires { i.frs3(); })
+        u.fuses |= 1u << i.frs3();
+    if constexpr (requires { i.frd(); })
+        u.fdefs |= 1u << i.frd();
+    return u;
+}
+
+static GlobalsMask ToGlobalsMask(u32 gprs, u32 fprs)
+{
+    GlobalsMask mask = 0;
+    for (u8 r = 1; r < 32; ++r) {
+        if (gprs & (1u << r))
+            mask |= (GlobalsMask) 1 << (GlobalRegId::GPR_START + r - 1);
+    }
+    return mask | ((GlobalsMask) fprs << GlobalRegId::FPR_START);
+}
+
+struct RegUsageProvider {
+#define OP(name, format_, flags_) \
+    static constexpr auto _##name = &GetRegUsage<insn::Insn_##name>;
+    RV32_OPCODE_LIST()
+#undef OP
+};
+
 StateInfo const *RV32Translator::GetStateInfo()
 {
     static std::array<StateReg, GlobalRegId::END> state_regs{};
@@ -49,13 +139,20 @@ StateInfo const *RV32Translator::GetStateInfo()
         state_regs[vreg_no] = StateReg{offs, VType::I32};
     }
     state_regs[GlobalRegId::IP] = StateReg{offsetof(CPUState, ip), VType::I32};
+    for (u8 i = 0; i < 32; ++i) {
+        u16 offs = offsetof(CPUState, fpr) + sizeof(CPUState::fpr_t) * i;
+        state_regs[GlobalRegId::FPR_START + i] = StateReg{offs, VType::F64};
+    }
 
     return &state_info;
 }
 StateInfo const *const RV32Translator::state_info = GetStateInfo();
 
 RV32Translator::RV32Translator(UNUSED qir::Region *region_, uptr vmem)
-    : qb(), vmem_base(vmem)
+    : qb(),
+      vmem_base(vmem),
+      vector_ops(qcg::HasVectorOps()),
+      fround_ops(qcg::HasFRoundOps())
 {
 }
 
@@ -75,9 +172,13 @@ void RV32Translator::Translate(qir::Region *region,
 void RV32Translator::TranslateIPRange(u32 ip, u32 boundary_ip)
 {
     insn_ip = ip;
+    range_ip = ip;
+    icount_pending = 0;
+    fpr_boxed = 0;
     assert(boundary_ip != 0);
 
     qb = qir::Builder(ip2bb.find(ip)->second);
+    vtype = insn::VTYPE::VILL;
 
     u32 num_insns = 0;
     control = Control::NEXT;
@@ -88,12 +189,22 @@ void RV32Translator::TranslateIPRange(u32 ip, u32 boundary_ip)
             break;
         if (num_insns == TB_MAX_INSNS || insn_ip >= boundary_ip) {
             control = Control::TB_OVF;
+            FlushICount(0);
             MakeGBr(insn_ip);
             break;
         }
     }
 }
 
+// instret is bumped before exits by instructions retired since the last
+// flush, plus extra ones ending the range
+void RV32Translator::FlushICount(u32 extra)
+{
+    if (u32 n = icount_pending + extra)
+        qb.Create_icount(n);
+    icount_pending = 0;
+}
+
 // TODO: move to late qir pass?
 void RV32Translator::PreSideeff()
 {
@@ -104,10 +215,10 @@ void RV32Translator::PreSideeff()
 
 void RV32Translator::TranslateInsn()
 {
-    auto *insn_ptr = (u32 *) (vmem_base + insn_ip);
+    auto raw = insn::Fetch((void *) (vmem_base + insn_ip));
 
     using decoder = insn::Decoder<RV32Translator>;
-    (this->*decoder::Decode(insn_ptr))(insn_ptr);
+    (this->*decoder::Decode(raw))(raw);
 }
 
 void RV32Translator::MakeGBr(u32 ip)
@@ -117,8 +228,39 @@ void RV32Translator::MakeGBr(u32 ip)
         qb.Create_br();
         qb.GetBlock()->AddSucc(it->second);
     } else {
-        qb.Create_gbr(vconst(ip));
+        qb.Create_gbr(vconst(ip), ScanLiveGlobals(ip));
+    }
+}
+
+// Conservative set of globals live at direct branch target: registers written
+// before read up to the first control transfer are dead. Only targets in the
+// page of the current range are scanned, so any modification of the scanned
+// code invalidates this region too
+GlobalsMask RV32Translator::ScanLiveGlobals(u32 ip)
+{
+    u32 page = rounddown(ip, mmu::PAGE_SIZE);
+    if (page != rounddown(range_ip, mmu::PAGE_SIZE))
+        return GlobalsAll;
+
+    u32 used = 0, killed = 0;
+    u32 fused = 0, fkilled = 0;
+    for (u32 n = 0; n < TB_MAX_INSNS && ip < page + mmu::PAGE_SIZE; ++n) {
+        auto raw = insn::Fetch((void *) (vmem_base + ip));
+        using decoder = insn::Decoder<RegUsageProvider>;
+        auto u = decoder::Decode(raw)(raw);
+
+        if (u.flags & insn::Flags::Trap)
+            break;
+        used |= u.uses & ~killed;
+        killed |= u.defs & ~used;
+        fused |= u.fuses & ~fkilled;
+        fkilled |= u.fdefs & ~fused;
+        if (u.flags & insn::Flags::Branch)
+            break;
+        ip += insn::Length(raw);
     }
+
+    return GlobalsAll & ~ToGlobalsMask(killed, fkilled);
 }
 
 void RV32Translator::TranslateBrcc(rv32::insn::B i, CondCode cc)
@@ -129,12 +271,12 @@ void RV32Translator::TranslateBrcc(rv32::insn::B i, CondCode cc)
         if (it != ip2bb.end())
             return it->second;
         qb = Builder(qb.CreateBlock());
-        qb.Create_gbr(vconst(ip));
+        qb.Create_gbr(vconst(ip), ScanLiveGlobals(ip));
         return qb.GetBlock();
     };
 
     auto bb_src = qb.GetBlock();
-    auto bb_f = make_target(insn_ip + 4);
+    auto bb_f = make_target(insn_ip + insn::Length(i.raw));
     auto bb_t = make_target(insn_ip + i.imm());
     qb = Builder(bb_src);
 
@@ -153,7 +295,7 @@ void RV32Translator::TranslateBrcc(rv32::insn::B i, CondCode cc)
     MakeGBr(insn_ip + i.imm());
 
     qb = Builder(bb_f);
-    MakeGBr(insn_ip + 4);
+    MakeGBr(insn_ip + insn::Length(i.raw));
 #endif
 }
 
@@ -197,31 +339,275 @@ void RV32Translator::TranslateStore(insn::S i, VType type, VSign sgn)
     qb.Create_vmstore(type, sgn, addr, gprop(i.rs2(), type));
 }
 
-inline void RV32Translator::TranslateHelper(insn::Base i, RuntimeStubId stub)
+// Result of dead-rd atomics is discarded in a temp
+inline VOperand RV32Translator::AtomicDst(insn::A i)
 {
-    qb.Create_hcall(stub, vconst(i.raw));
+    return i.rd() ? vgpr(i.rd()) : vtemp(qb);
 }
 
-#define TRANSLATOR(name)                                  \
-    void RV32Translator::H_##name(void *insn)             \
-    {                                                     \
-        insn::Insn_##name i{*(u32 *) insn};               \
-        static constexpr auto flags = decltype(i)::flags; \
-        if constexpr (flags & insn::Flags::Trap ||        \
-                      flags & insn::Flags::MayTrap) {     \
-            PreSideeff();                                 \
-        }                                                 \
-        V_##name(i);                                      \
-        if constexpr (flags & insn::Flags::Branch ||      \
-                      flags & insn::Flags::Trap) {        \
-            control = RV32Translator::Control::BRANCH;    \
-        }                                                 \
-        insn_ip += 4;                                     \
-    }                                                     \
-    ALWAYS_INLINE void RV32Translator::V_##name(UNUSED insn::Insn_##name i)
+void RV32Translator::TranslateAtomic(insn::A i, Op op)
+{
+    qb.CreateInstVMAtomic(op, AtomicDst(i), gprop(i.rs1()), gprop(i.rs2()));
+}
+
+// Singles which are not known to be NaN-boxed are unboxed, so that they
+// read as canonical NaN like in the interpreter
+VOperand RV32Translator::FInput(u8 id, VType type)
+{
+    if (type == VType::F64 || (fpr_boxed & (1u << id)))
+        return vfpr(id, type);
+    auto tmp = VOperand::MakeVFPR(type, qb.CreateVGPR(type));
+    qb.Create_funbox(tmp, vfpr(id, type));
+    return tmp;
+}
+
+// Inputs of the instruction must be taken before
+VOperand RV32Translator::FOutput(u8 id, VType type)
+{
+    if (type == VType::F32)
+        fpr_boxed |= 1u << id;
+    else
+        fpr_boxed &= ~(1u << id);
+    return vfpr(id, type);
+}
+
+void RV32Translator::TranslateFLoad(insn::FI i, VType type)
+{
+    VOperand addr = gprop(i.rs1());
+
+    if (i.imm()) {
+        auto tmp = vtemp(qb);
+        qb.Create_add(tmp, addr, vconst(i.imm()));
+        addr = tmp;
+    }
+    qb.Create_vmfload(FOutput(i.frd(), type), addr);
+}
+
+// Singles are stored as is, NaN-boxed or not
+void RV32Translator::TranslateFStore(insn::FS i, VType type)
+{
+    VOperand addr = gprop(i.rs1());
+
+    if (i.imm()) {
+        auto tmp = vtemp(qb);
+        qb.Create_add(tmp, addr, vconst(i.imm()));
+        addr = tmp;
+    }
+    qb.Create_vmfstore(addr, vfpr(i.frs2(), type));
+}
+
+void RV32Translator::TranslateFBinop(insn::FR i, Op op, VType type)
+{
+    auto s1 = FInput(i.frs1(), type);
+    auto s2 = FInput(i.frs2(), type);
+    qb.CreateInstFBinop(op, FOutput(i.frd(), type), s1, s2);
+}
+
+// funct3 selects the sign injection variant
+void RV32Translator::TranslateFSgnj(insn::FR i, VType type)
+{
+    static constexpr std::array<Op, 3> ops = {Op::_fsgnj, Op::_fsgnjn,
+                                              Op::_fsgnjx};
+    assert(i.rm() < ops.size());
+    TranslateFBinop(i, ops[i.rm()], type);
+}
+
+/* RVV: vtype set by vsetvli with immediate vtypei is tracked through the range.
+ * Unmasked ops on known vtype with groups of 128 or 256 bits are translated
+ * to native vector ops, the rest is left to helpers
+ */
+VType RV32Translator::VGroupType(std::initializer_list<u8> regs) const
+{
+    if (!vector_ops || (vtype & insn::VTYPE::VILL))
+        return VType::UNDEF;
+    u32 lmul = insn::VTYPE::LMUL(vtype);
+    for (auto r : regs) {
+        if (r % lmul)
+            return VType::UNDEF;
+    }
+    switch (CPUState::VLENB * lmul) {
+    case 16:
+        return VType::V128;
+    case 32:
+        return VType::V256;
+    default:
+        return VType::UNDEF;
+    }
+}
+
+// Index of the mask of tail bytes in CPUState::vtail_mask
+VOperand RV32Translator::VTailIdx()
+{
+    auto nbytes = vtemp(qb);
+    auto tidx = vtemp(qb);
+    qb.Create_mov(nbytes, vvl());
+    if (u32 sh = std::countr_zero(insn::VTYPE::SEWBytes(vtype)))
+        qb.Create_sll(nbytes, nbytes, vconst(sh));
+    qb.Create_sub(tidx, vconst(32), nbytes);
+    return tidx;
+}
+
+// avl is vl if rd and rs1 are x0, returns false if vtypei is unsupported
+bool RV32Translator::TranslateVSetVl(u8 rd, VOperand avl, u32 vtypei)
+{
+    u32 new_vtype = insn::VTYPE::Check(vtypei);
+    if (new_vtype & insn::VTYPE::VILL)
+        return false;
+    u32 vlmax = insn::VTYPE::VLMAX(new_vtype, CPUState::VLENB);
+
+    VOperand vl;
+    if (avl.IsConst()) {
+        vl = vconst(std::min(avl.GetConst(), vlmax));
+    } else {
+        if (avl.IsSlot()) {
+            auto tmp = vtemp(qb);
+            qb.Create_mov(tmp, avl);
+            avl = tmp;
+        }
+        vl = vtemp(qb);
+        qb.Create_minu(vl, avl, vconst(vlmax));
+    }
+    qb.Create_mov(vvl(), vl);
+    qb.Create_mov(vvtype(), vconst(new_vtype));
+    if (rd)
+        qb.Create_mov(vgpr(rd), vl);
+    vtype = new_vtype;
+    return true;
+}
+
+template <typename I>
+void RV32Translator::TranslateVBinop(I i, Op op, RuntimeStubId stub)
+{
+    VType type;
+    if constexpr (requires { i.vs1(); })
+        type = VGroupType({i.vd(), i.vs1(), i.vs2()});
+    else
+        type = VGroupType({i.vd(), i.vs2()});
+    auto sew = VSewType(vtype);
+    if (type == VType::UNDEF || !i.vm() ||
+        (op == Op::_vecmul && sew == VType::I8)) {
+        TranslateHelper(i, stub);
+        return;
+    }
+
+    VOperand src;
+    if constexpr (requires { i.vs1(); })
+        src = vvreg(i.vs1(), type);
+    else if constexpr (requires { i.rs1(); })
+        src = gprop(i.rs1());
+    else
+        src = vconst(i.simm());
+    auto tidx = VTailIdx();
+    qb.CreateInstVecBinop(op, sew, vvreg(i.vd(), type), vvreg(i.vs2(), type),
+                          src, tidx);
+}
+
+// Whole group is accessed natively if vl is VLMAX, helper handles the rest
+template <typename I>
+void RV32Translator::TranslateVMem(I i,
+                                   u32 eew,
+                                   bool is_load,
+                                   RuntimeStubId stub)
+{
+    auto type = VGroupType({i.vd()});
+    if (type == VType::UNDEF || !i.vm() ||
+        eew != insn::VTYPE::SEWBytes(vtype)) {
+        TranslateHelper(i, stub);
+        return;
+    }
+
+    auto bb_fast = qb.CreateBlock();
+    auto bb_slow = qb.CreateBlock();
+    auto bb_join = qb.CreateBlock();
+    auto vl = vtemp(qb);
+    qb.Create_mov(vl, vvl());
+    qb.Create_brcc(CondCode::EQ, vl,
+                   vconst(insn::VTYPE::VLMAX(vtype, CPUState::VLENB)));
+    qb.GetBlock()->AddSucc(bb_fast);
+    qb.GetBlock()->AddSucc(bb_slow);
+
+    qb = Builder(bb_fast);
+    if (is_load)
+        qb.Create_vecld(vvreg(i.vd(), type), gprop(i.rs1()));
+    else
+        qb.Create_vecst(gprop(i.rs1()), vvreg(i.vd(), type));
+    qb.Create_br();
+    qb.GetBlock()->AddSucc(bb_join);
+
+    qb = Builder(bb_slow);
+    TranslateHelper(i, stub);
+    qb.Create_br();
+    qb.GetBlock()->AddSucc(bb_join);
 
-#define TRANSLATOR_Unimpl(name) \
-    TRANSLATOR(name) { dbt::Panic("Unimplemented instruction " #name); }
+    qb = Builder(bb_join);
+}
+
+// Reads of counter CSRs without side effects, false if csr is not a counter
+bool RV32Translator::TranslateCounterRead(u8 rd, u16 csr)
+{
+    bool hi = csr & 0x80;
+    switch (csr & ~0x80) {
+    case insn::CSRNo::CYCLE:
+    case insn::CSRNo::TIME:
+        if (rd) {
+            bool scaled = (csr & ~0x80) == insn::CSRNo::TIME;
+            qb.Create_rdtsc(scaled, hi, vgpr(rd));
+        }
+        return true;
+    case insn::CSRNo::INSTRET:
+        if (rd) {
+            u16 offs = offsetof(CPUState, instret) + (hi ? 4 : 0);
+            qb.Create_mov(vgpr(rd), VOperand::MakeSlot(true, VType::I32, offs));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Stubs observe guest registers they access, trapping ones observe all
+template <typename I>
+inline void RV32Translator::TranslateHelper(I i, RuntimeStubId stub)
+{
+    auto u = GetRegUsage<I>(i.raw);
+    bool traps = u.flags & (insn::Flags::Trap | insn::Flags::MayTrap);
+    qb.Create_hcall(stub, vconst(i.raw),
+                    traps ? GlobalsAll : ToGlobalsMask(u.uses, u.fuses),
+                    ToGlobalsMask(u.defs, u.fdefs));
+    fpr_boxed &= ~u.fdefs;
+}
+
+// Counter CSRs observe instret up to the previous instruction
+template <typename I>
+static constexpr bool IsCSRInsn =
+    std::is_base_of_v<insn::CSR, I> || std::is_base_of_v<insn::CSRI, I>;
+
+// Branches retire before leaving the range, traps don't retire
+#define TRANSLATOR(name)                                       \
+    void RV32Translator::H_##name(u32 raw)                     \
+    {                                                          \
+        insn::Insn_##name i{raw};                              \
+        static constexpr auto flags = decltype(i)::flags;      \
+        if constexpr (flags & insn::Flags::Trap ||             \
+                      flags & insn::Flags::MayTrap) {          \
+            PreSideeff();                                      \
+        }                                                      \
+        if constexpr (flags & insn::Flags::Branch) {           \
+            FlushICount(1);                                    \
+        } else if constexpr (flags & insn::Flags::Trap ||      \
+                             IsCSRInsn<decltype(i)>) {         \
+            FlushICount(0);                                    \
+        }                                                      \
+        V_##name(i);                                           \
+        if constexpr (!(flags & insn::Flags::Branch))          \
+            icount_pending++;                                  \
+        if constexpr (flags & insn::Flags::Branch ||           \
+                      flags & insn::Flags::Trap) {             \
+            control = RV32Translator::Control::BRANCH;         \
+        }                                                      \
+        insn_ip += insn::Length(raw);                          \
+    }                                                          \
+    ALWAYS_INLINE void RV32Translator::V_##name(UNUSED insn::Insn_##name i)
 
 #define TRANSLATOR_ArithmRI(name, op)                                      \
     TRANSLATOR(name)                                                       \
@@ -249,10 +635,106 @@ inline void RV32Translator::TranslateHelper(insn::Base i, RuntimeStubId stub)
 #define TRANSLATOR_Store(name, type, sgn) \
     TRANSLATOR(name) { TranslateStore(i, VType::type, VSign::sgn); }
 
+#define TRANSLATOR_Atomic(name, op) \
+    TRANSLATOR(name) { TranslateAtomic(i, Op::_##op); }
+
+#define TRANSLATOR_Unop(name, op)                         \
+    TRANSLATOR(name)                                      \
+    {                                                     \
+        if (i.rd())                                       \
+            qb.Create_##op(vgpr(i.rd()), gprop(i.rs1())); \
+    }
+
+#define TRANSLATOR_ShAdd(name, sh)                        \
+    TRANSLATOR(name)                                      \
+    {                                                     \
+        if (!i.rd())                                      \
+            return;                                       \
+        auto tmp = vtemp(qb);                             \
+        qb.Create_sll(tmp, gprop(i.rs1()), vconst(sh));   \
+        qb.Create_add(vgpr(i.rd()), tmp, gprop(i.rs2())); \
+    }
+
 #define TRANSLATOR_Helper(name) \
     TRANSLATOR(name) { TranslateHelper(i, RuntimeStubId::id_rv32_##name); }
 
-TRANSLATOR_Unimpl(illegal);
+// Host rounding follows frm, static rounding modes are left to helpers
+#define TRANSLATOR_FBinop(name, op, type)                             \
+    TRANSLATOR(name)                                                  \
+    {                                                                 \
+        if (i.rm() != insn::RM::DYN)                                  \
+            return TranslateHelper(i, RuntimeStubId::id_rv32_##name); \
+        TranslateFBinop(i, Op::_##op, VType::type);                   \
+    }
+
+#define TRANSLATOR_FMinMax(name, op, type) \
+    TRANSLATOR(name) { TranslateFBinop(i, Op::_##op, VType::type); }
+
+#define TRANSLATOR_FSqrt(name, type)                                  \
+    TRANSLATOR(name)                                                  \
+    {                                                                 \
+        if (i.rm() != insn::RM::DYN)                                  \
+            return TranslateHelper(i, RuntimeStubId::id_rv32_##name); \
+        auto s = FInput(i.frs1(), VType::type);                       \
+        qb.Create_fsqrt(FOutput(i.frd(), VType::type), s);            \
+    }
+
+#define TRANSLATOR_FSgnj(name, type) \
+    TRANSLATOR(name) { TranslateFSgnj(i, VType::type); }
+
+// Compare results are computed even if rd is x0, for exception flags
+#define TRANSLATOR_FCmp(name, cc, type)                                  \
+    TRANSLATOR(name)                                                     \
+    {                                                                    \
+        auto s1 = FInput(i.frs1(), VType::type);                         \
+        auto s2 = FInput(i.frs2(), VType::type);                         \
+        qb.Create_fcmp(CondCode::cc, i.rd() ? vgpr(i.rd()) : vtemp(qb), \
+                       s1, s2);                                          \
+    }
+
+// Static rounding modes with a host lowering, RMM and DYN use helpers
+static bool GetFRound(u8 rm, bool fround_ops, FRound *out)
+{
+    switch (rm) {
+    case insn::RM::RTZ:
+        *out = FRound::ZERO;
+        return true;
+    case insn::RM::RNE:
+        *out = FRound::NEAREST;
+        return fround_ops;
+    case insn::RM::RDN:
+        *out = FRound::DOWN;
+        return fround_ops;
+    case insn::RM::RUP:
+        *out = FRound::UP;
+        return fround_ops;
+    default:
+        return false;
+    }
+}
+
+#define TRANSLATOR_FCvtToInt(name, type)                                  \
+    TRANSLATOR(name)                                                      \
+    {                                                                     \
+        FRound rm;                                                        \
+        if (!GetFRound(i.rm(), fround_ops, &rm))                          \
+            return TranslateHelper(i, RuntimeStubId::id_rv32_##name);     \
+        auto s = FInput(i.frs1(), VType::type);                           \
+        qb.Create_fcvtfi(VSign::S, rm, i.rd() ? vgpr(i.rd()) : vtemp(qb), \
+                         s);                                              \
+    }
+
+#define TRANSLATOR_FCvtFromInt(name, type, sgn)                       \
+    TRANSLATOR(name)                                                  \
+    {                                                                 \
+        if (i.rm() != insn::RM::DYN)                                  \
+            return TranslateHelper(i, RuntimeStubId::id_rv32_##name); \
+        qb.Create_fcvtif(VSign::sgn, FOutput(i.frd(), VType::type),   \
+                         gprop(i.rs1()));                             \
+    }
+
+// Raises ILLEGAL_INSN like the interpreter, e.g. for reserved RVC encodings
+TRANSLATOR_Helper(illegal);
 TRANSLATOR(lui)
 {
     if (i.rd())
@@ -263,11 +745,22 @@ TRANSLATOR(auipc)
     if (i.rd())
         qb.Create_mov(vgpr(i.rd()), vconst(i.imm() + insn_ip));
 }
+// Return address stack hints: link register in rd is a call, in rs1 of
+// jalr without link is a return. jalr with different link registers in rd
+// and rs1 is a coroutine swap, pops and then pushes
+static inline bool IsLinkReg(u8 r)
+{
+    return r == 1 || r == 5;
+}
+
 TRANSLATOR(jal)
 {
     // TODO: check alignment
+    u32 ret_ip = insn_ip + insn::Length(i.raw);
     if (i.rd())
-        qb.Create_mov(vgpr(i.rd()), vconst(insn_ip + 4));
+        qb.Create_mov(vgpr(i.rd()), vconst(ret_ip));
+    if (IsLinkReg(i.rd()))
+        qb.Create_raspush(ret_ip);
 
     MakeGBr(insn_ip + i.imm());
 }
@@ -280,10 +773,19 @@ TRANSLATOR(jalr)
     qb.Create_add(tgt, gprop(i.rs1()), vconst(i.imm()));
     qb.Create_and(tgt, tgt, vconst(~(u32) 1));
 
+    u32 ret_ip = insn_ip + insn::Length(i.raw);
     if (i.rd())
-        qb.Create_mov(vgpr(i.rd()), vconst(insn_ip + 4));
+        qb.Create_mov(vgpr(i.rd()), vconst(ret_ip));
 
-    qb.Create_gbrind(tgt);
+    bool call = IsLinkReg(i.rd());
+    bool ret = IsLinkReg(i.rs1()) && i.rs1() != i.rd();
+    if (call && ret) {
+        qb.Create_gbrind(tgt, true, true, ret_ip);
+        return;
+    }
+    if (call)
+        qb.Create_raspush(ret_ip);
+    qb.Create_gbrind(tgt, ret);
 }
 TRANSLATOR_Brcc(beq, EQ);
 TRANSLATOR_Brcc(bne, NE);
@@ -318,9 +820,299 @@ TRANSLATOR_ArithmRR(sra, sra);
 TRANSLATOR_ArithmRR(srl, srl);
 TRANSLATOR_ArithmRR(or, or);
 TRANSLATOR_ArithmRR(and, and);
+TRANSLATOR_ArithmRR(mul, mul);
+TRANSLATOR_ArithmRR(mulh, mulh);
+TRANSLATOR_ArithmRR(mulhsu, mulhsu);
+TRANSLATOR_ArithmRR(mulhu, mulhu);
+TRANSLATOR_ArithmRR(div, div);
+TRANSLATOR_ArithmRR(divu, divu);
+TRANSLATOR_ArithmRR(rem, rem);
+TRANSLATOR_ArithmRR(remu, remu);
+TRANSLATOR(lrw)
+{
+    qb.Create_vmlr(AtomicDst(i), gprop(i.rs1()));
+}
+TRANSLATOR(scw)
+{
+    qb.Create_vmsc(AtomicDst(i), gprop(i.rs1()), gprop(i.rs2()));
+}
+TRANSLATOR_Atomic(amoswapw, amoswap);
+TRANSLATOR_Atomic(amoaddw, amoadd);
+TRANSLATOR_Atomic(amoxorw, amoxor);
+TRANSLATOR_Atomic(amoandw, amoand);
+TRANSLATOR_Atomic(amoorw, amoor);
+TRANSLATOR_Atomic(amominw, amomin);
+TRANSLATOR_Atomic(amomaxw, amomax);
+TRANSLATOR_Atomic(amominuw, amominu);
+TRANSLATOR_Atomic(amomaxuw, amomaxu);
+TRANSLATOR_ShAdd(sh1add, 1);
+TRANSLATOR_ShAdd(sh2add, 2);
+TRANSLATOR_ShAdd(sh3add, 3);
+TRANSLATOR_ArithmRR(andn, andn);
+TRANSLATOR(orn)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_xor(tmp, gprop(i.rs2()), vconst(-1));
+    qb.Create_or(vgpr(i.rd()), gprop(i.rs1()), tmp);
+}
+TRANSLATOR(xnor)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_xor(tmp, gprop(i.rs1()), gprop(i.rs2()));
+    qb.Create_xor(vgpr(i.rd()), tmp, vconst(-1));
+}
+TRANSLATOR_Unop(clz, clz);
+TRANSLATOR_Unop(ctz, ctz);
+TRANSLATOR_Unop(cpop, cpop);
+TRANSLATOR_ArithmRR(max, max);
+TRANSLATOR_ArithmRR(maxu, maxu);
+TRANSLATOR_ArithmRR(min, min);
+TRANSLATOR_ArithmRR(minu, minu);
+TRANSLATOR(sextb)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_sll(tmp, gprop(i.rs1()), vconst(24));
+    qb.Create_sra(vgpr(i.rd()), tmp, vconst(24));
+}
+TRANSLATOR(sexth)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_sll(tmp, gprop(i.rs1()), vconst(16));
+    qb.Create_sra(vgpr(i.rd()), tmp, vconst(16));
+}
+TRANSLATOR(zexth)
+{
+    if (i.rd())
+        qb.Create_and(vgpr(i.rd()), gprop(i.rs1()), vconst(0xffff));
+}
+TRANSLATOR_ArithmRR(rol, rol);
+TRANSLATOR_ArithmRR(ror, ror);
+TRANSLATOR_ArithmRI(rori, ror);
+TRANSLATOR_Helper(orcb);
+TRANSLATOR_Unop(rev8, bswap);
+TRANSLATOR_ArithmRR(bclr, bclr);
+TRANSLATOR_ArithmRI(bclri, bclr);
+TRANSLATOR(bext)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_srl(tmp, gprop(i.rs1()), gprop(i.rs2()));
+    qb.Create_and(vgpr(i.rd()), tmp, vconst(1));
+}
+TRANSLATOR(bexti)
+{
+    if (!i.rd())
+        return;
+    auto tmp = vtemp(qb);
+    qb.Create_srl(tmp, gprop(i.rs1()), vconst(i.imm()));
+    qb.Create_and(vgpr(i.rd()), tmp, vconst(1));
+}
+TRANSLATOR_ArithmRR(binv, binv);
+TRANSLATOR_ArithmRI(binvi, binv);
+TRANSLATOR_ArithmRR(bset, bset);
+TRANSLATOR_ArithmRI(bseti, bset);
+TRANSLATOR(flw)
+{
+    TranslateFLoad(i, VType::F32);
+}
+TRANSLATOR(fsw)
+{
+    TranslateFStore(i, VType::F32);
+}
+TRANSLATOR_Helper(fmadds);
+TRANSLATOR_Helper(fmsubs);
+TRANSLATOR_Helper(fnmsubs);
+TRANSLATOR_Helper(fnmadds);
+TRANSLATOR_FBinop(fadds, fadd, F32);
+TRANSLATOR_FBinop(fsubs, fsub, F32);
+TRANSLATOR_FBinop(fmuls, fmul, F32);
+TRANSLATOR_FBinop(fdivs, fdiv, F32);
+TRANSLATOR_FSqrt(fsqrts, F32);
+TRANSLATOR_FSgnj(fsgnjs, F32);
+TRANSLATOR_FSgnj(fsgnjns, F32);
+TRANSLATOR_FSgnj(fsgnjxs, F32);
+TRANSLATOR_FMinMax(fmins, fmin, F32);
+TRANSLATOR_FMinMax(fmaxs, fmax, F32);
+TRANSLATOR_FCvtToInt(fcvtws, F32);
+TRANSLATOR_Helper(fcvtwus);
+TRANSLATOR(fmvxw)
+{
+    if (i.rd())
+        qb.Create_fmvfi(vgpr(i.rd()), vfpr(i.frs1(), VType::F32));
+}
+TRANSLATOR_FCmp(feqs, EQ, F32);
+TRANSLATOR_FCmp(flts, LT, F32);
+TRANSLATOR_FCmp(fles, LE, F32);
+TRANSLATOR_Helper(fclasss);
+TRANSLATOR_FCvtFromInt(fcvtsw, F32, S);
+TRANSLATOR_FCvtFromInt(fcvtswu, F32, U);
+TRANSLATOR(fmvwx)
+{
+    qb.Create_fmvif(FOutput(i.frd(), VType::F32), gprop(i.rs1()));
+}
+TRANSLATOR(fld)
+{
+    TranslateFLoad(i, VType::F64);
+}
+TRANSLATOR(fsd)
+{
+    TranslateFStore(i, VType::F64);
+}
+TRANSLATOR_Helper(fmaddd);
+TRANSLATOR_Helper(fmsubd);
+TRANSLATOR_Helper(fnmsubd);
+TRANSLATOR_Helper(fnmaddd);
+TRANSLATOR_FBinop(faddd, fadd, F64);
+TRANSLATOR_FBinop(fsubd, fsub, F64);
+TRANSLATOR_FBinop(fmuld, fmul, F64);
+TRANSLATOR_FBinop(fdivd, fdiv, F64);
+TRANSLATOR_FSqrt(fsqrtd, F64);
+TRANSLATOR_FSgnj(fsgnjd, F64);
+TRANSLATOR_FSgnj(fsgnjnd, F64);
+TRANSLATOR_FSgnj(fsgnjxd, F64);
+TRANSLATOR_FMinMax(fmind, fmin, F64);
+TRANSLATOR_FMinMax(fmaxd, fmax, F64);
+TRANSLATOR(fcvtsd)
+{
+    if (i.rm() != insn::RM::DYN)
+        return TranslateHelper(i, RuntimeStubId::id_rv32_fcvtsd);
+    auto s = FInput(i.frs1(), VType::F64);
+    qb.Create_fcvt(FOutput(i.frd(), VType::F32), s);
+}
+TRANSLATOR(fcvtds)
+{
+    auto s = FInput(i.frs1(), VType::F32);
+    qb.Create_fcvt(FOutput(i.frd(), VType::F64), s);
+}
+TRANSLATOR_FCmp(feqd, EQ, F64);
+TRANSLATOR_FCmp(fltd, LT, F64);
+TRANSLATOR_FCmp(fled, LE, F64);
+TRANSLATOR_Helper(fclassd);
+TRANSLATOR_FCvtToInt(fcvtwd, F64);
+TRANSLATOR_Helper(fcvtwud);
+TRANSLATOR(fcvtdw)
+{
+    qb.Create_fcvtif(VSign::S, FOutput(i.frd(), VType::F64), gprop(i.rs1()));
+}
+TRANSLATOR(fcvtdwu)
+{
+    qb.Create_fcvtif(VSign::U, FOutput(i.frd(), VType::F64), gprop(i.rs1()));
+}
+TRANSLATOR(vsetvli)
+{
+    VOperand avl;
+    if (i.rs1())
+        avl = vgpr(i.rs1());
+    else if (i.rd())
+        avl = vconst(-1);
+    else
+        avl = vvl();
+    if (!TranslateVSetVl(i.rd(), avl, i.zimm())) {
+        TranslateHelper(i, RuntimeStubId::id_rv32_vsetvli);
+        vtype = insn::VTYPE::VILL;
+    }
+}
+TRANSLATOR(vsetivli)
+{
+    if (!TranslateVSetVl(i.rd(), vconst(i.uimm()), i.zimm())) {
+        TranslateHelper(i, RuntimeStubId::id_rv32_vsetivli);
+        vtype = insn::VTYPE::VILL;
+    }
+}
+TRANSLATOR(vsetvl)
+{
+    TranslateHelper(i, RuntimeStubId::id_rv32_vsetvl);
+    vtype = insn::VTYPE::VILL;
+}
+
+#define TRANSLATOR_VLoad(name, eew)                                 \
+    TRANSLATOR(name)                                                \
+    {                                                               \
+        TranslateVMem(i, eew, true, RuntimeStubId::id_rv32_##name); \
+    }
+#define TRANSLATOR_VStore(name, eew)                                 \
+    TRANSLATOR(name)                                                 \
+    {                                                                \
+        TranslateVMem(i, eew, false, RuntimeStubId::id_rv32_##name); \
+    }
+#define TRANSLATOR_VBinop(name, op)                                   \
+    TRANSLATOR(name)                                                  \
+    {                                                                 \
+        TranslateVBinop(i, Op::_##op, RuntimeStubId::id_rv32_##name); \
+    }
+
+TRANSLATOR_VLoad(vle8v, 1);
+TRANSLATOR_VLoad(vle16v, 2);
+TRANSLATOR_VLoad(vle32v, 4);
+TRANSLATOR_VStore(vse8v, 1);
+TRANSLATOR_VStore(vse16v, 2);
+TRANSLATOR_VStore(vse32v, 4);
+TRANSLATOR_VBinop(vaddvv, vecadd);
+TRANSLATOR_VBinop(vaddvx, vecadd);
+TRANSLATOR_VBinop(vaddvi, vecadd);
+TRANSLATOR_VBinop(vsubvv, vecsub);
+TRANSLATOR_VBinop(vsubvx, vecsub);
+TRANSLATOR_VBinop(vmulvv, vecmul);
+TRANSLATOR_VBinop(vmulvx, vecmul);
+TRANSLATOR_VBinop(vandvv, vecand);
+TRANSLATOR_VBinop(vandvx, vecand);
+TRANSLATOR_VBinop(vandvi, vecand);
+TRANSLATOR_VBinop(vorvv, vecor);
+TRANSLATOR_VBinop(vorvx, vecor);
+TRANSLATOR_VBinop(vorvi, vecor);
+TRANSLATOR_VBinop(vxorvv, vecxor);
+TRANSLATOR_VBinop(vxorvx, vecxor);
+TRANSLATOR_VBinop(vxorvi, vecxor);
+TRANSLATOR_Helper(vredsum);
+TRANSLATOR_Helper(vmvvv);
+TRANSLATOR_Helper(vmvvx);
+TRANSLATOR_Helper(vmvvi);
+// Element 0 is sign-extended from SEW
+TRANSLATOR(vmvxs)
+{
+    if (vtype & insn::VTYPE::VILL) {
+        TranslateHelper(i, RuntimeStubId::id_rv32_vmvxs);
+        return;
+    }
+    if (!i.rd())
+        return;
+    auto rd = vgpr(i.rd());
+    qb.Create_mov(rd, vvreg(i.vs2(), VType::I32));
+    if (u32 sh = 32 - 8 * insn::VTYPE::SEWBytes(vtype)) {
+        qb.Create_sll(rd, rd, vconst(sh));
+        qb.Create_sra(rd, rd, vconst(sh));
+    }
+}
+TRANSLATOR_Helper(vmvsx);
 TRANSLATOR_Helper(fence);
-TRANSLATOR_Helper(fencei);
+// Region ends here, following code is looked up again
+// Always leaves the region, the next instruction may have been modified and
+// must be looked up again
+TRANSLATOR(fencei)
+{
+    qb.Create_gbr(vconst(insn_ip + insn::Length(i.raw)), GlobalsAll);
+}
 TRANSLATOR_Helper(ecall);
 TRANSLATOR_Helper(ebreak);
+TRANSLATOR_Helper(csrrw);
+// rdcycle, rdtime and rdinstret are lowered inline
+TRANSLATOR(csrrs)
+{
+    if (i.rs1() || !TranslateCounterRead(i.rd(), i.csr()))
+        TranslateHelper(i, RuntimeStubId::id_rv32_csrrs);
+}
+TRANSLATOR_Helper(csrrc);
+TRANSLATOR_Helper(csrrwi);
+TRANSLATOR_Helper(csrrsi);
+TRANSLATOR_Helper(csrrci);
 
 }  // namespace dbt::qir::rv32
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <initializer_list>
 #include <map>
 
 #include "guest/rv32_insn.h"
@@ -13,7 +14,7 @@ using namespace dbt::rv32;
 
 struct RV32Translator {
 #define OP(name, format_, flags_)           \
-    void H_##name(void *insn);              \
+    void H_##name(u32 raw);                 \
     void V_##name(rv32::insn::Insn_##name); \
     static constexpr auto _##name = &RV32Translator::H_##name;
     RV32_OPCODE_LIST()
@@ -31,16 +32,35 @@ private:
     explicit RV32Translator(qir::Region *region, uptr vmem);
     void TranslateIPRange(u32 ip, u32 boundary_ip);
     void PreSideeff();
+    void FlushICount(u32 extra);
     void TranslateInsn();
 
     void MakeGBr(u32 ip);
+    GlobalsMask ScanLiveGlobals(u32 ip);
 
     void TranslateLoad(insn::I i, VType type, VSign sgn);
     void TranslateStore(insn::S i, VType type, VSign sgn);
     void TranslateBrcc(insn::B i, CondCode cc);
     inline void TranslateSetcc(insn::R i, CondCode cc);
     inline void TranslateSetcc(insn::I i, CondCode cc);
-    inline void TranslateHelper(insn::Base i, RuntimeStubId stub);
+    inline VOperand AtomicDst(insn::A i);
+    void TranslateAtomic(insn::A i, Op op);
+    VOperand FInput(u8 id, VType type);
+    VOperand FOutput(u8 id, VType type);
+    void TranslateFLoad(insn::FI i, VType type);
+    void TranslateFStore(insn::FS i, VType type);
+    void TranslateFBinop(insn::FR i, Op op, VType type);
+    void TranslateFSgnj(insn::FR i, VType type);
+    template <typename I>
+    inline void TranslateHelper(I i, RuntimeStubId stub);
+    VType VGroupType(std::initializer_list<u8> regs) const;
+    VOperand VTailIdx();
+    bool TranslateVSetVl(u8 rd, VOperand avl, u32 vtypei);
+    template <typename I>
+    void TranslateVBinop(I i, Op op, RuntimeStubId stub);
+    template <typename I>
+    void TranslateVMem(I i, u32 eew, bool is_load, RuntimeStubId stub);
+    bool TranslateCounterRead(u8 rd, u16 csr);
 
     qir::Builder qb;
     std::map<u32, qir::Block *> ip2bb;
@@ -48,6 +68,13 @@ private:
     enum class Control { NEXT, BRANCH, TB_OVF } control{Control::NEXT};
     uptr vmem_base{};
     u32 insn_ip{0};
+    u32 range_ip{0};
+    u32 icount_pending{0};  // translated, but not counted in instret yet
+    u32 fpr_boxed{0};  // FPRs holding NaN-boxed singles written in the range
+    // Static vtype, VILL if unknown
+    u32 vtype{insn::VTYPE::VILL};
+    bool vector_ops{};
+    bool fround_ops{};
 };
 
 }  // namespace dbt::qir::rv32
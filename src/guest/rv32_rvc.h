@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstring>
+
+#include "guest/rv32_insn.h"
+
+namespace dbt::rv32::insn
+{
+/* RV32C instructions are expanded to their 32-bit equivalents, so decoders,
+ * interpreter handlers and translators work on a single encoding. Expanded
+ * encodings keep the two low bits cleared, which is how Length() tells the
+ * original size. Decoders restore the opcode with DecodeRaw().
+ */
+namespace rvc
+{
+// Compressed register fields
+using _rd = bf_range<u32, 7, 11>;
+using _rs2 = bf_range<u32, 2, 6>;
+using _rdp = bf_range<u32, 2, 4>;   // rd'/rs2'
+using _rs1p = bf_range<u32, 7, 9>;  // rs1'/rd'
+using _funct3 = bf_range<u32, 13, 15>;
+using _funct2 = bf_range<u32, 10, 11>;
+using _funct2b = bf_range<u32, 5, 6>;
+using _bit12 = bf_range<u32, 12, 12>;
+
+// Immediates
+using _imm_ci = bf_seq<i32, bf_pt<2, 6>, bf_pt<12, 12>>;
+using _imm_addi16sp = bf_seq<i32,
+                             bf_pt<6, 6>,
+                             bf_pt<2, 2>,
+                             bf_pt<5, 5>,
+                             bf_pt<3, 4>,
+                             bf_pt<12, 12>>;  // << 4
+using _uimm_addi4spn =
+    bf_seq<u32, bf_pt<6, 6>, bf_pt<5, 5>, bf_pt<11, 12>, bf_pt<7, 10>>;  // << 2
+using _uimm_lw = bf_seq<u32, bf_pt<6, 6>, bf_pt<10, 12>, bf_pt<5, 5>>;  // << 2
+using _uimm_lwsp =
+    bf_seq<u32, bf_pt<4, 6>, bf_pt<12, 12>, bf_pt<2, 3>>;  // << 2
+using _uimm_swsp = bf_seq<u32, bf_pt<9, 12>, bf_pt<7, 8>>;  // << 2
+using _uimm_ld = bf_seq<u32, bf_pt<10, 12>, bf_pt<5, 6>>;    // << 3
+using _uimm_ldsp =
+    bf_seq<u32, bf_pt<5, 6>, bf_pt<12, 12>, bf_pt<2, 4>>;  // << 3
+using _uimm_sdsp = bf_seq<u32, bf_pt<10, 12>, bf_pt<7, 9>>;  // << 3
+using _imm_j = bf_seq<i32,
+                      bf_pt<3, 5>,
+                      bf_pt<11, 11>,
+                      bf_pt<2, 2>,
+                      bf_pt<7, 7>,
+                      bf_pt<6, 6>,
+                      bf_pt<9, 10>,
+                      bf_pt<8, 8>,
+                      bf_pt<12, 12>>;  // << 1
+using _imm_b = bf_seq<i32,
+                      bf_pt<3, 4>,
+                      bf_pt<10, 11>,
+                      bf_pt<2, 2>,
+                      bf_pt<5, 6>,
+                      bf_pt<12, 12>>;  // << 1
+
+// 32-bit encoders
+static constexpr u32 OPC_LOAD = 0b0000011;
+static constexpr u32 OPC_LOAD_FP = 0b0000111;
+static constexpr u32 OPC_STORE = 0b0100011;
+static constexpr u32 OPC_STORE_FP = 0b0100111;
+static constexpr u32 OPC_OPIMM = 0b0010011;
+static constexpr u32 OPC_OP = 0b0110011;
+static constexpr u32 OPC_LUI = 0b0110111;
+static constexpr u32 OPC_BRANCH = 0b1100011;
+static constexpr u32 OPC_JALR = 0b1100111;
+static constexpr u32 OPC_JAL = 0b1101111;
+static constexpr u32 OPC_SYSTEM = 0b1110011;
+
+static constexpr u32 EncR(u32 opc, u32 f3, u32 f7, u32 rd, u32 rs1, u32 rs2)
+{
+    return opc | rd << 7 | f3 << 12 | rs1 << 15 | rs2 << 20 | f7 << 25;
+}
+
+static constexpr u32 EncI(u32 opc, u32 f3, u32 rd, u32 rs1, i32 imm)
+{
+    return opc | rd << 7 | f3 << 12 | rs1 << 15 | (u32) imm << 20;
+}
+
+static constexpr u32 EncS(u32 opc, u32 f3, u32 rs1, u32 rs2, i32 imm)
+{
+    return opc | (imm & 0x1f) << 7 | f3 << 12 | rs1 << 15 | rs2 << 20 |
+           ((u32) imm >> 5 & 0x7f) << 25;
+}
+
+static constexpr u32 EncB(u32 f3, u32 rs1, u32 rs2, i32 imm)
+{
+    u32 u = imm;
+    return OPC_BRANCH | (u >> 11 & 1) << 7 | (u >> 1 & 0xf) << 8 | f3 << 12 |
+           rs1 << 15 | rs2 << 20 | (u >> 5 & 0x3f) << 25 | (u >> 12 & 1) << 31;
+}
+
+static constexpr u32 EncJ(u32 rd, i32 imm)
+{
+    u32 u = imm;
+    return OPC_JAL | rd << 7 | (u >> 12 & 0xff) << 12 | (u >> 11 & 1) << 20 |
+           (u >> 1 & 0x3ff) << 21 | (u >> 20 & 1) << 31;
+}
+
+static constexpr u32 ILLEGAL = 0b1111111;  // reserved major opcode
+
+static inline u32 Expand(u32 c)
+{
+    auto rd = _rd::decode(c);
+    auto rs2 = _rs2::decode(c);
+    auto rdp = _rdp::decode(c) + 8;
+    auto rs1p = _rs1p::decode(c) + 8;
+    auto f3 = _funct3::decode(c);
+    bool b12 = _bit12::decode(c);
+
+    switch (c & 3) {
+    case 0b00:
+        switch (f3) {
+        case 0b000: { /* c.addi4spn */
+            u32 uimm = _uimm_addi4spn::decode(c) << 2;
+            if (!uimm)
+                return ILLEGAL;
+            return EncI(OPC_OPIMM, 0b000, rdp, 2, uimm);
+        }
+        case 0b001: /* c.fld */
+            return EncI(OPC_LOAD_FP, 0b011, rdp, rs1p,
+                        _uimm_ld::decode(c) << 3);
+        case 0b010: /* c.lw */
+            return EncI(OPC_LOAD, 0b010, rdp, rs1p, _uimm_lw::decode(c) << 2);
+        case 0b011: /* c.flw */
+            return EncI(OPC_LOAD_FP, 0b010, rdp, rs1p,
+                        _uimm_lw::decode(c) << 2);
+        case 0b101: /* c.fsd */
+            return EncS(OPC_STORE_FP, 0b011, rs1p, rdp,
+                        _uimm_ld::decode(c) << 3);
+        case 0b110: /* c.sw */
+            return EncS(OPC_STORE, 0b010, rs1p, rdp, _uimm_lw::decode(c) << 2);
+        case 0b111: /* c.fsw */
+            return EncS(OPC_STORE_FP, 0b010, rs1p, rdp,
+                        _uimm_lw::decode(c) << 2);
+        default:
+            return ILLEGAL;
+        }
+    case 0b01:
+        switch (f3) {
+        case 0b000: /* c.addi, c.nop */
+            return EncI(OPC_OPIMM, 0b000, rd, rd, _imm_ci::decode(c));
+        case 0b001: /* c.jal */
+            return EncJ(1, _imm_j::decode(c) << 1);
+        case 0b010: /* c.li */
+            return EncI(OPC_OPIMM, 0b000, rd, 0, _imm_ci::decode(c));
+        case 0b011:
+            if (rd == 2) { /* c.addi16sp */
+                i32 imm = _imm_addi16sp::decode(c) << 4;
+                if (!imm)
+                    return ILLEGAL;
+                return EncI(OPC_OPIMM, 0b000, 2, 2, imm);
+            } else { /* c.lui */
+                i32 imm = _imm_ci::decode(c);
+                if (!imm)
+                    return ILLEGAL;
+                return OPC_LUI | rd << 7 | ((u32) imm & 0xfffff) << 12;
+            }
+        case 0b100:
+            switch (_funct2::decode(c)) {
+            case 0b00: /* c.srli */
+                if (b12)
+                    return ILLEGAL;
+                return EncI(OPC_OPIMM, 0b101, rs1p, rs1p, rs2);
+            case 0b01: /* c.srai */
+                if (b12)
+                    return ILLEGAL;
+                return EncI(OPC_OPIMM, 0b101, rs1p, rs1p, rs2 | 0x400);
+            case 0b10: /* c.andi */
+                return EncI(OPC_OPIMM, 0b111, rs1p, rs1p, _imm_ci::decode(c));
+            default:
+                if (b12)
+                    return ILLEGAL;
+                switch (_funct2b::decode(c)) {
+                case 0b00: /* c.sub */
+                    return EncR(OPC_OP, 0b000, 0b0100000, rs1p, rs1p, rdp);
+                case 0b01: /* c.xor */
+                    return EncR(OPC_OP, 0b100, 0, rs1p, rs1p, rdp);
+                case 0b10: /* c.or */
+                    return EncR(OPC_OP, 0b110, 0, rs1p, rs1p, rdp);
+                default: /* c.and */
+                    return EncR(OPC_OP, 0b111, 0, rs1p, rs1p, rdp);
+                }
+            }
+        case 0b101: /* c.j */
+            return EncJ(0, _imm_j::decode(c) << 1);
+        case 0b110: /* c.beqz */
+            return EncB(0b000, rs1p, 0, _imm_b::decode(c) << 1);
+        default: /* c.bnez */
+            return EncB(0b001, rs1p, 0, _imm_b::decode(c) << 1);
+        }
+    case 0b10:
+        switch (f3) {
+        case 0b000: /* c.slli */
+            if (b12)
+                return ILLEGAL;
+            return EncI(OPC_OPIMM, 0b001, rd, rd, rs2);
+        case 0b001: /* c.fldsp */
+            return EncI(OPC_LOAD_FP, 0b011, rd, 2, _uimm_ldsp::decode(c) << 3);
+        case 0b010: /* c.lwsp */
+            if (!rd)
+                return ILLEGAL;
+            return EncI(OPC_LOAD, 0b010, rd, 2, _uimm_lwsp::decode(c) << 2);
+        case 0b011: /* c.flwsp */
+            return EncI(OPC_LOAD_FP, 0b010, rd, 2, _uimm_lwsp::decode(c) << 2);
+        case 0b100:
+            if (!b12) {
+                if (rs2) /* c.mv */
+                    return EncR(OPC_OP, 0b000, 0, rd, 0, rs2);
+                if (!rd)
+                    return ILLEGAL;
+                return EncI(OPC_JALR, 0b000, 0, rd, 0); /* c.jr */
+            }
+            if (rs2) /* c.add */
+                return EncR(OPC_OP, 0b000, 0, rd, rd, rs2);
+            if (!rd) /* c.ebreak */
+                return EncI(OPC_SYSTEM, 0b000, 0, 0, 1);
+            return EncI(OPC_JALR, 0b000, 1, rd, 0); /* c.jalr */
+        case 0b101: /* c.fsdsp */
+            return EncS(OPC_STORE_FP, 0b011, 2, rs2,
+                        _uimm_sdsp::decode(c) << 3);
+        case 0b110: /* c.swsp */
+            return EncS(OPC_STORE, 0b010, 2, rs2, _uimm_swsp::decode(c) << 2);
+        default: /* c.fswsp */
+            return EncS(OPC_STORE_FP, 0b010, 2, rs2,
+                        _uimm_swsp::decode(c) << 2);
+        }
+    default:
+        unreachable("");
+    }
+}
+}  // namespace rvc
+
+// Fetch instruction, compressed ones are returned expanded
+ALWAYS_INLINE u32 Fetch(void const *ptr)
+{
+    u16 lo;
+    memcpy(&lo, ptr, sizeof(lo));
+    if (Length(lo) == 2)
+        return rvc::Expand(lo) & ~(u32) 3;
+    u32 raw;
+    memcpy(&raw, ptr, sizeof(raw));
+    return raw;
+}
+
+// Restore the opcode of fetched instruction before decoding
+ALWAYS_INLINE constexpr u32 DecodeRaw(u32 raw)
+{
+    return raw | 3;
+}
+
+}  // namespace dbt::rv32::insn
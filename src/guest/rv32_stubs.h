@@ -1,7 +1,73 @@
 #pragma once
 
 #define GUEST_RUNTIME_STUBS \
+    _(rv32_illegal)         \
     _(rv32_fence)           \
     _(rv32_fencei)          \
     _(rv32_ecall)           \
-    _(rv32_ebreak)
+    _(rv32_ebreak)          \
+    _(rv32_orcb)            \
+    _(rv32_fmadds)          \
+    _(rv32_fmsubs)          \
+    _(rv32_fnmsubs)         \
+    _(rv32_fnmadds)         \
+    _(rv32_fadds)           \
+    _(rv32_fsubs)           \
+    _(rv32_fmuls)           \
+    _(rv32_fdivs)           \
+    _(rv32_fsqrts)          \
+    _(rv32_fcvtws)          \
+    _(rv32_fcvtwus)         \
+    _(rv32_fclasss)         \
+    _(rv32_fcvtsw)          \
+    _(rv32_fcvtswu)         \
+    _(rv32_fmaddd)          \
+    _(rv32_fmsubd)          \
+    _(rv32_fnmsubd)         \
+    _(rv32_fnmaddd)         \
+    _(rv32_faddd)           \
+    _(rv32_fsubd)           \
+    _(rv32_fmuld)           \
+    _(rv32_fdivd)           \
+    _(rv32_fsqrtd)          \
+    _(rv32_fcvtsd)          \
+    _(rv32_fclassd)         \
+    _(rv32_fcvtwd)          \
+    _(rv32_fcvtwud)         \
+    _(rv32_csrrw)           \
+    _(rv32_csrrs)           \
+    _(rv32_csrrc)           \
+    _(rv32_csrrwi)          \
+    _(rv32_csrrsi)          \
+    _(rv32_csrrci)          \
+    _(rv32_vsetvli)         \
+    _(rv32_vsetivli)        \
+    _(rv32_vsetvl)          \
+    _(rv32_vle8v)           \
+    _(rv32_vle16v)          \
+    _(rv32_vle32v)          \
+    _(rv32_vse8v)           \
+    _(rv32_vse16v)          \
+    _(rv32_vse32v)          \
+    _(rv32_vaddvv)          \
+    _(rv32_vaddvx)          \
+    _(rv32_vaddvi)          \
+    _(rv32_vsubvv)          \
+    _(rv32_vsubvx)          \
+    _(rv32_vmulvv)          \
+    _(rv32_vmulvx)          \
+    _(rv32_vandvv)          \
+    _(rv32_vandvx)          \
+    _(rv32_vandvi)          \
+    _(rv32_vorvv)           \
+    _(rv32_vorvx)           \
+    _(rv32_vorvi)           \
+    _(rv32_vxorvv)          \
+    _(rv32_vxorvx)          \
+    _(rv32_vxorvi)          \
+    _(rv32_vredsum)         \
+    _(rv32_vmvvv)           \
+    _(rv32_vmvvx)           \
+    _(rv32_vmvvi)           \
+    _(rv32_vmvxs)           \
+    _(rv32_vmvsx)
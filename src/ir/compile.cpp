@@ -1,19 +1,37 @@
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
 #include "ir/compile.h"
 #include "codegen/qcg.h"
 #include "guest/rv32_qir.h"
+#include "ir/qir_opt.h"
 
 namespace dbt::qir
 {
+// Reset between jobs of the same thread instead of being remapped
+static thread_local MemArena job_arena(1_MB);
+
 void *CompilerDoJob(CompilerJob &job)
 {
-    MemArena arena(1_MB);
+    job_arena.Reset();
 
     auto entry_ip = job.iprange[0].first;
-    auto region = CompilerGenRegionIR(&arena, job);
+    job.cruntime->BeginRegion(job.iprange);
+    auto region = CompilerGenRegionIR(&job_arena, job);
+    OptimizeRegion(region);
 
-    auto tcode =
-        qcg::GenerateCode(job.cruntime, &job.segment, region, entry_ip);
-    return job.cruntime->AnnounceRegion(entry_ip, tcode);
+    RegionRelocs relocs;
+    auto *prelocs = job.cruntime->AllowsRelocation() ? &relocs : nullptr;
+    auto tcode = qcg::GenerateCode(job.cruntime, &job.segment, region,
+                                   entry_ip, prelocs);
+    region->~Region();  // releases heap-backed vregs info
+    if (tcode.empty())
+        return nullptr;
+    return job.cruntime->AnnounceRegion(entry_ip, tcode, job.iprange,
+                                        prelocs);
 }
 
 qir::Region *CompilerGenRegionIR(MemArena *arena, CompilerJob &job)
@@ -25,4 +43,76 @@ qir::Region *CompilerGenRegionIR(MemArena *arena, CompilerJob &job)
     return region;
 }
 
+static struct {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<CompilerJob> queue;
+    std::unordered_set<u32> pending;  // entry ips of queued or running jobs
+    std::vector<std::thread> workers;
+    bool stop{false};
+} pool;
+
+bool CompilerPool::active{false};
+
+void CompilerPool::Init(u32 n_workers)
+{
+    assert(!active);
+    if (n_workers == 0)
+        return;
+    pool.stop = false;
+    for (u32 i = 0; i < n_workers; ++i)
+        pool.workers.emplace_back(WorkerLoop);
+    active = true;
+}
+
+void CompilerPool::Destroy()
+{
+    if (!active)
+        return;
+    {
+        std::lock_guard lock(pool.mtx);
+        pool.stop = true;
+        pool.queue.clear();
+    }
+    pool.cv.notify_all();
+    for (auto &w : pool.workers)
+        w.join();
+    pool.workers.clear();
+    pool.pending.clear();
+    active = false;
+}
+
+bool CompilerPool::Enqueue(CompilerJob &&job)
+{
+    u32 entry_ip = job.iprange[0].first;
+    {
+        std::lock_guard lock(pool.mtx);
+        if (!pool.pending.insert(entry_ip).second)
+            return false;
+        pool.queue.push_back(std::move(job));
+    }
+    pool.cv.notify_one();
+    return true;
+}
+
+void CompilerPool::WorkerLoop()
+{
+    std::unique_lock lock(pool.mtx);
+    while (true) {
+        pool.cv.wait(lock, [] { return pool.stop || !pool.queue.empty(); });
+        if (pool.stop)
+            return;
+        auto job = std::move(pool.queue.front());
+        pool.queue.pop_front();
+        lock.unlock();
+
+        // Fails if all generations are taken, the job is dropped then and
+        // Execute evicts the oldest one
+        CompilerDoJob(job);
+
+        lock.lock();
+        pool.pending.erase(job.iprange[0].first);
+    }
+}
+
 }  // namespace dbt::qir
@@ -10,12 +10,31 @@ namespace dbt
 {
 using IpRange = std::pair<u32, u32>;
 
+// Code of relocatable regions has no host addresses embedded, except for
+// BranchSlots and inline caches patched at runtime. Offsets are relative to
+// the region start
+struct RegionRelocs {
+    std::vector<u32> branch_slots;
+    std::vector<u32> brind_ics;
+    bool relocatable{true};  // false if run-specific constants are embedded
+};
+
 struct CompilerRuntime {
+    // Returns nullptr if the code cache is full, the job is dropped then
     virtual void *AllocateCode(size_t sz, uint align) = 0;
 
+    // Regions are emitted relocatable and announced with RegionRelocs
     virtual bool AllowsRelocation() const = 0;
 
-    virtual void *AnnounceRegion(u32 ip, std::span<u8> const &code) = 0;
+    // Called before guest code in ipranges is read by the translator
+    virtual void BeginRegion(std::span<IpRange const> ipranges) = 0;
+
+    // ipranges are the guest code ranges the region was translated from,
+    // relocs is nullptr unless AllowsRelocation
+    virtual void *AnnounceRegion(u32 ip,
+                                 std::span<u8> const &code,
+                                 std::span<IpRange const> ipranges,
+                                 RegionRelocs const *relocs) = 0;
 };
 }  // namespace dbt
 
@@ -52,10 +71,27 @@ struct CompilerJob {
     IpRangesSet iprange;
 };
 
-// Now qmc operates only in synchronous mode, so returns a value from
-// runtime.AnnounceRegion
+// Synchronous mode, returns a value from runtime.AnnounceRegion or nullptr if
+// code allocation failed
 void *CompilerDoJob(CompilerJob &job);
 
+// Asynchronous mode: jobs are processed by worker threads, results are
+// published through runtime.AnnounceRegion called from a worker
+struct CompilerPool {
+    static void Init(u32 n_workers);
+    static void Destroy();
+
+    static bool IsActive() { return active; }
+
+    // Returns false if a job with the same entry ip is already pending
+    static bool Enqueue(CompilerJob &&job);
+
+private:
+    static void WorkerLoop();
+
+    static bool active;
+};
+
 struct Region;
 // Just generate IR
 Region *CompilerGenRegionIR(MemArena *arena, CompilerJob &job);
@@ -13,6 +13,7 @@
 namespace dbt::qcg
 {
 struct RAOpCt;
+struct RegMask;
 };
 
 namespace dbt::qir
@@ -55,6 +56,7 @@ struct OpInfo {
 
     qcg::RAOpCt const *ra_ct{};
     u8 const *ra_order{};
+    qcg::RegMask const *ra_clobber{};
 };
 
 extern OpInfo op_info[to_underlying(qir::Op::Count)];
@@ -69,6 +71,10 @@ enum class VType : u8 {
     I8,
     I16,
     I32,
+    F32,
+    F64,
+    V128,
+    V256,
     Count,
 };
 
@@ -81,26 +87,51 @@ inline u8 VTypeToSize(VType type)
         return 2;
     case VType::I32:
         return 4;
+    case VType::F32:
+        return 4;
+    case VType::F64:
+        return 8;
+    case VType::V128:
+        return 16;
+    case VType::V256:
+        return 32;
     default:
         unreachable("");
     }
 }
 
+inline bool VTypeIsFloat(VType type)
+{
+    return type == VType::F32 || type == VType::F64;
+}
+
 enum class VSign : u8 {
     U = 0,
     S = 1,
 };
 
+// Static rounding modes of float to integer conversions
+enum class FRound : u8 {
+    NEAREST = 0,  // ties to even
+    DOWN = 1,
+    UP = 2,
+    ZERO = 3,
+};
+
 using RegN = u16;
 static constexpr auto RegNBad = static_cast<RegN>(-1);
 
+// Set of global vregs, carries guest liveness info to codegen
+using GlobalsMask = u64;
+static constexpr auto GlobalsAll = static_cast<GlobalsMask>(-1);
+
 struct VOperand {
 private:
     enum class Kind : u8 {
         CONST = 0,
         GPR,
         SLOT,
-        // FPR
+        FPR,
         BAD,
         Count,
     };
@@ -132,6 +163,25 @@ public:
         return VOperand(value);
     }
 
+    static VOperand MakeVFPR(VType type, RegN reg)
+    {
+        uptr value = 0;
+        value = f_kind::encode(value, Kind::FPR);
+        value = f_type::encode(value, type);
+        value = f_is_virtual::encode(value, true);
+        value = f_reg::encode(value, reg);
+        return VOperand(value);
+    }
+
+    static VOperand MakePFPR(VType type, RegN reg)
+    {
+        uptr value = 0;
+        value = f_kind::encode(value, Kind::FPR);
+        value = f_type::encode(value, type);
+        value = f_reg::encode(value, reg);
+        return VOperand(value);
+    }
+
     static VOperand MakeConst(VType type, u32 cval)
     {
         uptr value = 0;
@@ -160,6 +210,9 @@ public:
 
     bool IsSlot() const { return GetKind() == Kind::SLOT; }
 
+    // preg or vreg
+    bool IsFPR() const { return GetKind() == Kind::FPR; }
+
     bool IsV() const
     {
         assert(IsGPR());
@@ -170,6 +223,10 @@ public:
 
     bool IsVGPR() const { return IsGPR() && FlagV(); }
 
+    bool IsPFPR() const { return IsFPR() && !FlagV(); }
+
+    bool IsVFPR() const { return IsFPR() && FlagV(); }
+
     bool IsGSlot() const { return IsSlot() && f_slot_is_global::decode(value); }
 
     bool IsLSlot() const
@@ -195,6 +252,18 @@ public:
         return f_reg::decode(value);
     }
 
+    RegN GetPFPR() const
+    {
+        assert(IsPFPR());
+        return f_reg::decode(value);
+    }
+
+    RegN GetVFPR() const
+    {
+        assert(IsVFPR());
+        return f_reg::decode(value);
+    }
+
     u16 GetSlotOffs() const
     {
         assert(IsSlot());
@@ -503,26 +572,54 @@ struct InstBrcc : InstWithOperands<0, 2> {
 };
 
 struct InstGBr : InstNoOperands {
-    InstGBr(VOperand tpc_) : InstNoOperands(Op::_gbr), tpc(tpc_)
+    InstGBr(VOperand tpc_, GlobalsMask live_ = GlobalsAll)
+        : InstNoOperands(Op::_gbr), tpc(tpc_), live(live_)
     {
         assert(tpc_.IsConst());
     }
 
     VOperand tpc;
+    GlobalsMask live;  // globals that may be read at tpc
 };
 
 struct InstGBrind : InstWithOperands<0, 1> {
-    InstGBrind(VOperand tpc_) : InstWithOperands(Op::_gbrind, {}, {tpc_}) {}
+    InstGBrind(VOperand tpc_, bool ras_pop_ = false, bool ras_push_ = false,
+               u32 ret_gip_ = 0)
+        : InstWithOperands(Op::_gbrind, {}, {tpc_}), ras_pop(ras_pop_),
+          ras_push(ras_push_), ret_gip(ret_gip_)
+    {
+    }
+
+    bool ras_pop;   // return, predicted by the return address stack
+    bool ras_push;  // coroutine swap, ret_gip is pushed after the pop
+    u32 ret_gip;
+};
+
+// Pushes continuation of a call to the return address stack, host registers
+// are preserved
+struct InstRasPush : InstNoOperands {
+    InstRasPush(u32 ret_gip_)
+        : InstNoOperands(Op::_raspush), ret_gip(ret_gip_)
+    {
+    }
+
+    u32 ret_gip;
 };
 
 struct InstHcall : InstWithOperands<0, 1> {
     // TODO: variable number of operands
-    InstHcall(RuntimeStubId stub_, VOperand arg_)
-        : InstWithOperands(Op::_hcall, {}, {arg_}), stub(stub_)
+    InstHcall(RuntimeStubId stub_,
+              VOperand arg_,
+              GlobalsMask uses_ = GlobalsAll,
+              GlobalsMask defs_ = 0)
+        : InstWithOperands(Op::_hcall, {}, {arg_}), stub(stub_), uses(uses_),
+          defs(defs_)
     {
     }
 
     RuntimeStubId stub;
+    GlobalsMask uses;  // globals the stub may read from state
+    GlobalsMask defs;  // globals the stub may write to state
 };
 
 struct InstVMLoad : InstWithOperands<1, 1> {
@@ -545,6 +642,197 @@ struct InstVMStore : InstWithOperands<0, 2> {
     VSign sgn;
 };
 
+// Load-reserved word, the reservation is kept in guest state
+struct InstVMLr : InstWithOperands<1, 1> {
+    InstVMLr(VOperand d, VOperand ptr)
+        : InstWithOperands(Op::_vmlr, {d}, {ptr})
+    {
+    }
+};
+
+// Store-conditional word, d is 0 on success
+struct InstVMSc : InstWithOperands<1, 2> {
+    InstVMSc(VOperand d, VOperand ptr, VOperand val)
+        : InstWithOperands(Op::_vmsc, {d}, {ptr, val})
+    {
+    }
+};
+
+// Atomic word read-modify-write, d receives the old value
+struct InstVMAtomic : InstWithOperands<1, 2> {
+    InstVMAtomic(Op opcode_, VOperand d, VOperand ptr, VOperand val)
+        : InstWithOperands(opcode_, {d}, {ptr, val})
+    {
+        assert(HasOpcode(opcode_));
+    }
+
+    static bool classof(Inst *op) { return HasOpcode(op->GetOpcode()); }
+
+    static bool HasOpcode(Op opcode)
+    {
+        return opcode >= Op::InstVMAtomic_begin &&
+               opcode <= Op::InstVMAtomic_end;
+    }
+};
+
+/* Scalar FP, operands are F32/F64 FPRs. F32 inputs are expected to be
+ * NaN-boxed, see funbox. Arithmetic results are NaN-canonicalized, F32 results
+ * of all ops are NaN-boxed.
+ */
+struct InstFUnop : InstWithOperands<1, 1> {
+    InstFUnop(Op opcode_, VOperand d, VOperand s)
+        : InstWithOperands(opcode_, {d}, {s})
+    {
+        assert(HasOpcode(opcode_));
+    }
+
+    static bool classof(Inst *op) { return HasOpcode(op->GetOpcode()); }
+
+    static bool HasOpcode(Op opcode)
+    {
+        return opcode >= Op::InstFUnop_begin && opcode <= Op::InstFUnop_end;
+    }
+};
+
+struct InstFBinop : InstWithOperands<1, 2> {
+    InstFBinop(Op opcode_, VOperand d, VOperand sl, VOperand sr)
+        : InstWithOperands(opcode_, {d}, {sl, sr})
+    {
+        assert(HasOpcode(opcode_));
+    }
+
+    static bool classof(Inst *op) { return HasOpcode(op->GetOpcode()); }
+
+    static bool HasOpcode(Op opcode)
+    {
+        return opcode >= Op::InstFBinop_begin && opcode <= Op::InstFBinop_end;
+    }
+};
+
+// Raw bits moves between I32 GPRs and F32 FPRs
+struct InstFMov : InstWithOperands<1, 1> {
+    InstFMov(Op opcode_, VOperand d, VOperand s)
+        : InstWithOperands(opcode_, {d}, {s})
+    {
+        assert(HasOpcode(opcode_));
+    }
+
+    static bool classof(Inst *op) { return HasOpcode(op->GetOpcode()); }
+
+    static bool HasOpcode(Op opcode)
+    {
+        return opcode >= Op::InstFMov_begin && opcode <= Op::InstFMov_end;
+    }
+};
+
+// FPR memory access, the size is taken from the FPR operand type
+struct InstVMFLoad : InstWithOperands<1, 1> {
+    InstVMFLoad(VOperand d, VOperand ptr)
+        : InstWithOperands(Op::_vmfload, {d}, {ptr})
+    {
+    }
+};
+
+struct InstVMFStore : InstWithOperands<0, 2> {
+    InstVMFStore(VOperand ptr, VOperand val)
+        : InstWithOperands(Op::_vmfstore, {}, {ptr, val})
+    {
+    }
+};
+
+// Ordered comparison, d is 0 if unordered. Only EQ, LT and LE are supported
+struct InstFCmp : InstWithOperands<1, 2> {
+    InstFCmp(CondCode cc_, VOperand d, VOperand sl, VOperand sr)
+        : InstWithOperands(Op::_fcmp, {d}, {sl, sr}), cc(cc_)
+    {
+        assert(cc == CondCode::EQ || cc == CondCode::LT ||
+               cc == CondCode::LE);
+    }
+
+    CondCode cc;
+};
+
+// Conversion to integer with static rounding, saturates like RISC-V.
+// Rounding other than ZERO requires qcg::HasFRoundOps()
+struct InstFCvtFI : InstWithOperands<1, 1> {
+    InstFCvtFI(VSign sgn_, FRound rm_, VOperand d, VOperand s)
+        : InstWithOperands(Op::_fcvtfi, {d}, {s}), sgn(sgn_), rm(rm_)
+    {
+    }
+
+    VSign sgn;
+    FRound rm;
+};
+
+// Conversion from integer, rounded with current rounding mode
+struct InstFCvtIF : InstWithOperands<1, 1> {
+    InstFCvtIF(VSign sgn_, VOperand d, VOperand s)
+        : InstWithOperands(Op::_fcvtif, {d}, {s}), sgn(sgn_)
+    {
+    }
+
+    VSign sgn;
+};
+
+// Vector register group access, vector operands are V128 or V256 slots
+struct InstVecLoad : InstWithOperands<1, 1> {
+    InstVecLoad(VOperand d, VOperand ptr)
+        : InstWithOperands(Op::_vecld, {d}, {ptr})
+    {
+    }
+};
+
+struct InstVecStore : InstWithOperands<0, 2> {
+    InstVecStore(VOperand ptr, VOperand val)
+        : InstWithOperands(Op::_vecst, {}, {ptr, val})
+    {
+    }
+};
+
+// Elementwise op on sew-sized elements, sr is a vector slot or a scalar
+// broadcasted to all elements. tidx selects the tail mask in guest state,
+// tail bytes of d are left undisturbed
+struct InstVecBinop : InstWithOperands<1, 3> {
+    InstVecBinop(Op opcode_,
+                 VType sew_,
+                 VOperand d,
+                 VOperand sl,
+                 VOperand sr,
+                 VOperand tidx)
+        : InstWithOperands(opcode_, {d}, {sl, sr, tidx}), sew(sew_)
+    {
+        assert(HasOpcode(opcode_));
+    }
+
+    static bool classof(Inst *op) { return HasOpcode(op->GetOpcode()); }
+
+    static bool HasOpcode(Op opcode)
+    {
+        return opcode >= Op::InstVecBinop_begin &&
+               opcode <= Op::InstVecBinop_end;
+    }
+
+    VType sew;
+};
+
+// Adds n to the guest retired instructions counter
+struct InstICount : InstNoOperands {
+    InstICount(u32 n_) : InstNoOperands(Op::_icount), n(n_) {}
+
+    u32 n;
+};
+
+// Host timestamp counter, in HostClock ns if scaled. hi selects the upper word
+struct InstRdtsc : InstWithOperands<1, 0> {
+    InstRdtsc(bool scaled_, bool hi_, VOperand d)
+        : InstWithOperands(Op::_rdtsc, {d}, {}), scaled(scaled_), hi(hi_)
+    {
+    }
+
+    bool scaled;
+    bool hi;
+};
+
 struct InstSetcc : InstWithOperands<1, 2> {
     InstSetcc(CondCode cc_, VOperand d, VOperand sl, VOperand sr)
         : InstWithOperands(Op::_setcc, {d}, {sl, sr}), cc(cc_)
@@ -665,6 +953,8 @@ struct Region : InArena {
 
     u32 GetNumBlocks() const { return bb_id_counter; }
 
+    u32 GetNumInsts() const { return inst_id_counter; }
+
     MemArena *GetArena() { return arena; }
 
     VRegsInfo *GetVRegsInfo() { return &vregs_info; }
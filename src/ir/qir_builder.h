@@ -46,11 +46,12 @@ public:
     QIR_BASE_OPS_LIST(OP)
 #undef OP
 
-#define CLASS(cls, beg, end)                                             \
-    template <typename... Args>                                          \
-    Inst *Create##cls(Op op, Args &&...args)                             \
-    {                                                                    \
-        return Create<cls>(GetOpFlags(op), std::forward<Args>(args)...); \
+#define CLASS(cls, beg, end)                              \
+    template <typename... Args>                           \
+    Inst *Create##cls(Op op, Args &&...args)              \
+    {                                                     \
+        return Create<cls>(GetOpFlags(op), op,            \
+                           std::forward<Args>(args)...);  \
     }
     QIR_CLASS_LIST(CLASS)
 #undef CLASS
@@ -8,12 +8,19 @@
     BASE(brcc, InstBrcc, 0)                                   \
     BASE(gbr, InstGBr, Flags::REXIT)                          \
     BASE(gbrind, InstGBrind, Flags::REXIT)                    \
+    BASE(raspush, InstRasPush, Flags::SIDEEFF)                \
     BASE(vmload, InstVMLoad, Flags::SIDEEFF)                  \
     BASE(vmstore, InstVMStore, Flags::SIDEEFF)                \
+    BASE(vmlr, InstVMLr, Flags::SIDEEFF)                      \
+    BASE(vmsc, InstVMSc, Flags::SIDEEFF)                      \
     BASE(setcc, InstSetcc, 0)                                 \
     /* unary */                                               \
     LEAF(mov, InstUnop, 0)                                    \
-    CLASS(InstUnop, mov, mov)                                 \
+    LEAF(clz, InstUnop, 0)                                    \
+    LEAF(ctz, InstUnop, 0)                                    \
+    LEAF(cpop, InstUnop, 0)                                   \
+    LEAF(bswap, InstUnop, 0)                                  \
+    CLASS(InstUnop, mov, bswap)                               \
     /* binary */                                              \
     LEAF(add, InstBinop, 0)                                   \
     LEAF(sub, InstBinop, 0)                                   \
@@ -23,7 +30,72 @@
     LEAF(sra, InstBinop, 0)                                   \
     LEAF(srl, InstBinop, 0)                                   \
     LEAF(sll, InstBinop, 0)                                   \
-    CLASS(InstBinop, add, sll)
+    LEAF(mul, InstBinop, 0)                                   \
+    LEAF(mulh, InstBinop, 0)                                  \
+    LEAF(mulhsu, InstBinop, 0)                                \
+    LEAF(mulhu, InstBinop, 0)                                 \
+    LEAF(div, InstBinop, 0)                                   \
+    LEAF(divu, InstBinop, 0)                                  \
+    LEAF(rem, InstBinop, 0)                                   \
+    LEAF(remu, InstBinop, 0)                                  \
+    LEAF(andn, InstBinop, 0)                                  \
+    LEAF(rol, InstBinop, 0)                                   \
+    LEAF(ror, InstBinop, 0)                                   \
+    LEAF(min, InstBinop, 0)                                   \
+    LEAF(max, InstBinop, 0)                                   \
+    LEAF(minu, InstBinop, 0)                                  \
+    LEAF(maxu, InstBinop, 0)                                  \
+    LEAF(bset, InstBinop, 0)                                  \
+    LEAF(bclr, InstBinop, 0)                                  \
+    LEAF(binv, InstBinop, 0)                                  \
+    CLASS(InstBinop, add, binv)                               \
+    /* atomic rmw */                                          \
+    LEAF(amoswap, InstVMAtomic, Flags::SIDEEFF)               \
+    LEAF(amoadd, InstVMAtomic, Flags::SIDEEFF)                \
+    LEAF(amoxor, InstVMAtomic, Flags::SIDEEFF)                \
+    LEAF(amoand, InstVMAtomic, Flags::SIDEEFF)                \
+    LEAF(amoor, InstVMAtomic, Flags::SIDEEFF)                 \
+    LEAF(amomin, InstVMAtomic, Flags::SIDEEFF)                \
+    LEAF(amomax, InstVMAtomic, Flags::SIDEEFF)                \
+    LEAF(amominu, InstVMAtomic, Flags::SIDEEFF)               \
+    LEAF(amomaxu, InstVMAtomic, Flags::SIDEEFF)               \
+    CLASS(InstVMAtomic, amoswap, amomaxu)                     \
+    /* floating point */                                      \
+    BASE(fcmp, InstFCmp, 0)                                   \
+    BASE(fcvtfi, InstFCvtFI, 0)                               \
+    BASE(fcvtif, InstFCvtIF, 0)                               \
+    BASE(vmfload, InstVMFLoad, Flags::SIDEEFF)                \
+    BASE(vmfstore, InstVMFStore, Flags::SIDEEFF)              \
+    LEAF(fsqrt, InstFUnop, 0)                                 \
+    LEAF(fcvt, InstFUnop, 0)                                  \
+    LEAF(funbox, InstFUnop, 0)                                \
+    CLASS(InstFUnop, fsqrt, funbox)                           \
+    LEAF(fadd, InstFBinop, 0)                                 \
+    LEAF(fsub, InstFBinop, 0)                                 \
+    LEAF(fmul, InstFBinop, 0)                                 \
+    LEAF(fdiv, InstFBinop, 0)                                 \
+    LEAF(fmin, InstFBinop, 0)                                 \
+    LEAF(fmax, InstFBinop, 0)                                 \
+    LEAF(fsgnj, InstFBinop, 0)                                \
+    LEAF(fsgnjn, InstFBinop, 0)                               \
+    LEAF(fsgnjx, InstFBinop, 0)                               \
+    CLASS(InstFBinop, fadd, fsgnjx)                           \
+    LEAF(fmvfi, InstFMov, 0)                                  \
+    LEAF(fmvif, InstFMov, 0)                                  \
+    CLASS(InstFMov, fmvfi, fmvif)                             \
+    /* vector */                                              \
+    BASE(vecld, InstVecLoad, Flags::SIDEEFF)                  \
+    BASE(vecst, InstVecStore, Flags::SIDEEFF)                 \
+    LEAF(vecadd, InstVecBinop, 0)                             \
+    LEAF(vecsub, InstVecBinop, 0)                             \
+    LEAF(vecmul, InstVecBinop, 0)                             \
+    LEAF(vecand, InstVecBinop, 0)                             \
+    LEAF(vecor, InstVecBinop, 0)                              \
+    LEAF(vecxor, InstVecBinop, 0)                             \
+    CLASS(InstVecBinop, vecadd, vecxor)                       \
+    /* guest counters */                                      \
+    BASE(icount, InstICount, Flags::SIDEEFF)                  \
+    BASE(rdtsc, InstRdtsc, 0)
 
 #define QIR_OPS_LIST(OP) QIR_DEF_LIST(OP, OP, EMPTY_MACRO)
 #define QIR_LEAF_OPS_LIST(LEAF) QIR_DEF_LIST(LEAF, EMPTY_MACRO, EMPTY_MACRO)
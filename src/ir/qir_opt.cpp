@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <bit>
+
 #include "ir/qir_opt.h"
 #include "ir/qir_builder.h"
 
@@ -53,4 +56,490 @@ Inst *ApplyFolder(Block *bb, Inst *ins)
     return FolderVisitor(bb, ins).Apply();
 }
 
+static u32 TruncConst(VType type, u32 val)
+{
+    switch (type) {
+    case VType::I8:
+        return (u8) val;
+    case VType::I16:
+        return (u16) val;
+    default:
+        return val;
+    }
+}
+
+static bool EvalBinop(Op op, u32 a, u32 b, u32 *res)
+{
+    switch (op) {
+    case Op::_add:
+        *res = a + b;
+        return true;
+    case Op::_sub:
+        *res = a - b;
+        return true;
+    case Op::_and:
+        *res = a & b;
+        return true;
+    case Op::_or:
+        *res = a | b;
+        return true;
+    case Op::_xor:
+        *res = a ^ b;
+        return true;
+    case Op::_sll:
+        *res = a << (b & 31);
+        return true;
+    case Op::_srl:
+        *res = a >> (b & 31);
+        return true;
+    case Op::_sra:
+        *res = (i32) a >> (b & 31);
+        return true;
+    case Op::_mul:
+        *res = a * b;
+        return true;
+    case Op::_mulh:
+        *res = ((i64) (i32) a * (i64) (i32) b) >> 32;
+        return true;
+    case Op::_mulhsu:
+        *res = ((i64) (i32) a * (i64) b) >> 32;
+        return true;
+    case Op::_mulhu:
+        *res = ((u64) a * (u64) b) >> 32;
+        return true;
+    case Op::_div:
+        if (b == 0)
+            *res = -1;
+        else if (b == (u32) -1)
+            *res = -a;
+        else
+            *res = (i32) a / (i32) b;
+        return true;
+    case Op::_divu:
+        *res = b ? a / b : -1;
+        return true;
+    case Op::_rem:
+        if (b == 0)
+            *res = a;
+        else if (b == (u32) -1)
+            *res = 0;
+        else
+            *res = (i32) a % (i32) b;
+        return true;
+    case Op::_remu:
+        *res = b ? a % b : a;
+        return true;
+    case Op::_andn:
+        *res = a & ~b;
+        return true;
+    case Op::_rol:
+        *res = std::rotl(a, b & 31);
+        return true;
+    case Op::_ror:
+        *res = std::rotr(a, b & 31);
+        return true;
+    case Op::_min:
+        *res = std::min((i32) a, (i32) b);
+        return true;
+    case Op::_max:
+        *res = std::max((i32) a, (i32) b);
+        return true;
+    case Op::_minu:
+        *res = std::min(a, b);
+        return true;
+    case Op::_maxu:
+        *res = std::max(a, b);
+        return true;
+    case Op::_bset:
+        *res = a | (1u << (b & 31));
+        return true;
+    case Op::_bclr:
+        *res = a & ~(1u << (b & 31));
+        return true;
+    case Op::_binv:
+        *res = a ^ (1u << (b & 31));
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool EvalUnop(Op op, u32 a, u32 *res)
+{
+    switch (op) {
+    case Op::_clz:
+        *res = std::countl_zero(a);
+        return true;
+    case Op::_ctz:
+        *res = std::countr_zero(a);
+        return true;
+    case Op::_cpop:
+        *res = std::popcount(a);
+        return true;
+    case Op::_bswap:
+        *res = __builtin_bswap32(a);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool EvalCondCode(CondCode cc, u32 a, u32 b)
+{
+    switch (cc) {
+    case CondCode::EQ:
+        return a == b;
+    case CondCode::NE:
+        return a != b;
+    case CondCode::LE:
+        return (i32) a <= (i32) b;
+    case CondCode::LT:
+        return (i32) a < (i32) b;
+    case CondCode::GE:
+        return (i32) a >= (i32) b;
+    case CondCode::GT:
+        return (i32) a > (i32) b;
+    case CondCode::LEU:
+        return a <= b;
+    case CondCode::LTU:
+        return a < b;
+    case CondCode::GEU:
+        return a >= b;
+    case CondCode::GTU:
+        return a > b;
+    default:
+        unreachable("");
+    }
+}
+
+static bool IsCommutative(Op op)
+{
+    return op == Op::_add || op == Op::_and || op == Op::_or ||
+           op == Op::_xor || op == Op::_mul || op == Op::_mulh ||
+           op == Op::_mulhu || op == Op::_min || op == Op::_max ||
+           op == Op::_minu || op == Op::_maxu;
+}
+
+// Result of binop with zero rhs: lhs, zero or unknown
+static VOperand const *ZeroRhsResult(Op op, VOperand const &lhs,
+                                     VOperand const &rhs)
+{
+    switch (op) {
+    case Op::_add:
+    case Op::_sub:
+    case Op::_or:
+    case Op::_xor:
+    case Op::_sll:
+    case Op::_srl:
+    case Op::_sra:
+    case Op::_andn:
+    case Op::_rol:
+    case Op::_ror:
+    case Op::_maxu:
+        return &lhs;
+    case Op::_and:
+    case Op::_mul:
+    case Op::_mulh:
+    case Op::_mulhsu:
+    case Op::_mulhu:
+    case Op::_minu:
+        return &rhs;
+    default:
+        return nullptr;
+    }
+}
+
+/* Regions are not in SSA form, so everything is tracked per block and
+ * invalidated on redefinition. Locals never escape blocks, globals are
+ * conservatively unknown at block entry.
+ */
+struct Propagation {
+    explicit Propagation(Region *region_)
+        : region(region_), vregs_info(region->GetVRegsInfo()),
+          vals(vregs_info->NumAll())
+    {
+    }
+
+    void Run();
+
+private:
+    struct ValInfo {
+        enum class Kind : u8 {
+            NONE,
+            CONST,
+            COPY,
+        };
+        Kind kind{Kind::NONE};
+        u32 val{};  // constant or source vreg
+    };
+
+    struct Expr {
+        Op op;
+        CondCode cc;
+        u64 lhs, rhs;
+        RegN holder;
+    };
+
+    static u64 OprKey(VOperand const &opr)
+    {
+        if (opr.IsConst())
+            return ((u64) 1 << 32) | opr.GetConst();
+        return opr.GetVGPR();
+    }
+
+    void Reset();
+    void Set(RegN r, ValInfo::Kind kind, u32 val);
+    void Kill(RegN r);
+    void Substitute(VOperand &opr);
+    Expr MakeExpr(Inst *ins);
+    RegN LookupExpr(Inst *ins);
+    Inst *Replace(Block *bb, Inst *ins, VOperand dst, VOperand src);
+    Inst *Simplify(Block *bb, Inst *ins);
+    void Record(Inst *ins);
+
+    Region *region;
+    VRegsInfo const *vregs_info;
+    std::vector<ValInfo> vals;
+    std::vector<RegN> tracked;  // vregs with known values
+    std::vector<Expr> exprs;
+};
+
+void Propagation::Reset()
+{
+    for (auto r : tracked)
+        vals[r] = ValInfo{};
+    tracked.clear();
+    exprs.clear();
+}
+
+void Propagation::Set(RegN r, ValInfo::Kind kind, u32 val)
+{
+    if (vals[r].kind == ValInfo::Kind::NONE)
+        tracked.push_back(r);
+    vals[r] = ValInfo{kind, val};
+}
+
+void Propagation::Kill(RegN r)
+{
+    vals[r] = ValInfo{};
+    for (auto t : tracked) {
+        auto &vi = vals[t];
+        if (vi.kind == ValInfo::Kind::COPY && vi.val == r)
+            vi = ValInfo{};
+    }
+    std::erase_if(exprs, [r](Expr const &e) {
+        return e.holder == r || e.lhs == r || e.rhs == r;
+    });
+}
+
+void Propagation::Substitute(VOperand &opr)
+{
+    if (!opr.IsVGPR())
+        return;
+    auto const &vi = vals[opr.GetVGPR()];
+    auto type = opr.GetType();
+    switch (vi.kind) {
+    case ValInfo::Kind::CONST:
+        opr = VOperand::MakeConst(type, TruncConst(type, vi.val));
+        break;
+    case ValInfo::Kind::COPY:
+        opr = VOperand::MakeVGPR(type, vi.val);
+        break;
+    default:
+        break;
+    }
+}
+
+Propagation::Expr Propagation::MakeExpr(Inst *ins)
+{
+    Expr e{ins->GetOpcode(), CondCode::EQ, OprKey(ins->i(0)),
+           OprKey(ins->i(1)), ins->o(0).GetVGPR()};
+    if (e.op == Op::_setcc)
+        e.cc = static_cast<InstSetcc *>(ins)->cc;
+    else if (IsCommutative(e.op) && e.lhs > e.rhs)
+        std::swap(e.lhs, e.rhs);
+    return e;
+}
+
+RegN Propagation::LookupExpr(Inst *ins)
+{
+    auto e = MakeExpr(ins);
+    for (auto const &x : exprs) {
+        if (x.op == e.op && x.cc == e.cc && x.lhs == e.lhs && x.rhs == e.rhs)
+            return x.holder;
+    }
+    return RegNBad;
+}
+
+Inst *Propagation::Replace(Block *bb, Inst *ins, VOperand dst, VOperand src)
+{
+    Inst *res = nullptr;
+    if (!src.IsVGPR() || src.GetVGPR() != dst.GetVGPR())
+        res = Builder(bb, ins->getIter()).Create_mov(dst, src);
+    bb->ilist.erase(ins->getIter());
+    return res;
+}
+
+// Returns replacement, or nullptr if ins is removed
+Inst *Propagation::Simplify(Block *bb, Inst *ins)
+{
+    auto op = ins->GetOpcode();
+    if (op == Op::_mov) {
+        auto &src = ins->i(0);
+        auto &dst = ins->o(0);
+        if (src.IsVGPR() && dst.IsVGPR() && src.GetVGPR() == dst.GetVGPR())
+            return Replace(bb, ins, dst, src);
+        return ins;
+    }
+    if (InstUnop::classof(ins)) {
+        auto &src = ins->i(0);
+        u32 res;
+        if (src.IsConst() && EvalUnop(op, src.GetConst(), &res)) {
+            auto dst = ins->o(0);
+            return Replace(bb, ins, dst,
+                           VOperand::MakeConst(dst.GetType(), res));
+        }
+        return ins;
+    }
+    if (!InstBinop::classof(ins) && op != Op::_setcc)
+        return ins;
+
+    auto &lhs = ins->i(0), &rhs = ins->i(1);
+    auto dst = ins->o(0);
+    if (lhs.IsConst() && rhs.IsConst()) {
+        u32 a = lhs.GetConst(), b = rhs.GetConst(), res;
+        if (op == Op::_setcc)
+            res = EvalCondCode(static_cast<InstSetcc *>(ins)->cc, a, b);
+        else if (!EvalBinop(op, a, b, &res))
+            return ins;
+        return Replace(bb, ins, dst, VOperand::MakeConst(dst.GetType(), res));
+    }
+    if (rhs.IsConst() && rhs.GetConst() == 0) {
+        if (auto res = ZeroRhsResult(op, lhs, rhs))
+            return Replace(bb, ins, dst, *res);
+    }
+    if (auto holder = LookupExpr(ins); holder != RegNBad)
+        return Replace(bb, ins, dst, VOperand::MakeVGPR(dst.GetType(), holder));
+    return ins;
+}
+
+void Propagation::Record(Inst *ins)
+{
+    auto outs = ins->outputs();
+    for (u8 i = 0; i < outs.size(); ++i) {
+        if (outs[i].IsVGPR())
+            Kill(outs[i].GetVGPR());
+    }
+    // Helpers may access guest state
+    if (ins->GetFlags() & Inst::HAS_CALLS) {
+        for (RegN r = 0; r < vregs_info->NumGlobals(); ++r)
+            Kill(r);
+    }
+
+    if (outs.size() != 1 || !outs[0].IsVGPR())
+        return;
+    auto dst = outs[0];
+    if (dst.GetType() != VType::I32)
+        return;
+
+    auto op = ins->GetOpcode();
+    if (op == Op::_mov) {
+        auto &src = ins->i(0);
+        if (src.IsConst())
+            Set(dst.GetVGPR(), ValInfo::Kind::CONST, src.GetConst());
+        else if (src.IsVGPR() && src.GetType() == VType::I32)
+            Set(dst.GetVGPR(), ValInfo::Kind::COPY, src.GetVGPR());
+    } else if (InstBinop::classof(ins) || op == Op::_setcc) {
+        auto e = MakeExpr(ins);
+        // Value of the expression is lost if dst is an operand
+        if (e.lhs != e.holder && e.rhs != e.holder)
+            exprs.push_back(e);
+    }
+}
+
+void Propagation::Run()
+{
+    for (auto &bb : region->GetBlocks()) {
+        Reset();
+        auto &ilist = bb.ilist;
+        for (auto iit = ilist.begin(); iit != ilist.end();) {
+            auto *ins = &*iit++;
+            auto inputs = ins->inputs();
+            for (u8 i = 0; i < inputs.size(); ++i)
+                Substitute(inputs[i]);
+            if ((ins = Simplify(&bb, ins)))
+                Record(ins);
+        }
+    }
+}
+
+void PropagationPass::run(Region *region)
+{
+    Propagation(region).Run();
+}
+
+void DCEPass::run(Region *region)
+{
+    auto *vregs_info = region->GetVRegsInfo();
+    RegN n_globals = vregs_info->NumGlobals();
+    std::vector<bool> live(vregs_info->NumAll());
+
+    auto set_globals = [&](GlobalsMask mask) {
+        for (RegN r = 0; r < n_globals; ++r)
+            live[r] = mask & ((GlobalsMask) 1 << r);
+    };
+
+    for (auto &bb : region->GetBlocks()) {
+        // Locals never escape blocks, globals may be read by successors
+        std::fill(live.begin(), live.end(), false);
+        set_globals(GlobalsAll);
+
+        auto &ilist = bb.ilist;
+        for (auto iit = ilist.end(); iit != ilist.begin();) {
+            auto *ins = &*--iit;
+            if (ins->GetOpcode() == Op::_gbr)
+                set_globals(static_cast<InstGBr *>(ins)->live);
+            else if (ins->GetOpcode() == Op::_gbrind)
+                set_globals(GlobalsAll);
+
+            auto outs = ins->outputs();
+            if (!ins->GetFlags() && outs.size()) {
+                bool used = false;
+                for (u8 i = 0; i < outs.size(); ++i)
+                    used |= !outs[i].IsVGPR() || live[outs[i].GetVGPR()];
+                if (!used) {
+                    iit = ilist.erase(iit);
+                    continue;
+                }
+            }
+
+            for (u8 i = 0; i < outs.size(); ++i) {
+                if (outs[i].IsVGPR())
+                    live[outs[i].GetVGPR()] = false;
+            }
+            auto inputs = ins->inputs();
+            for (u8 i = 0; i < inputs.size(); ++i) {
+                if (inputs[i].IsVGPR())
+                    live[inputs[i].GetVGPR()] = true;
+            }
+            if (ins->GetOpcode() == Op::_hcall) {
+                auto uses = static_cast<InstHcall *>(ins)->uses;
+                for (RegN r = 0; r < n_globals; ++r)
+                    live[r] = live[r] || (uses & ((GlobalsMask) 1 << r));
+            }
+        }
+    }
+}
+
+static constexpr void (*opt_pipeline[])(Region *) = {
+    PropagationPass::run,
+    DCEPass::run,
+};
+
+void OptimizeRegion(Region *region)
+{
+    for (auto pass : opt_pipeline)
+        pass(region);
+}
+
 }  // namespace dbt::qir
@@ -5,4 +5,18 @@
 namespace dbt::qir
 {
 Inst *ApplyFolder(Block *bb, Inst *ins);
-}
+
+// Constant and copy propagation, folding and local value numbering
+struct PropagationPass {
+    static void run(Region *region);
+};
+
+// Removes instructions whose results are never read
+struct DCEPass {
+    static void run(Region *region);
+};
+
+// Optimization pipeline, runs on translated region before codegen
+void OptimizeRegion(Region *region);
+
+}  // namespace dbt::qir
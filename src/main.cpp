@@ -1,9 +1,36 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
+#include "codegen/jitabi.h"
 #include "env.h"
+#include "execute.h"
 #include "guest/rv32_cpu.h"
+#include "guest/rv32_interp.h"
+#include "ir/compile.h"
+#include "pcache.h"
 #include "tcache.h"
 
+// Comma-separated guest register numbers, e.g. "2,1,10,11"
+static void InitPinnedRegs(char const *list)
+{
+    std::vector<u16> offs;
+    for (char const *p = list; *p;) {
+        char *end;
+        long r = strtol(p, &end, 10);
+        if (end == p || r <= 0 || r >= 32)
+            dbt::Panic("Bad RV32JIT_PINNED_REGS");
+        u16 o = offsetof(dbt::CPUState, gpr) + sizeof(u32) * r;
+        // Two host copies of one guest register would go out of sync
+        if (std::find(offs.begin(), offs.end(), o) != offs.end())
+            dbt::Panic("Duplicate register in RV32JIT_PINNED_REGS");
+        offs.push_back(o);
+        p = *end == ',' ? end + 1 : end;
+    }
+    dbt::jitabi::PinnedRegs::Init(offs);
+}
+
 int main(int argc, char **argv)
 {
     if (argc < 2) {
@@ -12,10 +39,38 @@ int main(int argc, char **argv)
     }
 
     dbt::mmu::Init();
-    dbt::tcache::Init();
+    // Code cache size in KiB, small ones force evictions
+    size_t code_cache_size = dbt::tcache::CODE_POOL_SIZE;
+    if (char const *n = getenv("RV32JIT_CODE_CACHE_KB")) {
+        size_t kb = std::max(atoi(n), 512);
+        code_cache_size = std::min(kb * 1024, code_cache_size);
+    }
+    dbt::tcache::Init(code_cache_size);
+    // Code cache statistics to stderr at exit
+    if (getenv("RV32JIT_TCACHE_STATS"))
+        dbt::tcache::EnableStats();
+    // Guest registers kept in host registers across translated regions
+    if (char const *s = getenv("RV32JIT_PINNED_REGS"))
+        InitPinnedRegs(s);
+    // Number of background compiler threads, 0 means synchronous mode
+    if (char const *n = getenv("RV32JIT_COMPILE_THREADS"))
+        dbt::qir::CompilerPool::Init(atoi(n));
+    // Number of interpreted entries before a block is compiled
+    if (char const *n = getenv("RV32JIT_HOT_THRESHOLD"))
+        dbt::rv32::InterpTier::hot_threshold = atoi(n);
     dbt::env env{};
     auto elf = &dbt::env::exe_elf_image;
     env.BootElf(argv[1], elf);
+    // Translations saved by previous runs of the same image
+    if (char const *dir = getenv("RV32JIT_PCACHE_DIR")) {
+        dbt::pcache::Init(dir, dbt::env::ExecSegments(elf));
+        dbt::pcache::Load();
+    }
+    // Number of threads translating the whole image before it runs
+    if (char const *n = getenv("RV32JIT_AOT_THREADS")) {
+        dbt::CompileAhead(dbt::env::ExecSegments(elf),
+                          dbt::env::CodeRoots(elf), std::max(atoi(n), 1));
+    }
     env.InitArgVectors(elf, argc - 1, argv + 1);
 
     dbt::CPUState state{};
@@ -23,6 +78,10 @@ int main(int argc, char **argv)
     dbt::env::InitSignals(&state);
     int guest_rc = env.Execute(&state);
 
+    dbt::qir::CompilerPool::Destroy();
+    dbt::pcache::Save();
+    if (dbt::tcache::StatsEnabled())
+        dbt::tcache::PrintStats(stderr);
     dbt::tcache::Destroy();
     dbt::mmu::Destroy();
     return guest_rc;
@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <cstdlib>
 #include <map>
@@ -24,6 +26,31 @@ void *host_mmap(void *addr,
 u8 *mmu::base{nullptr};
 u32 mmu::mmap_hint_page = mmu::MIN_MMAP_ADDR >> mmu::PAGE_BITS;
 std::bitset<(mmu::ASPACE_SIZE >> mmu::PAGE_BITS)> mmu::used_pages;
+std::array<u8, (mmu::ASPACE_SIZE >> mmu::PAGE_BITS)> mmu::page_prot;
+u32 mmu::code_write_count{0};
+std::mutex mmu::mtx;
+
+// Write faults are handled under mtx, so they are blocked while it's held:
+// the handler must not interrupt the owner. A fault while blocked is fatal
+struct mmu::SignalSafeLock {
+    SignalSafeLock()
+    {
+        sigset_t sset;
+        sigemptyset(&sset);
+        sigaddset(&sset, SIGSEGV);
+        sigaddset(&sset, SIGBUS);
+        pthread_sigmask(SIG_BLOCK, &sset, &saved);
+        mtx.lock();
+    }
+
+    ~SignalSafeLock()
+    {
+        mtx.unlock();
+        pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    }
+
+    sigset_t saved;
+};
 
 void mmu::Init()
 {
@@ -34,7 +61,7 @@ void mmu::Init()
     base = (u8 *) ::mmap(NULL, ASPACE_SIZE, PROT_NONE,
                          MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
     if (base == MAP_FAILED ||
-        munmap(base + MIN_MMAP_ADDR, ASPACE_SIZE - MIN_MMAP_ADDR)) {
+        ::munmap(base + MIN_MMAP_ADDR, ASPACE_SIZE - MIN_MMAP_ADDR)) {
         Panic("mmu::Init failed");
     }
 #endif
@@ -42,7 +69,7 @@ void mmu::Init()
 
 void mmu::Destroy()
 {
-    int rc = munmap(base, ASPACE_SIZE);
+    int rc = ::munmap(base, ASPACE_SIZE);
     if (rc)
         Panic("mmu::Destroy failed");
 }
@@ -83,6 +110,7 @@ void *mmu::mmap(u32 vaddr, u32 len, int prot, int flags, int fd, size_t offs)
         if (hptr == MAP_FAILED)
             return MAP_FAILED;
         MarkUsedPages(vaddr >> PAGE_BITS, plen);
+        SetPageProt(vaddr, len, prot);
         return hptr;
     }
 
@@ -118,8 +146,77 @@ void *mmu::mmap(u32 vaddr, u32 len, int prot, int flags, int fd, size_t offs)
         Panic();
     paddr = h2g(hptr) >> PAGE_BITS;
     MarkUsedPages(paddr, plen);
+    SetPageProt(paddr << PAGE_BITS, len, prot);
     mmap_hint_page = paddr + plen;
     return res;
 }
 
+// Code pages must be dropped by the caller, remapping resets protection
+void mmu::SetPageProt(u32 vaddr, u32 len, int prot)
+{
+    u32 const pend = ((u64) vaddr + len) >> PAGE_BITS;
+    SignalSafeLock lock;
+    for (u32 p = vaddr >> PAGE_BITS; p < pend; ++p)
+        __atomic_store_n(&page_prot[p], (u8) prot, __ATOMIC_RELEASE);
+}
+
+int mmu::munmap(u32 vaddr, u32 len)
+{
+    len = roundup(len, PAGE_SIZE);
+    int rc = ::munmap(g2h(vaddr), len);
+    if (rc == 0)
+        SetPageProt(vaddr, len, PROT_NONE);
+    return rc;
+}
+
+int mmu::mprotect(u32 vaddr, u32 len, int prot)
+{
+    len = roundup(len, PAGE_SIZE);
+    int rc = ::mprotect(g2h(vaddr), len, prot);
+    if (rc == 0)
+        SetPageProt(vaddr, len, prot);
+    return rc;
+}
+
+void mmu::ProtectCode(u32 pvaddr)
+{
+    u32 p = pvaddr >> PAGE_BITS;
+    // Most calls hit already protected pages
+    if (__atomic_load_n(&page_prot[p], __ATOMIC_ACQUIRE) & PROT_CODE)
+        return;
+    SignalSafeLock lock;
+    u8 prot = page_prot[p];
+    if (prot & PROT_CODE)
+        return;
+    if ((prot & PROT_WRITE) &&
+        ::mprotect(g2h(pvaddr), PAGE_SIZE, prot & ~PROT_WRITE)) {
+        Panic("mmu::ProtectCode failed");
+    }
+    __atomic_store_n(&page_prot[p], (u8) (prot | PROT_CODE), __ATOMIC_RELEASE);
+}
+
+bool mmu::UnprotectCode(u32 pvaddr)
+{
+    u32 p = pvaddr >> PAGE_BITS;
+    // Syscall buffers mostly span data pages
+    if (!(__atomic_load_n(&page_prot[p], __ATOMIC_ACQUIRE) & PROT_CODE))
+        return false;
+    SignalSafeLock lock;
+    u8 prot = page_prot[p];
+    if (!(prot & PROT_CODE))
+        return false;
+    prot &= ~PROT_CODE;
+    if ((prot & PROT_WRITE) && ::mprotect(g2h(pvaddr), PAGE_SIZE, prot))
+        Panic("mmu::UnprotectCode failed");
+    __atomic_store_n(&page_prot[p], prot, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&code_write_count, 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+bool mmu::IsGuestWritable(u32 pvaddr)
+{
+    u32 p = pvaddr >> PAGE_BITS;
+    return __atomic_load_n(&page_prot[p], __ATOMIC_ACQUIRE) & PROT_WRITE;
+}
+
 }  // namespace dbt
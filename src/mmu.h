@@ -1,8 +1,10 @@
 #pragma once
 
 #include <sys/mman.h>
+#include <array>
 #include <bitset>
 #include <cstdint>
+#include <mutex>
 #include <unordered_map>
 
 #include "util/allocator.h"
@@ -23,6 +25,22 @@ struct mmu {
                       int flag = MAP_ANON | MAP_PRIVATE | MAP_FIXED,
                       int fd = -1,
                       size_t offs = 0);
+    static int munmap(u32 vaddr, u32 len);
+    static int mprotect(u32 vaddr, u32 len, int prot);
+
+    // Guest pages holding translated code are write-protected on host, the
+    // first store to such page faults and drops the protection, see env.cpp
+    static void ProtectCode(u32 pvaddr);
+    // Returns false if the page was not write-protected as code
+    static bool UnprotectCode(u32 pvaddr);
+    // Whether a write fault at pvaddr is caused by code protection only
+    static bool IsGuestWritable(u32 pvaddr);
+    // Bumped by UnprotectCode, translations of code read before a change of
+    // this counter may be stale
+    static u32 CodeWriteCount()
+    {
+        return __atomic_load_n(&code_write_count, __ATOMIC_SEQ_CST);
+    }
 
     static ALWAYS_INLINE bool check_h2g(void *hptr)
     {
@@ -44,6 +62,17 @@ private:
     static std::bitset<(ASPACE_SIZE >> PAGE_BITS)> used_pages;
     static u32 mmap_hint_page;
 
+    // Guest-visible protection of pages, PROT_CODE marks write-protected
+    // code pages. Updated under mtx, read without it
+    static constexpr u8 PROT_CODE = 0x80;
+    static std::array<u8, (ASPACE_SIZE >> PAGE_BITS)> page_prot;
+    static u32 code_write_count;
+    // Also taken by the SIGSEGV handler, see SignalSafeLock
+    static std::mutex mtx;
+    struct SignalSafeLock;
+
+    static void SetPageProt(u32 vaddr, u32 len, int prot);
+
     static void MarkUsedPages(u32 pvaddr, u32 plen);
     static void MarkFreePages(u32 pvaddr, u32 plen);
     static u32 LookupFreeRange(u32 pvaddr, u32 plen);
@@ -0,0 +1,334 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pcache.h"
+#include "codegen/jitabi.h"
+#include "codegen/qcg.h"
+#include "execute.h"
+#include "guest/rv32_cpu.h"
+#include "mmu.h"
+#include "tcache.h"
+
+namespace dbt
+{
+bool pcache::enabled{false};
+
+struct PRegion {
+    std::vector<IpRange> ipranges;
+    std::vector<u32> branch_slots;
+    std::vector<u32> brind_ics;
+    std::vector<u8> code;
+};
+
+// File layout, host endianness: PFileHeader, then n_regions of PRegionHeader
+// followed by ipranges, branch_slots, brind_ics and code padded to 4 bytes
+struct PFileHeader {
+    u64 magic;
+    u64 key;
+    u32 n_regions;
+    u32 reserved;
+};
+
+struct PRegionHeader {
+    u32 ip;
+    u32 n_ipranges;
+    u32 n_branch_slots;
+    u32 n_brind_ics;
+    u32 code_size;
+};
+
+static constexpr u64 PCACHE_MAGIC = 0x3243504a32335652;  // "RV32JPC2"
+
+static struct {
+    std::mutex mtx;
+    std::string path;
+    std::vector<IpRange> exec_segs;
+    std::vector<std::vector<u8>> exec_images;  // segments contents at Init
+    u64 key;
+    std::map<u32, PRegion> regions;  // by entry ip
+    bool dirty{false};
+} pstate;
+
+// FNV-1a, enough to tell images and configurations apart
+static u64 Hash(u64 h, void const *data, size_t sz)
+{
+    auto *p = (u8 const *) data;
+    for (size_t i = 0; i < sz; ++i)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+template <typename T>
+static u64 Hash(u64 h, T const &val)
+{
+    return Hash(h, &val, sizeof(val));
+}
+
+static u64 ComputeKey(std::span<IpRange const> exec_segs)
+{
+    u64 h = 0xcbf29ce484222325ull;
+    // State layout and stub ids of the translator binary are baked into code
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        h = Hash(h, st.st_size);
+        h = Hash(h, st.st_mtim);
+    }
+    // Instruction selection follows host ISA extensions
+    h = Hash(h, qcg::HostFeatureBits());
+    for (u32 r = 0; r < CPUState::gpr_num; ++r) {
+        u16 offs = offsetof(CPUState, gpr) + sizeof(u32) * r;
+        h = Hash(h, jitabi::PinnedRegs::Lookup(offs));
+    }
+    for (auto const &[beg, end] : exec_segs) {
+        h = Hash(h, beg);
+        h = Hash(h, end);
+        h = Hash(h, mmu::g2h(beg), end - beg);
+    }
+    return h;
+}
+
+// Translations of code modified at run time must not reach later runs,
+// pages the code is fetched from are compared with the image
+static bool MatchesImage(std::span<IpRange const> ipranges)
+{
+    for (auto const &range : ipranges) {
+        u32 beg = rounddown(range.first, mmu::PAGE_SIZE);
+        u64 end = (u64) CodeLastPage(range.first) + mmu::PAGE_SIZE;
+        for (size_t i = 0; i < pstate.exec_segs.size(); ++i) {
+            auto const &[seg_beg, seg_end] = pstate.exec_segs[i];
+            u32 cmp_beg = std::max(beg, seg_beg);
+            u32 cmp_end = std::min<u64>(end, seg_end);
+            if (cmp_beg >= cmp_end)
+                continue;
+            auto const *orig = pstate.exec_images[i].data() + cmp_beg - seg_beg;
+            if (memcmp(mmu::g2h(cmp_beg), orig, cmp_end - cmp_beg))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool InExecSegments(std::span<IpRange const> ipranges)
+{
+    for (auto const &[beg, end] : ipranges) {
+        bool found = false;
+        for (auto const &seg : pstate.exec_segs)
+            found |= beg >= seg.first && end <= seg.second;
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+void pcache::Init(char const *dir, std::span<IpRange const> exec_segs)
+{
+    pstate.exec_segs.assign(exec_segs.begin(), exec_segs.end());
+    for (auto const &[beg, end] : exec_segs) {
+        auto const *data = (u8 const *) mmu::g2h(beg);
+        pstate.exec_images.emplace_back(data, data + (end - beg));
+    }
+    pstate.key = ComputeKey(exec_segs);
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin",
+             (unsigned long long) pstate.key);
+    pstate.path = std::string(dir) + name;
+    enabled = true;
+}
+
+void pcache::Record(u32 ip,
+                    std::span<u8 const> code,
+                    std::span<IpRange const> ipranges,
+                    RegionRelocs const &relocs)
+{
+    if (!relocs.relocatable || !InExecSegments(ipranges))
+        return;
+    std::lock_guard lock(pstate.mtx);
+    if (!MatchesImage(ipranges))
+        return;
+    PRegion region{{ipranges.begin(), ipranges.end()},
+                   relocs.branch_slots,
+                   relocs.brind_ics,
+                   {code.begin(), code.end()}};
+    pstate.regions.insert_or_assign(ip, std::move(region));
+    pstate.dirty = true;
+}
+
+void pcache::InvalidatePage(u32 pvaddr)
+{
+    if (!enabled)
+        return;
+    std::lock_guard lock(pstate.mtx);
+    std::erase_if(pstate.regions, [&](auto const &e) {
+        for (auto const &range : e.second.ipranges) {
+            if (rounddown(range.first, mmu::PAGE_SIZE) == pvaddr ||
+                CodeLastPage(range.first) == pvaddr) {
+                pstate.dirty = true;
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+// Bounds-checked view of the mapped file
+struct PReader {
+    template <typename T>
+    bool Read(T *val)
+    {
+        if (end - ptr < (ptrdiff_t) sizeof(T))
+            return false;
+        memcpy(val, ptr, sizeof(T));
+        ptr += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool Read(std::vector<T> *vec, u32 n, size_t align = 1)
+    {
+        size_t sz = sizeof(T) * (size_t) n;
+        if ((size_t) (end - ptr) < roundup(sz, align))
+            return false;
+        vec->resize(n);
+        memcpy((void *) vec->data(), ptr, sz);
+        ptr += roundup(sz, align);
+        return true;
+    }
+
+    u8 const *ptr;
+    u8 const *end;
+};
+
+static bool IsValid(PRegion const &r)
+{
+    size_t sz = r.code.size();
+    for (auto offs : r.branch_slots) {
+        if (offs + sizeof(jitabi::ppoint::BranchSlot) > sz || offs % 8)
+            return false;
+    }
+    for (auto offs : r.brind_ics) {
+        if (offs + sizeof(u64) * tcache::BRIND_IC_SIZE > sz || offs % 8)
+            return false;
+    }
+    return !r.ipranges.empty() && InExecSegments(r.ipranges);
+}
+
+// Same steps as JIT region announcement, links are left lazy
+static bool Install(u32 ip, PRegion const &r)
+{
+    auto *tb = tcache::AllocateTBlock(r.code.size(), 8);
+    if (tb == nullptr)
+        return false;
+    for (auto const &range : r.ipranges) {
+        mmu::ProtectCode(rounddown(range.first, mmu::PAGE_SIZE));
+        mmu::ProtectCode(CodeLastPage(range.first));
+    }
+
+    auto *code = (u8 *) tb->tcode.ptr;
+    memcpy(code, r.code.data(), r.code.size());
+    for (auto offs : r.branch_slots)
+        ((jitabi::ppoint::BranchSlot *) (code + offs))->LinkLazyJIT();
+    for (auto offs : r.brind_ics) {
+        auto *ic = (tcache::BrindCacheEntry *) (code + offs);
+        for (u32 i = 0; i < tcache::BRIND_IC_SIZE; ++i)
+            ic[i] = tcache::BrindCacheEntry();
+    }
+
+    tb->ip = ip;
+    if (tcache::Insert(tb) != tb)
+        return true;
+    u32 entry_page = rounddown(ip, mmu::PAGE_SIZE);
+    for (auto const &range : r.ipranges) {
+        u32 page = rounddown(range.first, mmu::PAGE_SIZE);
+        if (page != entry_page)
+            tcache::AddPageDependency(tb, page);
+        u32 last = CodeLastPage(range.first);
+        if (last != page && last != entry_page)
+            tcache::AddPageDependency(tb, last);
+    }
+    return true;
+}
+
+void pcache::Load()
+{
+    int fd = open(pstate.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+
+    PReader rd{(u8 const *) map, (u8 const *) map + st.st_size};
+    PFileHeader hdr;
+    if (rd.Read(&hdr) && hdr.magic == PCACHE_MAGIC && hdr.key == pstate.key) {
+        std::lock_guard lock(pstate.mtx);
+        for (u32 n = 0; n < hdr.n_regions; ++n) {
+            PRegionHeader rh;
+            PRegion r;
+            if (!rd.Read(&rh) || !rd.Read(&r.ipranges, rh.n_ipranges) ||
+                !rd.Read(&r.branch_slots, rh.n_branch_slots) ||
+                !rd.Read(&r.brind_ics, rh.n_brind_ics) ||
+                !rd.Read(&r.code, rh.code_size, sizeof(u32)) || !IsValid(r))
+                break;
+            if (!Install(rh.ip, r))
+                break;
+            pstate.regions.emplace(rh.ip, std::move(r));
+        }
+    }
+    munmap(map, st.st_size);
+}
+
+template <typename T>
+static bool Write(FILE *f, T const *data, size_t n = 1, size_t align = 1)
+{
+    static constexpr u8 pad[8] = {};
+    size_t sz = sizeof(T) * n;
+    size_t pad_sz = roundup(sz, align) - sz;
+    return fwrite(data, 1, sz, f) == sz && fwrite(pad, 1, pad_sz, f) == pad_sz;
+}
+
+void pcache::Save()
+{
+    if (!enabled)
+        return;
+    std::lock_guard lock(pstate.mtx);
+    if (!pstate.dirty)
+        return;
+
+    // Written aside and renamed, so that concurrent runs see a whole file
+    auto tmp_path = pstate.path + "." + std::to_string(getpid());
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr)
+        return;
+    PFileHeader hdr{PCACHE_MAGIC, pstate.key, (u32) pstate.regions.size(), 0};
+    bool ok = Write(f, &hdr);
+    for (auto const &[ip, r] : pstate.regions) {
+        PRegionHeader rh{ip, (u32) r.ipranges.size(),
+                         (u32) r.branch_slots.size(), (u32) r.brind_ics.size(),
+                         (u32) r.code.size()};
+        ok = ok && Write(f, &rh) &&
+             Write(f, r.ipranges.data(), r.ipranges.size()) &&
+             Write(f, r.branch_slots.data(), r.branch_slots.size()) &&
+             Write(f, r.brind_ics.data(), r.brind_ics.size()) &&
+             Write(f, r.code.data(), r.code.size(), sizeof(u32));
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (ok && rename(tmp_path.c_str(), pstate.path.c_str()) == 0)
+        pstate.dirty = false;
+    else
+        unlink(tmp_path.c_str());
+}
+
+}  // namespace dbt
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <span>
+
+#include "ir/compile.h"
+
+namespace dbt
+{
+/* Persistent translation cache, enabled by RV32JIT_PCACHE_DIR.
+ * Relocatable regions translated from PF_X segments of the main executable
+ * are saved at exit and inserted into tcache at startup of the next runs of
+ * the same image. Files are keyed by a hash of the segments contents and of
+ * the translator configuration, mismatching or broken files are ignored.
+ * Regions of code modified at run time are not saved.
+ */
+struct pcache {
+    static void Init(char const *dir, std::span<IpRange const> exec_segs);
+    static bool IsEnabled() { return enabled; }
+
+    static void Load();
+    // Rewrites the file if the set of regions changed
+    static void Save();
+
+    // Keeps a copy of region code as emitted, before BranchSlots are linked
+    static void Record(u32 ip,
+                       std::span<u8 const> code,
+                       std::span<IpRange const> ipranges,
+                       RegionRelocs const &relocs);
+
+    // Guest code in page pvaddr was modified, its regions are dropped
+    static void InvalidatePage(u32 pvaddr);
+
+private:
+    static bool enabled;
+
+    pcache() = delete;
+};
+
+}  // namespace dbt
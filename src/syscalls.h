@@ -221,6 +221,7 @@
     _(rt_tgsigqueueinfo, 240)            \
     _(perf_event_open, 241)              \
     _(accept4, 242)                      \
+    _(riscv_flush_icache, 259)           \
     _(prlimit64, 261)                    \
     _(fanotify_init, 262)                \
     _(fanotify_mark, 263)                \
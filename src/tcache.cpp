@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstring>
+
 #include "tcache.h"
 #include "codegen/jitabi.h"
 
@@ -5,97 +8,437 @@ namespace dbt
 {
 tcache::L1Cache tcache::l1_cache{};
 tcache::L1BrindCache tcache::l1_brind_cache{};
-tcache::MapType tcache::tcache_map{};
+tcache::PageDir tcache::page_dir{};
+MemArena tcache::idx_pool{};
 MemArena tcache::code_pool{};
 MemArena tcache::tb_pool{};
 std::multimap<u32, jitabi::ppoint::BranchSlot *> tcache::link_map;
+std::multimap<u32, tcache::BrindCacheEntry *> tcache::brind_ic_map;
+std::multimap<u32, TBlock *> tcache::xpage_map;
+std::array<tcache::Generation, tcache::N_GENERATIONS> tcache::gens{};
+size_t tcache::code_gen_size{CODE_POOL_SIZE / N_GENERATIONS};
+u32 tcache::cur_gen{0};
+bool tcache::evict_pending{false};
+u32 tcache::flush_count{0};
+bool tcache::stats_enabled{false};
+constinit thread_local tcache::ThreadCounters tcache::thread_counters{};
+std::vector<tcache::ThreadCounters *> tcache::live_counters;
+tcache::ThreadCounters tcache::exited_counters{};
+u64 tcache::n_blocks{0};
+u64 tcache::n_page_invalidations{0};
+u64 tcache::n_full_invalidations{0};
+u64 tcache::n_evictions{0};
+std::mutex tcache::mtx;
 
-void tcache::Init()
+void tcache::Init(size_t code_pool_size)
 {
+    assert(code_pool_size <= CODE_POOL_SIZE);
+    code_gen_size = rounddown(code_pool_size / N_GENERATIONS, (size_t) 4096);
     l1_cache.fill(nullptr);
-    l1_brind_cache.fill({0, nullptr});
-    tcache_map.clear();
+    l1_brind_cache.fill({});
+    page_dir.fill({});
+    idx_pool.Init(IDX_POOL_SIZE, PROT_READ | PROT_WRITE);
     tb_pool.Init(TB_POOL_SIZE, PROT_READ | PROT_WRITE);
-    code_pool.Init(CODE_POOL_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC);
+    code_pool.Init(code_gen_size * N_GENERATIONS,
+                   PROT_READ | PROT_WRITE | PROT_EXEC);
 }
 
 void tcache::Destroy()
 {
     l1_cache.fill(nullptr);
-    l1_brind_cache.fill({0, nullptr});
-    tcache_map.clear();
+    l1_brind_cache.fill({});
+    page_dir.fill({});
+    idx_pool.Destroy();
     tb_pool.Destroy();
     code_pool.Destroy();
 }
 
 void tcache::Invalidate()
+{
+    std::lock_guard lock(mtx);
+    InvalidateLocked();
+}
+
+void tcache::InvalidateLocked()
 {
     l1_cache.fill(nullptr);
-    l1_brind_cache.fill({0, nullptr});
-    tcache_map.clear();
-    tb_pool.Reset();
-    code_pool.Reset();
+    l1_brind_cache.fill({});
+    page_dir.fill({});  // the only place page keys are reclaimed
+    idx_pool.Reset();
+    gens.fill({});
+    cur_gen = 0;
+    __atomic_store_n(&evict_pending, false, __ATOMIC_RELAXED);
     link_map.clear();
+    brind_ic_map.clear();
+    xpage_map.clear();
+    n_blocks = 0;
+    n_full_invalidations++;
+    __atomic_add_fetch(&flush_count, 1, __ATOMIC_RELEASE);
 }
 
 void tcache::InvalidatePage(u32 pvaddr)
 {
     assert(rounddown(pvaddr, mmu::PAGE_SIZE) == pvaddr);
-    for (auto it = link_map.upper_bound(pvaddr);
-         it->first < pvaddr + mmu::PAGE_SIZE;) {
+    std::lock_guard lock(mtx);
+    n_page_invalidations++;
+    for (auto it = link_map.lower_bound(pvaddr);
+         it != link_map.end() && it->first < pvaddr + mmu::PAGE_SIZE;) {
         it->second->LinkLazyJIT();
         it = link_map.erase(it);
     }
-    for (auto it = tcache_map.upper_bound(pvaddr);
-         it->first < pvaddr + mmu::PAGE_SIZE;) {
-        it = tcache_map.erase(it);
+    for (auto it = brind_ic_map.lower_bound(pvaddr);
+         it != brind_ic_map.end() && it->first < pvaddr + mmu::PAGE_SIZE;) {
+        __atomic_store_n(&it->second->raw, BrindCacheEntry().raw,
+                         __ATOMIC_RELAXED);
+        it = brind_ic_map.erase(it);
+    }
+    // Regions entered from other pages, but containing code from this one
+    for (auto it = xpage_map.lower_bound(pvaddr);
+         it != xpage_map.end() && it->first == pvaddr;) {
+        RemoveLocked(it->second);
+        it = xpage_map.erase(it);
+    }
+    if (auto *page = LookupPage(pvaddr)) {
+        n_blocks -= page->size;
+        __atomic_store_n(&page->size, 0, __ATOMIC_RELEASE);
     }
     for (auto &e : l1_cache) {
-        if (rounddown(e->ip, mmu::PAGE_SIZE) == pvaddr)
-            e = nullptr;
+        auto *tb = __atomic_load_n(&e, __ATOMIC_RELAXED);
+        if (tb && rounddown(tb->ip, mmu::PAGE_SIZE) == pvaddr)
+            __atomic_store_n(&e, nullptr, __ATOMIC_RELAXED);
     }
     for (auto &e : l1_brind_cache) {
-        if (rounddown(e.gip, mmu::PAGE_SIZE) == pvaddr)
-            e = {0, 0};
+        BrindCacheEntry cur;
+        cur.raw = __atomic_load_n(&e.raw, __ATOMIC_RELAXED);
+        if (rounddown(cur.gip, mmu::PAGE_SIZE) == pvaddr)
+            __atomic_store_n(&e.raw, BrindCacheEntry().raw, __ATOMIC_RELAXED);
+    }
+}
+
+tcache::PageBucket *tcache::LookupPage(u32 gip)
+{
+    u32 pkey = (gip >> mmu::PAGE_BITS) + 1;
+    u32 h = pdirhash(pkey);
+    // Keys are reclaimed only by Invalidate, the directory may be full
+    for (u32 n = 0; n < page_dir.size(); ++n) {
+        auto *page = &page_dir[h];
+        u32 cur = __atomic_load_n(&page->pkey, __ATOMIC_ACQUIRE);
+        if (likely(cur == pkey))
+            return page;
+        if (cur == 0)
+            return nullptr;
+        h = (h + 1) & (page_dir.size() - 1);
+    }
+    return nullptr;
+}
+
+tcache::PageBucket *tcache::LookupOrCreatePage(u32 gip)
+{
+    u32 pkey = (gip >> mmu::PAGE_BITS) + 1;
+    u32 h = pdirhash(pkey);
+    for (u32 n = 0; n < page_dir.size(); ++n) {
+        auto *page = &page_dir[h];
+        if (page->pkey == pkey)
+            return page;
+        if (page->pkey == 0) {
+            page->size = page->capacity = 0;
+            page->tbs = nullptr;
+            __atomic_store_n(&page->pkey, pkey, __ATOMIC_RELEASE);
+            return page;
+        }
+        h = (h + 1) & (page_dir.size() - 1);
     }
+    Panic("tcache page directory overflow");
+}
+
+TBlock *tcache::Insert(TBlock *tb)
+{
+    std::lock_guard lock(mtx);
+    gens[GenerationOf(tb)].n_inflight--;
+    auto *page = LookupOrCreatePage(tb->ip);
+    auto cmp = [](TBlock *a, u32 ip) { return a->ip < ip; };
+    auto *pos = std::lower_bound(page->begin(), page->end(), tb->ip, cmp);
+
+    if (pos == page->end() || (*pos)->ip != tb->ip) {
+        if (page->size == page->capacity) {
+            u32 capacity =
+                std::max(page->capacity * 2, PAGE_BUCKET_MIN_CAPACITY);
+            auto *tbs = idx_pool.Allocate<TBlock *>(capacity);
+            if (tbs == nullptr)
+                Panic("tcache index pool overflow");
+            u32 pos_idx = pos - page->begin();
+            memcpy(tbs, page->tbs, sizeof(TBlock *) * page->size);
+            // Old array is retired, not freed: readers may still scan it
+            __atomic_store_n(&page->tbs, tbs, __ATOMIC_RELEASE);
+            page->capacity = capacity;
+            pos = page->begin() + pos_idx;
+        }
+        // Shift element-wise, concurrent readers see a sorted array with a
+        // duplicate at worst, which results in a miss
+        for (auto *it = page->end(); it != pos; --it)
+            __atomic_store_n(it, *(it - 1), __ATOMIC_RELAXED);
+        __atomic_store_n(pos, tb, __ATOMIC_RELAXED);
+        __atomic_store_n(&page->size, page->size + 1, __ATOMIC_RELEASE);
+        n_blocks++;
+    }
+    __atomic_store_n(&l1_cache[l1hash(tb->ip)], *pos, __ATOMIC_RELEASE);
+    return *pos;
+}
+
+void tcache::RemoveLocked(TBlock *tb)
+{
+    auto *page = LookupPage(tb->ip);
+    if (page == nullptr)
+        return;
+    auto *pos = std::find(page->begin(), page->end(), tb);
+    if (pos == page->end())
+        return;
+
+    auto range = link_map.equal_range(tb->ip);
+    for (auto it = range.first; it != range.second; ++it)
+        it->second->LinkLazyJIT();
+    link_map.erase(range.first, range.second);
+
+    auto ic_range = brind_ic_map.equal_range(tb->ip);
+    for (auto it = ic_range.first; it != ic_range.second; ++it)
+        __atomic_store_n(&it->second->raw, BrindCacheEntry().raw,
+                         __ATOMIC_RELAXED);
+    brind_ic_map.erase(ic_range.first, ic_range.second);
+
+    for (auto *it = pos; it + 1 != page->end(); ++it)
+        __atomic_store_n(it, *(it + 1), __ATOMIC_RELAXED);
+    __atomic_store_n(&page->size, page->size - 1, __ATOMIC_RELEASE);
+    n_blocks--;
+
+    auto &l1e = l1_cache[l1hash(tb->ip)];
+    if (__atomic_load_n(&l1e, __ATOMIC_RELAXED) == tb)
+        __atomic_store_n(&l1e, nullptr, __ATOMIC_RELAXED);
+    auto &bre = l1_brind_cache[l1hash(tb->ip)];
+    BrindCacheEntry cur;
+    cur.raw = __atomic_load_n(&bre.raw, __ATOMIC_RELAXED);
+    if (cur.gip == tb->ip)
+        __atomic_store_n(&bre.raw, BrindCacheEntry().raw, __ATOMIC_RELAXED);
+}
+
+void tcache::AddPageDependency(TBlock *tb, u32 pvaddr)
+{
+    assert(rounddown(pvaddr, mmu::PAGE_SIZE) == pvaddr);
+    std::lock_guard lock(mtx);
+    xpage_map.insert({pvaddr, tb});
+}
+
+bool tcache::LinkBranch(jitabi::ppoint::BranchSlot *slot, TBlock *tgt)
+{
+    std::lock_guard lock(mtx);
+    if (LookupFull(tgt->ip) != tgt)
+        return false;
+    slot->Link(tgt->tcode.ptr);
+    tgt->flags.is_segment_entry |= slot->flags.cross_segment;
+    link_map.insert({tgt->ip, slot});
+    return true;
 }
 
-void tcache::Insert(TBlock *tb)
+void tcache::FillBrindIC(BrindCacheEntry *ic, TBlock *tb)
 {
-    tcache_map.insert({tb->ip, tb});
-    l1_cache[l1hash(tb->ip)] = tb;
+    std::lock_guard lock(mtx);
+    if (LookupFull(tb->ip) != tb)
+        return;
+    BrindCacheEntry e{tb->ip, (u32) ((u8 *) tb->tcode.ptr - CodeBase())};
+    for (u32 i = 0; i < BRIND_IC_SIZE; ++i) {
+        // Concurrent misses of the same site may race here
+        if (ic[i].gip == tb->ip)
+            return;
+        if (ic[i].gip == BrindCacheEntry::GIP_EMPTY) {
+            __atomic_store_n(&ic[i].raw, e.raw, __ATOMIC_RELEASE);
+            brind_ic_map.insert({tb->ip, &ic[i]});
+            return;
+        }
+    }
 }
 
 TBlock *tcache::LookupUpperBound(u32 gip)
 {
-    auto it = tcache_map.upper_bound(gip);
-    if (it == tcache_map.end())
+    auto *page = LookupPage(gip);
+    if (page == nullptr)
         return nullptr;
-    return it->second;
+    auto [beg, end] = PageSnapshot(page);
+    auto cmp = [](u32 ip, TBlock *a) { return ip < a->ip; };
+    auto *it = std::upper_bound(beg, end, gip, cmp);
+    if (it == end)
+        return nullptr;
+    return *it;
 }
 
 TBlock *tcache::LookupFull(u32 gip)
 {
-    auto it = tcache_map.find(gip);
-    if (likely(it != tcache_map.end()))
-        return it->second;
+    auto *page = LookupPage(gip);
+    if (unlikely(page == nullptr))
+        return nullptr;
+    auto [beg, end] = PageSnapshot(page);
+    auto cmp = [](TBlock *a, u32 ip) { return a->ip < ip; };
+    auto *it = std::lower_bound(beg, end, gip, cmp);
+    if (likely(it != end && (*it)->ip == gip))
+        return *it;
     return nullptr;
 }
 
-TBlock *tcache::AllocateTBlock()
+TBlock *tcache::AllocateTBlock(size_t code_sz, u16 align)
+{
+    std::lock_guard lock(mtx);
+    while (true) {
+        auto &gen = gens[cur_gen];
+        size_t code_start = roundup(gen.code_used, (size_t) align);
+        if (code_start + code_sz <= code_gen_size &&
+            gen.tb_used + sizeof(TBlock) <= TB_GEN_SIZE) {
+            auto *mem = tb_pool.BasePtr() + cur_gen * TB_GEN_SIZE + gen.tb_used;
+            auto *tb = new (mem) TBlock{};
+            tb->tcode.ptr = CodeBase() + cur_gen * code_gen_size + code_start;
+            tb->tcode.size = code_sz;
+            gen.code_used = code_start + code_sz;
+            gen.tb_used += sizeof(TBlock);
+            gen.n_inflight++;
+            return tb;
+        }
+        if (gen.IsEmpty())
+            Panic("region doesn't fit into code cache generation");
+        u32 next = (cur_gen + 1) % N_GENERATIONS;
+        if (!gens[next].IsEmpty()) {
+            __atomic_store_n(&evict_pending, true, __ATOMIC_RELAXED);
+            return nullptr;
+        }
+        cur_gen = next;
+    }
+}
+
+void tcache::EvictPending()
+{
+    std::lock_guard lock(mtx);
+    u32 victim = (cur_gen + 1) % N_GENERATIONS;
+    // Regions being compiled into the victim are waited for
+    if (!evict_pending || gens[victim].n_inflight)
+        return;
+    EvictLocked(victim);
+    n_evictions++;
+    __atomic_store_n(&evict_pending, false, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&flush_count, 1, __ATOMIC_RELEASE);
+}
+
+void tcache::EvictLocked(u32 gen)
 {
-    auto *res = tb_pool.Allocate<TBlock>();
-    if (res == nullptr)
-        Invalidate();
-    return new (res) TBlock{};
+    auto *tb_beg = (TBlock *) (tb_pool.BasePtr() + gen * TB_GEN_SIZE);
+    auto *tb_end = tb_beg + gens[gen].tb_used / sizeof(TBlock);
+    // Unlinks incoming branches and inline cache entries
+    for (auto *tb = tb_beg; tb != tb_end; ++tb)
+        RemoveLocked(tb);
+
+    // Branch slots and inline caches embedded in the evicted code
+    u8 *code_beg = CodeBase() + gen * code_gen_size;
+    auto in_gen = [code_beg](void *p) {
+        return (uptr) p - (uptr) code_beg < code_gen_size;
+    };
+    std::erase_if(link_map, [&](auto const &e) { return in_gen(e.second); });
+    std::erase_if(brind_ic_map,
+                  [&](auto const &e) { return in_gen(e.second); });
+    std::erase_if(xpage_map, [&](auto const &e) {
+        return e.second >= tb_beg && e.second < tb_end;
+    });
+    // TBlocks left out of the index are not scrubbed by RemoveLocked
+    for (auto &e : l1_cache) {
+        auto *tb = __atomic_load_n(&e, __ATOMIC_RELAXED);
+        if (tb >= tb_beg && tb < tb_end)
+            __atomic_store_n(&e, nullptr, __ATOMIC_RELAXED);
+    }
+    for (auto &e : l1_brind_cache) {
+        BrindCacheEntry cur;
+        cur.raw = __atomic_load_n(&e.raw, __ATOMIC_RELAXED);
+        if (cur.gip != BrindCacheEntry::GIP_EMPTY &&
+            in_gen(CodeBase() + cur.code_offs)) {
+            __atomic_store_n(&e.raw, BrindCacheEntry().raw, __ATOMIC_RELAXED);
+        }
+    }
+    gens[gen] = {};
 }
 
-void *tcache::AllocateCode(size_t code_sz, u16 align)
+// Counters of exiting threads are folded into exited_counters
+void tcache::RegisterThreadCounters()
 {
-    void *res = code_pool.Allocate(code_sz, align);
-    if (res == nullptr)
-        Invalidate();
-    return res;
+    struct Unregister {
+        ~Unregister()
+        {
+            std::lock_guard lock(mtx);
+            auto *tc = &thread_counters;
+#define _(name) exited_counters.name += tc->name;
+            TCACHE_THREAD_COUNTERS(_)
+#undef _
+            std::erase(live_counters, tc);
+        }
+    };
+    static thread_local Unregister unregister;
+
+    std::lock_guard lock(mtx);
+    live_counters.push_back(&thread_counters);
+    thread_counters.registered = true;
+}
+
+tcache::Stats tcache::GetStats()
+{
+    std::lock_guard lock(mtx);
+    Stats st{};
+#define _(name) st.name = exited_counters.name;
+    TCACHE_THREAD_COUNTERS(_)
+#undef _
+    for (auto *tc : live_counters) {
+#define _(name) st.name += __atomic_load_n(&tc->name, __ATOMIC_RELAXED);
+        TCACHE_THREAD_COUNTERS(_)
+#undef _
+    }
+
+    st.blocks = n_blocks;
+    for (auto const &gen : gens)
+        st.code_bytes += gen.code_used;
+    st.code_capacity = code_gen_size * N_GENERATIONS;
+    st.links = link_map.size();
+    st.brind_ic_entries = brind_ic_map.size();
+    st.xpage_deps = xpage_map.size();
+    st.page_invalidations = n_page_invalidations;
+    st.full_invalidations = n_full_invalidations;
+    st.evictions = n_evictions;
+    return st;
+}
+
+void tcache::PrintStats(FILE *f)
+{
+    auto st = GetStats();
+    auto pct = [](u64 n, u64 total) {
+        return total ? 100.0 * n / total : 0.0;
+    };
+
+    fprintf(f, "tcache stats:\n");
+    fprintf(f, "  blocks:             %llu\n", (unsigned long long) st.blocks);
+    fprintf(f, "  code bytes:         %llu of %llu (%.1f%%)\n",
+            (unsigned long long) st.code_bytes,
+            (unsigned long long) st.code_capacity,
+            pct(st.code_bytes, st.code_capacity));
+    fprintf(f, "  links:              %llu\n", (unsigned long long) st.links);
+    fprintf(f, "  brind ic entries:   %llu\n",
+            (unsigned long long) st.brind_ic_entries);
+    fprintf(f, "  xpage deps:         %llu\n",
+            (unsigned long long) st.xpage_deps);
+    fprintf(f, "  lookups:            %llu, l1 hits %.1f%%, misses %llu\n",
+            (unsigned long long) st.lookups, pct(st.l1_hits, st.lookups),
+            (unsigned long long) st.lookup_misses);
+    fprintf(f, "  dispatches:         %llu\n",
+            (unsigned long long) st.dispatches);
+    fprintf(f, "  brind misses:       %llu\n",
+            (unsigned long long) st.brind_misses);
+    fprintf(f, "  lazy links:         %llu\n",
+            (unsigned long long) st.lazy_links);
+    fprintf(f, "  page invalidations: %llu\n",
+            (unsigned long long) st.page_invalidations);
+    fprintf(f, "  full invalidations: %llu\n",
+            (unsigned long long) st.full_invalidations);
+    fprintf(f, "  evictions:          %llu\n",
+            (unsigned long long) st.evictions);
 }
 
 }  // namespace dbt
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <array>
-#include <bitset>
+#include <cstdio>
 #include <map>
+#include <mutex>
+#include <vector>
 
 #include "arena.h"
 #include "mmu.h"
@@ -22,61 +24,178 @@ struct alignas(8) TBlock {
 
     TCode tcode{};
     u32 ip{0};
+    // Not bitfields: flags are updated from different threads
     struct {
-        bool is_brind_target : 1 {false};
-        bool is_segment_entry : 1 {false};
+        bool is_brind_target{false};
+        bool is_segment_entry{false};
     } flags;
 };
 
+/* Concurrency model:
+ *  - Lookup/LookupFull/LookupUpperBound are lock-free. Readers may observe
+ *    a transient miss while a page bucket is updated, callers fall back to
+ *    compilation and Insert resolves duplicates.
+ *  - Insert, LinkBranch, FillBrindIC, InvalidatePage and pool allocations
+ *    are serialized by tcache::mtx.
+ *  - Invalidate releases all translations at once and requires other guest
+ *    threads to stay out of translated code, so does EvictPending.
+ */
+// Per-thread event counters:
+//  lookups, l1_hits: Lookup calls and l1_cache hits among them
+//  lookup_misses: Lookup found no translation
+//  brind_misses: indirect branches missed inline and l1_brind_cache in JIT
+//  lazy_links: BranchSlots resolved by the link stub
+//  dispatches: entries to translated code from Execute
+#define TCACHE_THREAD_COUNTERS(_) \
+    _(lookups)                    \
+    _(l1_hits)                    \
+    _(lookup_misses)              \
+    _(brind_misses)               \
+    _(lazy_links)                 \
+    _(dispatches)
+
 struct tcache {
-    static void Init();
+    static constexpr size_t CODE_POOL_SIZE = 128 * 1024 * 1024;
+    static_assert(CODE_POOL_SIZE <= (1ull << 31));  // BrindCacheEntry, rel32
+
+    // Code pool is at most CODE_POOL_SIZE, smaller ones put it under pressure
+    static void Init(size_t code_pool_size = CODE_POOL_SIZE);
     static void Destroy();
     static void Invalidate();
-    static void Insert(TBlock *tb);
+    // Returns the indexed TBlock, which differs from tb if ip was inserted
+    // concurrently. tb is left unused then
+    static TBlock *Insert(TBlock *tb);
     static void InvalidatePage(u32 pvaddr);
 
+    // Region of tb contains code from page pvaddr other than its entry page
+    static void AddPageDependency(TBlock *tb, u32 pvaddr);
+
     static TBlock *Lookup(u32 ip)
     {
+        CountEvent(&ThreadCounters::lookups);
         auto hash = l1hash(ip);
-        auto *tb = l1_cache[hash];
-        if (tb != nullptr && tb->ip == ip)
+        auto *tb = __atomic_load_n(&l1_cache[hash], __ATOMIC_ACQUIRE);
+        if (tb != nullptr && tb->ip == ip) {
+            CountEvent(&ThreadCounters::l1_hits);
             return tb;
+        }
         tb = LookupFull(ip);
         if (tb != nullptr)
-            l1_cache[hash] = tb;
+            __atomic_store_n(&l1_cache[hash], tb, __ATOMIC_RELEASE);
+        else
+            CountEvent(&ThreadCounters::lookup_misses);
         return tb;
     }
 
+    // Returns first TBlock with ip > gip in the same guest page
     static TBlock *LookupUpperBound(u32 gip);
 
     static void CacheBrind(TBlock *tb)
     {
-        l1_brind_cache[l1hash(tb->ip)] = {tb->ip, tb->tcode.ptr};
-        tb->flags.is_brind_target = true;
+        BrindCacheEntry e{tb->ip, (u32) ((u8 *) tb->tcode.ptr - CodeBase())};
+        __atomic_store_n(&l1_brind_cache[l1hash(tb->ip)].raw, e.raw,
+                         __ATOMIC_RELEASE);
+        __atomic_store_n(&tb->flags.is_brind_target, true, __ATOMIC_RELAXED);
+    }
+
+    // Patch slot to jump to tgt and record the link for invalidation.
+    // Returns false if tgt was invalidated concurrently.
+    static bool LinkBranch(jitabi::ppoint::BranchSlot *slot, TBlock *tgt);
+
+    // Returns TBlock with tcode pointing to code_sz bytes of code memory, or
+    // nullptr if all generations are taken. The oldest generation is then
+    // evicted by the next EvictPending call
+    static TBlock *AllocateTBlock(size_t code_sz, u16 align);
+
+    static bool IsEvictionPending()
+    {
+        return __atomic_load_n(&evict_pending, __ATOMIC_RELAXED);
     }
 
-    static void RecordLink(jitabi::ppoint::BranchSlot *slot,
-                           TBlock *tgt,
-                           bool cross_segment)
+    static void EvictPending();
+
+    static u8 *CodeBase() { return code_pool.BasePtr(); }
+
+    // Number of full invalidations and evictions, code pointers kept outside
+    // of tcache are stale once it changes
+    static u32 FlushCount()
     {
-        tgt->flags.is_segment_entry |= cross_segment;
-        link_map.insert({tgt->ip, slot});
+        return __atomic_load_n(&flush_count, __ATOMIC_ACQUIRE);
     }
 
-    static void *AllocateCode(size_t sz, u16 align);
-    static TBlock *AllocateTBlock();
+    struct ThreadCounters {
+#define _(name) u64 name;
+        TCACHE_THREAD_COUNTERS(_)
+#undef _
+        bool registered;
+    };
+
+    // Set before guest and compiler threads start, counting is off by default
+    static void EnableStats() { stats_enabled = true; }
+    static bool StatsEnabled() { return stats_enabled; }
+
+    // Plain increment, threads only write their own counters
+    static ALWAYS_INLINE void CountEvent(u64 ThreadCounters::*ctr)
+    {
+        if (likely(!stats_enabled))
+            return;
+        if (unlikely(!thread_counters.registered))
+            RegisterThreadCounters();
+        u64 *c = &(thread_counters.*ctr);
+        __atomic_store_n(c, *c + 1, __ATOMIC_RELAXED);
+    }
+
+    struct Stats {
+        // Summed over live and exited threads
+#define _(name) u64 name;
+        TCACHE_THREAD_COUNTERS(_)
+#undef _
+        u64 blocks;
+        u64 code_bytes;  // allocated in live generations
+        u64 code_capacity;
+        u64 links;  // patched BranchSlots
+        u64 brind_ic_entries;
+        u64 xpage_deps;
+        u64 page_invalidations;
+        u64 full_invalidations;
+        u64 evictions;
+    };
+
+    static Stats GetStats();
+    static void PrintStats(FILE *f);
 
     static constexpr u32 L1_CACHE_BITS = 12;
     using L1Cache = std::array<TBlock *, 1u << L1_CACHE_BITS>;
     static L1Cache l1_cache;
 
-    struct BrindCacheEntry {
-        u32 gip; // global instruction pointer
-        void *code;
+    // Single qword, so that translated code loads gip and code atomically
+    union BrindCacheEntry {
+        BrindCacheEntry() : BrindCacheEntry(GIP_EMPTY, 0) {}
+        BrindCacheEntry(u32 gip_, u32 code_offs_)
+            : gip(gip_), code_offs(code_offs_)
+        {
+        }
+
+        struct {
+            u32 gip;        // global instruction pointer
+            u32 code_offs;  // relative to CodeBase()
+        };
+        u64 raw;
+
+        // never matches: guest ip is at least 2-byte aligned
+        static constexpr u32 GIP_EMPTY = 1;
     };
     using L1BrindCache = std::array<BrindCacheEntry, 1u << L1_CACHE_BITS>;
     static L1BrindCache l1_brind_cache;
 
+    // Entries of per-site gbrind inline caches, embedded in translated code.
+    // Sites with all entries taken use l1_brind_cache
+    static constexpr u32 BRIND_IC_SIZE = 4;
+
+    // Store tb to a free entry of gbrind inline cache ic and record it for
+    // invalidation. Full caches are left as is
+    static void FillBrindIC(BrindCacheEntry *ic, TBlock *tb);
+
     static ALWAYS_INLINE u32 l1hash(u32 ip)
     {
         return (ip >> 2) & ((1ull << L1_CACHE_BITS) - 1);
@@ -84,17 +203,92 @@ struct tcache {
 
 private:
     static TBlock *LookupFull(u32 ip);
+    static void InvalidateLocked();
+    static void RemoveLocked(TBlock *tb);
+    static void EvictLocked(u32 gen);
 
-    using MapType = std::map<u32, TBlock *>;
-    static MapType tcache_map;
+    // Two-level translation index: guest page -> sorted array of TBlocks.
+    // Page directory is open-addressed, bucket arrays live in idx_pool and
+    // grow geometrically, so Insert doesn't touch the heap.
+    struct PageBucket {
+        u32 pkey;  // (gip >> PAGE_BITS) + 1, 0 means empty, published last
+        u32 size;  // published after tbs
+        u32 capacity;
+        TBlock **tbs;  // sorted by ip, retired arrays stay valid until flush
+
+        TBlock **begin() const { return tbs; }
+        TBlock **end() const { return tbs + size; }
+    };
+
+    static constexpr u32 PAGE_DIR_BITS = 16;
+    using PageDir = std::array<PageBucket, 1u << PAGE_DIR_BITS>;
+    static PageDir page_dir;
+
+    static ALWAYS_INLINE u32 pdirhash(u32 pkey)
+    {
+        return (pkey * 0x9e3779b1u) >> (32 - PAGE_DIR_BITS);
+    }
+
+    static std::pair<TBlock **, TBlock **> PageSnapshot(PageBucket *page)
+    {
+        u32 size = __atomic_load_n(&page->size, __ATOMIC_ACQUIRE);
+        auto *tbs = __atomic_load_n(&page->tbs, __ATOMIC_ACQUIRE);
+        return {tbs, tbs + size};
+    }
+
+    static PageBucket *LookupPage(u32 gip);
+    static PageBucket *LookupOrCreatePage(u32 gip);
+
+    static constexpr u32 PAGE_BUCKET_MIN_CAPACITY = 8;
+    static constexpr size_t IDX_POOL_SIZE = 32 * 1024 * 1024;
+    static MemArena idx_pool;
 
     static constexpr size_t TB_POOL_SIZE = 32 * 1024 * 1024;
     static MemArena tb_pool;
 
-    static constexpr size_t CODE_POOL_SIZE = 128 * 1024 * 1024;
     static MemArena code_pool;
 
+    // Code and TBlock pools are split into generations filled in FIFO order,
+    // the oldest one is evicted with all its regions on exhaustion
+    static constexpr u32 N_GENERATIONS = 8;
+    static size_t code_gen_size;
+    static constexpr size_t TB_GEN_SIZE = TB_POOL_SIZE / N_GENERATIONS;
+
+    struct Generation {
+        bool IsEmpty() const { return tb_used == 0; }
+
+        size_t code_used;
+        size_t tb_used;
+        u32 n_inflight;  // allocated, but not inserted yet
+    };
+    static std::array<Generation, N_GENERATIONS> gens;
+    static u32 cur_gen;
+    static bool evict_pending;
+
+    static u32 GenerationOf(TBlock *tb)
+    {
+        return ((u8 *) tb - tb_pool.BasePtr()) / TB_GEN_SIZE;
+    }
+
     static std::multimap<u32, jitabi::ppoint::BranchSlot *> link_map;
+    static std::multimap<u32, BrindCacheEntry *> brind_ic_map;
+    static std::multimap<u32, TBlock *> xpage_map;
+
+    static u32 flush_count;
+
+    static bool stats_enabled;
+    static constinit thread_local ThreadCounters thread_counters;
+    static std::vector<ThreadCounters *> live_counters;
+    static ThreadCounters exited_counters;
+    static void RegisterThreadCounters();
+
+    // Updated under mtx
+    static u64 n_blocks;
+    static u64 n_page_invalidations;
+    static u64 n_full_invalidations;
+    static u64 n_evictions;
+
+    static std::mutex mtx;
 };
 
 }  // namespace dbt
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cpuid.h>
+#include <ctime>
+
+#include "util/hostclock.h"
+
+namespace dbt
+{
+static u64 MonotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u64 MakeMult(u64 ns, u64 tsc)
+{
+    if (tsc == 0)
+        Panic("HostClock: TSC is not monotonic");
+    return ((unsigned __int128) ns << HostClock::shift) / tsc;
+}
+
+// TSC frequency in Hz from the crystal clock leaf, 0 if not reported
+static u64 CpuidTscHz()
+{
+    u32 a, b, c, d;
+    if (__get_cpuid_max(0, nullptr) < 0x15)
+        return 0;
+    __cpuid(0x15, a, b, c, d);
+    if (!a || !b || !c)
+        return 0;
+    return (u64) c * b / a;
+}
+
+// Measured against CLOCK_MONOTONIC if CPUID has no frequency, the window
+// is long enough to keep the initial error well below 0.1%
+HostClock HostClock::Calibrate()
+{
+    static constexpr u64 window_ns = 20000000;
+
+    HostClock clock{};
+    u64 ns_begin = MonotonicNs();
+    u64 tsc_begin = ReadTsc();
+    clock.tsc_base = tsc_begin;
+    clock.ns_base = ns_begin;
+
+    if (u64 hz = CpuidTscHz()) {
+        clock.mult = MakeMult(1000000000, hz);
+        clock.mult_exact = true;
+        clock.tsc0 = tsc_begin;
+        clock.ns0 = ns_begin;
+    } else {
+        u64 ns_end;
+        do {
+            ns_end = MonotonicNs();
+        } while (ns_end - ns_begin < window_ns);
+        u64 tsc_end = ReadTsc();
+        clock.mult = MakeMult(ns_end - ns_begin, tsc_end - tsc_begin);
+        clock.tsc0 = tsc_end;
+        clock.ns0 = ns_end;
+    }
+    clock.anchor_period_tsc =
+        ((unsigned __int128) anchor_period_ns << shift) / clock.mult;
+    return clock;
+}
+
+// Guest time never goes back, an anchor ahead of CLOCK_MONOTONIC is kept
+void HostClock::Reanchor()
+{
+    u64 tsc = ReadTsc();
+    u64 ns = MonotonicNs();
+    u64 ns_cur = TscToNs(tsc);
+
+    if (!mult_exact)
+        mult = MakeMult(ns - ns_base, tsc - tsc_base);
+    tsc0 = tsc;
+    ns0 = std::max(ns, ns_cur);
+}
+
+HostClock &HostClock::Get()
+{
+    static HostClock clock = Calibrate();
+    active.store(&clock, std::memory_order_relaxed);
+    return clock;
+}
+}  // namespace dbt
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <x86intrin.h>
+
+#include "util/common.h"
+
+namespace dbt
+{
+// Host TSC converted to CLOCK_MONOTONIC, ns = ns0 + (tsc - tsc0) * mult in
+// 32.32 fixed point. Invariant TSC is assumed. The anchor is moved to the
+// current time periodically, so rate errors do not accumulate. Translated
+// code reads the fields from memory
+struct HostClock {
+    static constexpr u8 shift = 32;
+    static constexpr u64 anchor_period_ns = 100000000;
+
+    // Calibrated on first use
+    static HostClock &Get();
+
+    static ALWAYS_INLINE u64 ReadTsc() { return __rdtsc(); }
+
+    ALWAYS_INLINE u64 TscToNs(u64 tsc) const
+    {
+        auto delta = (unsigned __int128) (tsc - tsc0) * mult;
+        return ns0 + (u64) (delta >> shift);
+    }
+
+    ALWAYS_INLINE u64 Now() const { return TscToNs(ReadTsc()); }
+
+    // Called by the guest thread only, translated code reads the anchor
+    // unsynchronized
+    ALWAYS_INLINE void Update()
+    {
+        if (unlikely(ReadTsc() - tsc0 > anchor_period_tsc))
+            Reanchor();
+    }
+
+    // Same, but does not calibrate the clock if nobody used it yet
+    static ALWAYS_INLINE void UpdateIfUsed()
+    {
+        if (auto *clock = active.load(std::memory_order_relaxed))
+            clock->Update();
+    }
+
+    u64 tsc0;
+    u64 ns0;
+    u64 mult;
+    u64 anchor_period_tsc;
+    // First anchor, mult is refined over the whole run unless the TSC
+    // frequency is reported by CPUID
+    u64 tsc_base;
+    u64 ns_base;
+    bool mult_exact;
+
+private:
+    static HostClock Calibrate();
+    void Reanchor();
+
+    static inline std::atomic<HostClock *> active{};
+};
+}  // namespace dbt